@@ -0,0 +1,77 @@
+#!/usr/bin/python
+
+# Copyright (C) 2013-2015 by Massachusetts Institute of Technology
+#
+# This file is part of zsim.
+#
+# zsim is free software; you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, version 2.
+#
+# If you use this software in your research, we request that you reference
+# the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+# Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+# source of the simulator in any publications that use this software, and that
+# you send us a citation of your work.
+#
+# zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program. If not, see <http://www.gnu.org/licenses/>.
+
+# Compares the stats files of two zsim runs, e.g. of the same config simulated
+# by two builds, to check that a change to the stats backends does not change
+# their output. HDF5 files (*.h5) must have the same stats layout and
+# byte-identical records; text files (*.out) must be byte-identical. Note that
+# runs are only reproducible with deterministic configs (e.g., a single
+# simulated core and process, and no host-time-based periodic stats).
+#
+# Usage: compare_stats.py <run dir A> <run dir B>
+
+import filecmp, glob, os, sys
+import h5py
+
+def compareH5(fa, fb):
+    da = h5py.File(fa, "r")["stats"]["root"]
+    db = h5py.File(fb, "r")["stats"]["root"]
+    if da.dtype != db.dtype:
+        return "different stats layout"
+    if da.shape != db.shape:
+        return "%d vs %d records" % (da.shape[0], db.shape[0])
+    ra, rb = da[...], db[...]
+    if ra.tobytes() == rb.tobytes():
+        return None
+    for i in range(ra.shape[0]):
+        if ra[i].tobytes() != rb[i].tobytes():
+            return "first difference in record %d" % i
+    return "different contents"
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: %s <run dir A> <run dir B>" % sys.argv[0])
+        sys.exit(1)
+    dirA, dirB = sys.argv[1:]
+    names = sorted(os.path.basename(f) for f in glob.glob(os.path.join(dirA, "*.h5")) + glob.glob(os.path.join(dirA, "*.out")))
+    if not names:
+        print("No stats files in %s" % dirA)
+        sys.exit(1)
+
+    failed = 0
+    for name in names:
+        fa, fb = os.path.join(dirA, name), os.path.join(dirB, name)
+        if not os.path.exists(fb):
+            err = "missing in %s" % dirB
+        elif name.endswith(".h5"):
+            err = compareH5(fa, fb)
+        else:
+            err = None if filecmp.cmp(fa, fb, shallow=False) else "different contents"
+        print("%-24s %s" % (name, err if err else "OK"))
+        if err: failed += 1
+    print("%d/%d files match" % (len(names) - failed, len(names)))
+    sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+    main()
@@ -40,9 +40,12 @@
 #undef STR
 #undef _STR
 
+mutex hdf5Lock;
+
 #define PT_CHUNKSIZE (1024*256u)  // 256K records (~6MB)
 
 AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()) {
+    scoped_mutex sm(hdf5Lock);
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
 
@@ -68,7 +71,7 @@ AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str())
     curFrameRecord = 0;
     cur = 0;
     max = MIN(PT_CHUNKSIZE, numRecords);
-    buf = max? gm_calloc<PackedAccessRecord>(max) : nullptr;
+    buf = max? gm_calloc<PackedAccessRecord>(max, GM_TAG_TRACE) : nullptr;
 
     if (max) {
         H5PTread_packets(table, 0, max, buf);
@@ -79,6 +82,7 @@ AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str())
 }
 
 void AccessTraceReader::nextChunk() {
+    scoped_mutex sm(hdf5Lock);
     assert(cur == max);
     curFrameRecord += max;
 
@@ -99,6 +103,7 @@ void AccessTraceReader::nextChunk() {
 
 
 AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
+    scoped_mutex sm(hdf5Lock);
     // Create record structure
     hid_t accType = H5Tenum_create(H5T_NATIVE_USHORT);
     uint16_t val;
@@ -157,13 +162,14 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     H5Fclose(fid);
 
     // Initialize buffer
-    buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+    buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE, GM_TAG_TRACE);
     cur = 0;
     max = PT_CHUNKSIZE;
     assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
 }
 
 void AccessTraceWriter::dump(bool cont) {
+    scoped_mutex sm(hdf5Lock);
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
     hid_t table = H5PTopen(fid, "accs");
@@ -186,3 +192,112 @@ void AccessTraceWriter::dump(bool cont) {
     H5PTclose(table);
     H5Fclose(fid);
 }
+
+
+NextUseReader::NextUseReader(std::string _fname) : fname(_fname.c_str()) {
+    scoped_mutex sm(hdf5Lock);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+
+    hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+    uint32_t finished;
+    H5Aread(fAttr, H5T_NATIVE_UINT, &finished);
+    H5Aclose(fAttr);
+
+    if (!finished) panic("Next-use index %s unfinished", fname.c_str());
+
+    hsize_t nPackets;
+    hid_t table = H5PTopen(fid, "nextUse");
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+    H5PTget_num_packets(table, &nPackets);
+    numRecords = nPackets;
+
+    curFrameRecord = 0;
+    cur = 0;
+    max = MIN(PT_CHUNKSIZE, numRecords);
+    buf = max? gm_calloc<uint64_t>(max, GM_TAG_TRACE) : nullptr;
+
+    if (max) {
+        H5PTread_packets(table, 0, max, buf);
+    }
+
+    H5PTclose(table);
+    H5Fclose(fid);
+}
+
+void NextUseReader::nextChunk() {
+    scoped_mutex sm(hdf5Lock);
+    assert(cur == max);
+    curFrameRecord += max;
+
+    if (curFrameRecord < numRecords) {
+        cur = 0;
+        max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
+        hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+        hid_t table = H5PTopen(fid, "nextUse");
+        if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+        H5PTread_packets(table, curFrameRecord, max, buf);
+        H5PTclose(table);
+        H5Fclose(fid);
+    } else {
+        assert_msg(curFrameRecord == numRecords, "%ld %ld", curFrameRecord, numRecords);
+    }
+}
+
+NextUseWriter::NextUseWriter(std::string _fname) : fname(_fname.c_str()) {
+    scoped_mutex sm(hdf5Lock);
+    hid_t fid = H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not create HDF5 file %s", fname.c_str());
+
+    // Same layout as the trace itself: chunked, shuffled and compressed raw dataset
+    hsize_t dims[1] = {0};
+    hsize_t dims_chunk[1] = {PT_CHUNKSIZE};
+    hsize_t maxdims[1] = {H5S_UNLIMITED};
+    hid_t space_id = H5Screate_simple(1, dims, maxdims);
+
+    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(plist_id, 1, dims_chunk);
+    H5Pset_shuffle(plist_id);
+    H5Pset_deflate(plist_id, 9);
+
+    hid_t table = H5Dcreate2(fid, "nextUse", H5T_NATIVE_ULONG, space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+    if (table == H5I_INVALID_HID) panic("Could not create HDF5 dataset");
+    H5Dclose(table);
+
+    hid_t fAttr = H5Acreate2(fid, "finished", H5T_NATIVE_UINT, H5Screate(H5S_SCALAR), H5P_DEFAULT, H5P_DEFAULT);
+    uint32_t finished = 0;
+    H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
+    H5Aclose(fAttr);
+
+    H5Fclose(fid);
+
+    buf = gm_calloc<uint64_t>(PT_CHUNKSIZE, GM_TAG_TRACE);
+    cur = 0;
+    max = PT_CHUNKSIZE;
+}
+
+void NextUseWriter::dump(bool cont) {
+    scoped_mutex sm(hdf5Lock);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+    hid_t table = H5PTopen(fid, "nextUse");
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+    herr_t err = H5PTappend(table, cur, buf);
+    assert(err >= 0);
+
+    if (!cont) {
+        hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+        uint32_t finished = 1;
+        H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
+        H5Aclose(fAttr);
+
+        gm_free(buf);
+        buf = nullptr;
+        max = 0;
+    }
+
+    cur = 0;
+    H5PTclose(table);
+    H5Fclose(fid);
+}
@@ -28,9 +28,15 @@
 
 #include "g_std/g_string.h"
 #include "memory_hierarchy.h"
+#include "mutex.h"
 
 /* HDF5-based classes read and write address traces in a consistent format */
 
+/* The HDF5 library is not thread-safe. All HDF5 calls that may run concurrently with other threads of the same
+ * process (e.g., the stats writer thread) must hold this lock. It is process-local, like the library's state.
+ */
+extern mutex hdf5Lock;
+
 struct AccessRecord {
     Address lineAddr;
     uint64_t reqCycle;
@@ -99,4 +105,58 @@ class AccessTraceWriter : public GlobAlloc {
         void dump(bool cont);
 };
 
+/* Next-use index of a trace, stored in its own file next to the trace. For every record in the trace, it holds the
+ * position (record number) of the next GETS/GETX to the same line, or NEXT_USE_NEVER. Records are read in the same
+ * order as the trace, so a NextUseReader can be advanced in lockstep with an AccessTraceReader.
+ */
+#define NEXT_USE_NEVER ((uint64_t)-1L)
+
+class NextUseReader {
+    private:
+        uint64_t* buf;
+        uint32_t cur;
+        uint32_t max;
+        g_string fname;
+
+        uint64_t curFrameRecord;
+        uint64_t numRecords;
+
+    public:
+        explicit NextUseReader(std::string fname);
+
+        inline bool empty() const {return (cur == max);}
+        uint64_t getNumRecords() const {return numRecords;}
+
+        inline uint64_t read() {
+            assert(cur < max);
+            uint64_t nextUse = buf[cur++];
+            if (unlikely(cur == max)) nextChunk();
+            return nextUse;
+        }
+
+    private:
+        void nextChunk();
+};
+
+class NextUseWriter {
+    private:
+        uint64_t* buf;
+        uint32_t cur;
+        uint32_t max;
+        g_string fname;
+
+    public:
+        explicit NextUseWriter(std::string fname);
+
+        inline void write(uint64_t nextUse) {
+            buf[cur++] = nextUse;
+            if (unlikely(cur == max)) {
+                dump(true);
+                assert(cur < max);
+            }
+        }
+
+        void dump(bool cont);
+};
+
 #endif  // _ACCESS_TRACING_H
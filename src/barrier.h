@@ -31,6 +31,13 @@
  *
  * PARALLELISM CONTROL: The barrier limits the number of threads that run at the same time.
  *
+ * BATCHED WAKEUPS: The threads picked to run are collected in a batch while holding the scheduler lock, and are
+ * released together once the batch is final. The futex wakeups happen outside the lock and fan out as a tree: the
+ * thread that formed the batch wakes the first WAKE_FANOUT threads, and each woken thread wakes WAKE_FANOUT more.
+ * This keeps FUTEX_WAKE syscalls out of the serialized critical section, and spreads the O(n) wakeup cost of a
+ * phase start across the woken threads. A released thread that leaves before waking its children (e.g., because its
+ * process was killed) must have them woken by the scheduler (wakeChildren), or the subtree would never run.
+ *
  * Author: Daniel Sanchez <sanchezd@stanford.edu>
  * Date: Apr 2011
  */
@@ -49,11 +56,16 @@
 #include "locks.h"
 #include "log.h"
 #include "mtrand.h"
+#include "profile_stats.h"
+#include "stats.h"
 
 // Configure futex timeouts (die rather than deadlock)
 #define TIMEOUT_LENGTH 20 //seconds
 #define MAX_TIMEOUTS 10
 
+// Each woken thread wakes up to this many threads of its batch
+#define WAKE_FANOUT 4
+
 //#define DEBUG_BARRIER(args...) info(args)
 #define DEBUG_BARRIER(args...)
 
@@ -69,11 +81,15 @@ class Barrier : public GlobAlloc {
 
         enum State {OFFLINE, WAITING, RUNNING, LEFT};
 
+        static const uint32_t NO_THREAD = (uint32_t)-1;
+
         struct ThreadSyncInfo {
             volatile State state;
             volatile uint32_t futexWord;
             uint32_t lastIdx;
             uint32_t pad;
+            uint64_t wakeNs; //when the thread's wakeup batch was released, for wakeup latency stats
+            uint32_t children[WAKE_FANOUT]; //threads of our batch that we must wake up once we resume
         };
 
         ThreadSyncInfo threadList[MAX_THREADS];
@@ -88,6 +104,18 @@ class Barrier : public GlobAlloc {
 
         uint32_t phaseCount; //INTERNAL, for LEFT->OFFLINE bookkeeping overhead reduction purposes
 
+        //Threads picked to run in the current tryWakeNext call, released together by releaseBatch()
+        uint32_t* wakeBatch;
+        uint32_t wakeBatchSize;
+
+        //Stats; the wakeup ones are updated by woken threads outside the lock, so they use atomic adds
+        uint64_t phases;
+        uint64_t eopNs; //time from the last thread reaching the barrier to releasing the next phase's first batch
+        uint64_t batches;
+        uint64_t wakeups;
+        uint64_t wakeNs; //aggregate time from a batch being released to its threads resuming
+        uint64_t eopStartNs; //INTERNAL, nonzero between a phase end and the release of the next phase's first batch
+
         uint32_t pad[16];
 
         /* NOTE(dsm): I was initially misled that having a single lock protecting the barrier was a performance hog, and coded a lock-free version.
@@ -106,6 +134,7 @@ class Barrier : public GlobAlloc {
             for (uint32_t t = 0; t < MAX_THREADS; t++) {
                 threadList[t].state = OFFLINE;
                 threadList[t].futexWord = 0;
+                for (uint32_t c = 0; c < WAKE_FANOUT; c++) threadList[t].children[c] = NO_THREAD;
             }
 
             runList = gm_calloc<uint32_t>(MAX_THREADS);
@@ -115,11 +144,28 @@ class Barrier : public GlobAlloc {
             runningThreads = 0;
             leftThreads = 0;
             phaseCount = 0;
+
+            wakeBatch = gm_calloc<uint32_t>(MAX_THREADS);
+            wakeBatchSize = 0;
+
+            phases = eopNs = batches = wakeups = wakeNs = eopStartNs = 0;
             //barrierLock = 0;
         }
 
         ~Barrier() {}
 
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* barStats = new AggregateStat();
+            barStats->init("bar", "Barrier stats");
+            ProxyStat* s;
+            s = new ProxyStat(); s->init("phases", "Phases completed", &phases); barStats->append(s);
+            s = new ProxyStat(); s->init("eopNs", "Phase turnaround time (ns), from the last sync to releasing the next phase", &eopNs); barStats->append(s);
+            s = new ProxyStat(); s->init("batches", "Wakeup batches released", &batches); barStats->append(s);
+            s = new ProxyStat(); s->init("wakeups", "Thread wakeups", &wakeups); barStats->append(s);
+            s = new ProxyStat(); s->init("wakeNs", "Aggregate wakeup latency (ns), from batch release to the thread resuming", &wakeNs); barStats->append(s);
+            parentStat->append(barStats);
+        }
+
         //Called with schedLock held; returns with schedLock unheld
         void join(uint32_t tid, lock_t* schedLock) {
             DEBUG_BARRIER("[%d] Joining, runningThreads %d, prevState %d", tid, runningThreads, threadList[tid].state);
@@ -148,18 +194,12 @@ class Barrier : public GlobAlloc {
 
             threadList[tid].state = WAITING;
             threadList[tid].futexWord = 1;
-            tryWakeNext(tid); //NOTE: You can't cause a phase to end here.
+            uint32_t roots[WAKE_FANOUT];
+            tryWakeNext(tid, roots); //NOTE: You can't cause a phase to end here.
             futex_unlock(schedLock);
 
-            if (threadList[tid].state == WAITING) {
-                DEBUG_BARRIER("[%d] Waiting on join", tid);
-                while (true) {
-                    int futex_res = syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
-                    if (futex_res == 0 || threadList[tid].futexWord != 1) break;
-                }
-                //The thread that wakes us up changes this
-                assert(threadList[tid].state == RUNNING);
-            }
+            wakeAll(roots, tid);
+            waitTurn(tid);
         }
 
         //Must be called with schedLock held
@@ -169,7 +209,10 @@ class Barrier : public GlobAlloc {
                 threadList[tid].state = LEFT;
                 leftThreads++;
                 runningThreads--;
-                tryWakeNext(tid); //can trigger phase end
+                //We still hold the lock, so wake the batch roots here; the rest of the batch fans out from them
+                uint32_t roots[WAKE_FANOUT];
+                tryWakeNext(tid, roots); //can trigger phase end
+                wakeAll(roots, tid);
             } else {
                 assert_msg(threadList[tid].state == WAITING, "leave, tid %d, incorrect state %d", tid, threadList[tid].state);
                 threadList[tid].state = LEFT;
@@ -184,20 +227,50 @@ class Barrier : public GlobAlloc {
             threadList[tid].futexWord = 1;
             threadList[tid].state = WAITING;
             runningThreads--;
-            tryWakeNext(tid); //can trigger phase end
+            uint32_t roots[WAKE_FANOUT];
+            tryWakeNext(tid, roots); //can trigger phase end
             futex_unlock(schedLock);
 
-            if (threadList[tid].state == WAITING) {
-                while (true) {
-                    int futex_res = syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
-                    if (futex_res == 0 || threadList[tid].futexWord != 1) break;
-                }
-                //The thread that wakes us up changes this
-                assert(threadList[tid].state == RUNNING);
-            }
+            wakeAll(roots, tid);
+            waitTurn(tid);
+        }
+
+        //Wakes the children the thread was given in its batch, if it has not done so yet. Called by the thread once
+        //released, and by the scheduler when the thread leaves; these can't race, since a thread leaves only after
+        //waitTurn() returns, or once it is dead.
+        void wakeChildren(uint32_t tid) {
+            ThreadSyncInfo& ts = threadList[tid];
+            wakeAll(ts.children, tid);
+            for (uint32_t c = 0; c < WAKE_FANOUT; c++) ts.children[c] = NO_THREAD;
         }
 
     private:
+        inline void futexWake(uint32_t wtid) {
+            syscall(SYS_futex, &threadList[wtid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+
+        inline void wakeAll(const uint32_t* wtids, uint32_t tid) {
+            for (uint32_t c = 0; c < WAKE_FANOUT; c++) {
+                if (wtids[c] == NO_THREAD) break;
+                if (wtids[c] != tid) futexWake(wtids[c]); //we may be in our own batch; we're awake already
+            }
+        }
+
+        //Called without locks. Blocks until our batch is released, then wakes our children in the batch.
+        void waitTurn(uint32_t tid) {
+            ThreadSyncInfo& ts = threadList[tid];
+            while (ts.futexWord == 1) {
+                syscall(SYS_futex, &ts.futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
+            }
+            //The thread that released our batch changes this, and set our children before clearing futexWord
+            assert(ts.state == RUNNING);
+            __sync_synchronize();
+            wakeChildren(tid);
+
+            __sync_fetch_and_add(&wakeups, 1);
+            __sync_fetch_and_add(&wakeNs, getNs() - ts.wakeNs);
+        }
+
         inline void checkEndPhase(uint32_t tid) {
             if (curThreadIdx == runListSize && runningThreads == 0) {
                 if (leftThreads == runListSize) {
@@ -206,6 +279,8 @@ class Barrier : public GlobAlloc {
                 }
                 DEBUG_BARRIER("[%d] Phase ended", tid);
                 // End of phase actions
+                eopStartNs = getNs();
+                phases++;
                 sched->callback();
                 curThreadIdx = 0; //rewind list
 
@@ -262,9 +337,7 @@ class Barrier : public GlobAlloc {
                     DEBUG_BARRIER("[%d] Waking %d runningThreads %d", tid, wtid, runningThreads);
                     threadList[wtid].state = RUNNING; //must be set before writing to futexWord to avoid wakeup race
                     threadList[wtid].lastIdx = idx;
-                    bool succ = __sync_bool_compare_and_swap(&threadList[wtid].futexWord, 1, 0);
-                    if (!succ) panic("Wakeup race in barrier?");
-                    syscall(SYS_futex, &threadList[wtid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+                    wakeBatch[wakeBatchSize++] = wtid; //futexWord is cleared when the batch is released
                     runningThreads++;
                 } else {
                     DEBUG_BARRIER("[%d] Skipping %d state %d", tid, wtid, threadList[wtid].state);
@@ -272,10 +345,43 @@ class Barrier : public GlobAlloc {
             }
         }
 
-        void tryWakeNext(uint32_t tid) {
+        /* Lays out the batch as a WAKE_FANOUT-ary tree: the caller wakes wakeBatch[0..WAKE_FANOUT-1] (returned in roots),
+         * and wakeBatch[i] wakes wakeBatch[(i+1)*WAKE_FANOUT ...]. Children must be set before clearing futexWord, since
+         * a thread that has not blocked yet will see the cleared futexWord, skip the wait, and read its children.
+         */
+        void releaseBatch(uint32_t* roots) {
+            for (uint32_t c = 0; c < WAKE_FANOUT; c++) roots[c] = (c < wakeBatchSize)? wakeBatch[c] : NO_THREAD;
+            if (!wakeBatchSize) return;
+
+            uint64_t curNs = getNs();
+            for (uint32_t i = 0; i < wakeBatchSize; i++) {
+                ThreadSyncInfo& ts = threadList[wakeBatch[i]];
+                for (uint32_t c = 0; c < WAKE_FANOUT; c++) {
+                    uint32_t ci = (i+1)*WAKE_FANOUT + c;
+                    ts.children[c] = (ci < wakeBatchSize)? wakeBatch[ci] : NO_THREAD;
+                }
+                ts.wakeNs = curNs;
+            }
+
+            for (uint32_t i = 0; i < wakeBatchSize; i++) {
+                bool succ = __sync_bool_compare_and_swap(&threadList[wakeBatch[i]].futexWord, 1, 0);
+                if (!succ) panic("Wakeup race in barrier?");
+            }
+
+            if (eopStartNs) {
+                eopNs += curNs - eopStartNs;
+                eopStartNs = 0;
+            }
+            batches++;
+            wakeBatchSize = 0;
+        }
+
+        //Fills roots with the threads the caller must wake up once it releases schedLock
+        void tryWakeNext(uint32_t tid, uint32_t* roots) {
             checkRunList(tid); //wake up threads on this phase, may reach EOP
             checkEndPhase(tid); //see if we've reached EOP, execute if if so
             checkRunList(tid); //if we started a new phase, wake up threads
+            releaseBatch(roots);
         }
 };
 
@@ -0,0 +1,122 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmark for the barrier's phase turnaround. Runs <threads> host threads that repeatedly sync on a barrier
+ * that allows <parallel> of them to run at once, like simulated threads in zero-work phases, and reports the
+ * wall-clock time per phase and the barrier's own wakeup stats.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <vector>
+#include "barrier.h"
+#include "galloc.h"
+#include "locks.h"
+#include "log.h"
+#include "profile_stats.h"
+
+static uint32_t joinedThreads;
+static uint32_t totalThreads;
+
+//Only counts phases once all threads have joined; before that, phases have fewer threads
+class PhaseCounter : public Callee {
+    public:
+        volatile uint64_t phases;
+        uint64_t startNs;
+        PhaseCounter() : phases(0), startNs(0) {}
+        void callback() {
+            if (joinedThreads < totalThreads) return;
+            if (!startNs) startNs = getNs();
+            phases++;
+        }
+};
+
+static Barrier* bar;
+static PhaseCounter* counter;
+static lock_t benchLock;
+static uint64_t targetPhases;
+static volatile bool done;
+
+static void* runThread(void* arg) {
+    uint32_t tid = (uintptr_t)arg;
+    futex_lock(&benchLock);
+    joinedThreads++;
+    bar->join(tid, &benchLock); //releases lock
+    while (true) {
+        futex_lock(&benchLock);
+        if (counter->phases >= targetPhases) done = true;
+        if (done) {
+            bar->leave(tid);
+            futex_unlock(&benchLock);
+            break;
+        }
+        bar->sync(tid, &benchLock); //releases lock
+    }
+    return nullptr;
+}
+
+void bench(uint32_t threads, uint32_t parallel, uint64_t phases) {
+    bar = new Barrier(parallel, counter);
+    counter->phases = 0;
+    targetPhases = phases;
+    done = false;
+    futex_init(&benchLock);
+    counter->startNs = 0;
+    joinedThreads = 0;
+    totalThreads = threads;
+
+    AggregateStat* rootStat = new AggregateStat();
+    rootStat->init("root", "Stats");
+    bar->initStats(rootStat);
+    const AggregateStat* barStats = dynamic_cast<const AggregateStat*>(rootStat->get(0));
+    auto stat = [&](uint32_t i) { return dynamic_cast<const ScalarStat*>(barStats->get(i))->get(); };
+
+    std::vector<pthread_t> ths(threads);
+    for (uint32_t t = 0; t < threads; t++) pthread_create(&ths[t], nullptr, runThread, (void*)(uintptr_t)t);
+    for (uint32_t t = 0; t < threads; t++) pthread_join(ths[t], nullptr);
+    uint64_t ns = getNs() - counter->startNs;
+
+    uint64_t barPhases = stat(0), eopNs = stat(1), batches = stat(2), wakeups = stat(3), wakeNs = stat(4);
+    info("%4d threads, %3d parallel: %8.1f us/phase, turnaround %6.1f us/phase, %6.1f wakeups/batch, %6.1f us/wakeup",
+            threads, parallel, ((double)ns)/1e3/counter->phases, ((double)eopNs)/1e3/(barPhases? barPhases : 1),
+            ((double)wakeups)/(batches? batches : 1), ((double)wakeNs)/1e3/(wakeups? wakeups : 1));
+}
+
+int main(int argc, char* argv[]) {
+    InitLog(""); //no log header
+    if (argc > 3) {
+        info("Usage: %s [<phases>] [<parallel>]", argv[0]);
+        exit(1);
+    }
+    uint64_t phases = (argc > 1)? strtoul(argv[1], nullptr, 0) : 1000;
+    uint32_t parallel = (argc > 2)? strtoul(argv[2], nullptr, 0) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (phases == 0 || parallel == 0) panic("Need at least one phase and one parallel thread");
+
+    gm_init(256<<20 /*256 MB*/);
+    info("%ld host CPUs", sysconf(_SC_NPROCESSORS_ONLN)); //numbers are only meaningful with several, since wakeups are serialized otherwise
+    counter = new PhaseCounter();
+    for (uint32_t threads : {16, 64, 256}) bench(threads, parallel, phases);
+    return 0;
+}
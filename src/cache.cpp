@@ -26,12 +26,17 @@
 #include "cache.h"
 #include "hash.h"
 
+#include "bithacks.h"
 #include "event_recorder.h"
+#include "pc_miss_table.h"
+#include "pc_profiler.h"
+#include "self_prof.h"
+#include "stack_distance.h"
 #include "timing_event.h"
 #include "zsim.h"
 
 Cache::Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name)
-    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name) {}
+    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name), level(0), sdProf(nullptr), pcProf(nullptr), missPCs(nullptr) {}
 
 const char* Cache::getName() {
     return name.c_str();
@@ -43,6 +48,7 @@ void Cache::setParents(uint32_t childId, const g_vector<MemObject*>& parents, Ne
 
 void Cache::setChildren(const g_vector<BaseCache*>& children, Network* network) {
     cc->setChildren(children, network);
+    if (sdProf) sdProf->setNumChildren(children.size());
 }
 
 void Cache::initStats(AggregateStat* parentStat) {
@@ -56,14 +62,32 @@ void Cache::initCacheStats(AggregateStat* cacheStat) {
     cc->initStats(cacheStat);
     array->initStats(cacheStat);
     rp->initStats(cacheStat);
+    if (sdProf) sdProf->initStats(cacheStat);
+    if (missPCs) missPCs->initStats(cacheStat);
+}
+
+void Cache::profileStackDistance(const MemReq& req) {
+    if (IsGet(req.type)) sdProf->access(req.lineAddr, req.childId);
+}
+
+void Cache::profileMiss(const MemReq& req) {
+    if (req.srcId < zinfo->numCores) {
+        CoreMissLevel& ml = zinfo->coreMissLevels[req.srcId];
+        ml.level = MAX(ml.level, level + 1);
+    }
+    if (unlikely(pcProf != nullptr)) pcProf->miss(req.srcId, level);
+    if (unlikely(missPCs != nullptr)) missPCs->miss(req.pc);
 }
 
 uint64_t Cache::access(MemReq& req) {
+    SelfProfScope sps(SPR_CACHE);
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
     if (likely(!skipAccess)) {
+        if (unlikely(sdProf != nullptr)) profileStackDistance(req);
         bool updateReplacement = (req.type == GETS) || (req.type == GETX);
         int32_t lineId = array->lookup(req.lineAddr, &req, updateReplacement);
+        if (lineId == -1 && IsGet(req.type)) profileMiss(req);
         respCycle += accLat;
 
         if (lineId == -1 && cc->shouldAllocate(req)) {
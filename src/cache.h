@@ -31,10 +31,23 @@
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
+#include "pad.h"
 #include "repl_policies.h"
 #include "stats.h"
 
 class Network;
+class PCMissTable;
+class PCProfiler;
+class StackDistanceProfiler;
+
+/* Deepest cache level that each core's in-flight access has missed in (0 if it hit in the L1), which tells core
+ * models what level served a load: caches on the access path raise it on GET misses, and the core clears it before
+ * each access. Indexed by core id (MemReq::srcId); padded, since each entry is written by a different thread.
+ */
+struct CoreMissLevel {
+    uint32_t level;
+    PAD();
+};
 
 /* General coherent modular cache. The replacement policy and cache array are
  * pretty much mix and match. The coherence controller interfaces are general
@@ -55,6 +68,12 @@ class Cache : public BaseCache {
 
         g_string name;
 
+        uint32_t level; //0 for L1s, 1 for their parents, etc.
+
+        StackDistanceProfiler* sdProf; //optional LRU stack distance tap on GETs, null if disabled
+        PCProfiler* pcProf; //optional per-PC miss attribution, null if disabled
+        PCMissTable* missPCs; //optional top-K table of PCs by GET misses, null if disabled
+
     public:
         Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name);
 
@@ -63,6 +82,11 @@ class Cache : public BaseCache {
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
         void initStats(AggregateStat* parentStat);
 
+        void setStackDistanceProfiler(StackDistanceProfiler* _sdProf) {sdProf = _sdProf;}
+        void setLevel(uint32_t _level) {level = _level;}
+        void setPCProfiler(PCProfiler* _pcProf) {pcProf = _pcProf;}
+        void setPCMissTable(PCMissTable* _missPCs) {missPCs = _missPCs;}
+
         virtual uint64_t access(MemReq& req);
 
         //NOTE: reqWriteback is pulled up to true, but not pulled down to false.
@@ -74,6 +98,12 @@ class Cache : public BaseCache {
     protected:
         void initCacheStats(AggregateStat* cacheStat);
 
+        //Must be called on GET misses, with the cc locks held
+        void profileMiss(const MemReq& req);
+
+        //Must be called with the cc locks held, i.e., between startAccess and endAccess
+        void profileStackDistance(const MemReq& req);
+
         void startInvalidate(); // grabs cc's downLock
         uint64_t finishInvalidate(const InvReq& req); // performs inv and releases downLock
 };
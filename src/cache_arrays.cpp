@@ -30,7 +30,7 @@
 /* Set-associative array implementation */
 
 SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
-    array = gm_calloc<Address>(numLines);
+    array = gm_calloc<Address>(numLines, GM_TAG_CACHES);
     numSets = numLines/assoc;
     setMask = numSets - 1;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
@@ -79,12 +79,12 @@ ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPol
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
     setMask = numSets - 1;
 
-    lookupArray = gm_calloc<uint32_t>(numLines);
-    array = gm_calloc<Address>(numLines);
+    lookupArray = gm_calloc<uint32_t>(numLines, GM_TAG_CACHES);
+    array = gm_calloc<Address>(numLines, GM_TAG_CACHES);
     for (uint32_t i = 0; i < numLines; i++) {
         lookupArray[i] = i;  // start with a linear mapping; with swaps, it'll get progressively scrambled
     }
-    swapArray = gm_calloc<uint32_t>(cands/ways + 2);  // conservative upper bound (tight within 2 ways)
+    swapArray = gm_calloc<uint32_t>(cands/ways + 2, GM_TAG_CACHES);  // conservative upper bound (tight within 2 ways)
 }
 
 void ZArray::initStats(AggregateStat* parentStat) {
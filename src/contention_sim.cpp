@@ -31,8 +31,10 @@
 #include <typeinfo>
 #include <unordered_map>
 #include <vector>
+#include "host_placement.h"
 #include "log.h"
 #include "ooo_core.h"
+#include "self_prof.h"
 #include "timing_core.h"
 #include "timing_event.h"
 #include "zsim.h"
@@ -65,14 +67,16 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     limit = 0;
     lastLimit = 0;
     inCSim = false;
+    profCrossings = nullptr;
 
-    domains = gm_calloc<DomainData>(numDomains);
-    simThreads = gm_calloc<SimThreadData>(numSimThreads);
+    domains = gm_calloc<DomainData>(numDomains, GM_TAG_EVENTS);
+    simThreads = gm_calloc<SimThreadData>(numSimThreads, GM_TAG_EVENTS);
 
     for (uint32_t i = 0; i < numDomains; i++) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
         futex_init(&domains[i].pqLock);
+        futex_prof_name(&domains[i].pqLock, ("pqLock-" + std::to_string(i)).c_str());
     }
 
     if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
@@ -97,7 +101,12 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
         PIN_SpawnInternalThread(SimThreadTrampoline, this, 1024*1024, nullptr);
     }
 
-    lastCrossing = gm_calloc<CrossingEventInfo>(numDomains*numDomains*MAX_THREADS); //TODO: refine... this allocs too much
+    numSources = MAX(zinfo->numCores, (uint32_t)1);
+    lastCrossing = gm_calloc<CrossingEventInfo*>(numSources*numDomains, GM_TAG_EVENTS);
+}
+
+void ContentionSim::enableDomainProfiling() {
+    if (!profCrossings) profCrossings = gm_calloc<uint64_t>(numDomains*numDomains, GM_TAG_EVENTS);
 }
 
 void ContentionSim::postInit() {
@@ -217,6 +226,8 @@ void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
 }
 
 void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
+    if (profCrossings) __sync_fetch_and_add(&profCrossings[srcDomain*numDomains + dstDomain], 1);
+
     CrossingStack& cs = evRec->getCrossingStack();
     bool isFirst = cs.empty();
     bool isResp = false;
@@ -236,7 +247,13 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
     if (isResp) {
         req->parentEv->addChild(ev, evRec);
     } else {
-        CrossingEventInfo* last = &lastCrossing[(srcId*numDomains + srcDomain)*numDomains + dstDomain];
+        assert(srcId < numSources);
+        CrossingEventInfo*& row = lastCrossing[srcId*numDomains + srcDomain];
+        if (unlikely(!row)) {
+            CrossingEventInfo* newRow = gm_calloc<CrossingEventInfo>(numDomains, GM_TAG_EVENTS);
+            if (!__sync_bool_compare_and_swap(&row, nullptr, newRow)) gm_free(newRow);
+        }
+        CrossingEventInfo* last = &row[dstDomain];
         uint64_t srcDomCycle = domains[srcDomain].curCycle;
         if (last->cycle > srcDomCycle && last->cycle <= cycle) { //NOTE: With the OOO model, last->cycle > cycle is now possible, since requests are issued in instruction order -> ooo
             //Chain to previous req
@@ -256,18 +273,7 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
 
 void ContentionSim::simThreadLoop(uint32_t thid) {
     info("Started contention simulation thread %d", thid);
-#if 0
-    //Pin
-    uint32_t nprocs = sysconf(_SC_NPROCESSORS_ONLN);
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    //CPU_SET(domain % nprocs, cpuset); //basically no difference
-    //CPU_SET(0, cpuset); CPU_SET(1, cpuset); CPU_SET(2, cpuset); CPU_SET(3, cpuset); //don't use hyperthreads; confuses the scheduler to no end, does worse
-    CPU_SET(thid % nprocs, &cpuset); CPU_SET((thid % nprocs) + (nprocs/2), &cpuset); //pin to a single core but can use both its hyperthreads, works best (~20% gain)
-    //TODO: Must make this optional, or multiple simulations/machine will work horribly
-    int r = sched_setaffinity(0 /*calling thread, equiv to syscall(SYS_gettid)*/, sizeof(cpuset), &cpuset);
-    assert_msg(r == 0, "sched_setaffinity failed (%d)", r);
-#endif
+    if (zinfo->hostPlacement) zinfo->hostPlacement->pinWeaveThread(thid, simThreads[thid].firstDomain, simThreads[thid].supDomain, numDomains);
     while (true) {
         futex_lock_nospin(&simThreads[thid].wakeLock);
 
@@ -288,7 +294,19 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
     info("Finished contention simulation thread %d", thid);
 }
 
+inline void ContentionSim::runEvent(DomainData& domain, TimingEvent* te, uint64_t cycle) {
+    if (likely(!profCrossings)) {
+        te->run(cycle);
+    } else {
+        uint64_t startNs = getNs();
+        te->run(cycle);
+        domain.profNs += getNs() - startNs;
+        domain.profEvents++;
+    }
+}
+
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
+    SelfProfScope sps(SPR_WEAVE);
     uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
     uint32_t numFinished = 0;
 
@@ -305,7 +323,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                 domCycle = cycle;
                 domain.curCycle = cycle;
             }
-            te->run(cycle);
+            runEvent(domain, te, cycle);
             uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
             assert(newCycle >= domCycle);
             if (newCycle != domCycle) domain.curCycle = newCycle;
@@ -373,7 +391,7 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                     TimingEvent* te = pq.dequeue(cycle);
                     //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
                     if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->run(cycle);
+                    runEvent(*domain, te, cycle);
                     domain->curCycle = pq.size()? pq.firstCycle() : limit;
                     domain->queuePrio = domain->curCycle;
                     if (domain->prio == 0) domPq.push(domain);
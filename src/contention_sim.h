@@ -60,7 +60,12 @@ class ContentionSim : public GlobAlloc {
             CrossingEvent* ev; //only valid if the source's curCycle < cycle (otherwise this may be already executed or recycled)
         };
 
-        CrossingEventInfo* lastCrossing; //indexed by [srcId*doms*doms + srcDom*doms + dstDom]
+        //Indexed by [srcId*doms + srcDom][dstDom]. A source only crosses out of a few domains, so rows are allocated
+        //on first use; with one domain per component (domain profiling), a full table would take GBs
+        CrossingEventInfo** lastCrossing;
+        uint32_t numSources; //srcIds are core ids
+
+        uint64_t* profCrossings; //indexed by [srcDom*doms + dstDom], nullptr unless profiling domains
 
         struct DomainData : public GlobAlloc {
             PrioQueue<TimingEvent, PQ_BLOCKS> pq;
@@ -78,6 +83,10 @@ class ContentionSim : public GlobAlloc {
 
             ClockStat profTime;
 
+            //Only gathered when profiling domains (see domain_profiler.h)
+            uint64_t profEvents;
+            uint64_t profNs;
+
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
             VectorCounter profIncomingCrossings;
@@ -132,6 +141,17 @@ class ContentionSim : public GlobAlloc {
 
         void postInit(); //must be called after the simulator is initialized
 
+        //Count crossings between every pair of domains, and events run and host time spent in each domain
+        void enableDomainProfiling();
+        bool isProfilingDomains() const {return profCrossings;}
+
+        uint64_t getProfCrossings(uint32_t srcDomain, uint32_t dstDomain) const {
+            assert(profCrossings && srcDomain < numDomains && dstDomain < numDomains);
+            return profCrossings[srcDomain*numDomains + dstDomain];
+        }
+        uint64_t getProfEvents(uint32_t domain) const {return domains[domain].profEvents;}
+        uint64_t getProfNs(uint32_t domain) const {return domains[domain].profNs;}
+
         void enqueue(TimingEvent* ev, uint64_t cycle);
         void enqueueSynced(TimingEvent* ev, uint64_t cycle);
         void enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec);
@@ -162,6 +182,7 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        inline void runEvent(DomainData& domain, TimingEvent* te, uint64_t cycle);
 
         static void SimThreadTrampoline(void* arg);
 };
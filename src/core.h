@@ -41,13 +41,14 @@ struct BblInfo {
  * As an artifact of having a shared code cache, we need these to be the same for different core types.
  */
 struct InstrFuncPtrs {  // NOLINT(whitespace)
-    void (*loadPtr)(THREADID, ADDRINT);
-    void (*storePtr)(THREADID, ADDRINT);
+    // Loads and stores get the effective address and the PC of the instruction
+    void (*loadPtr)(THREADID, ADDRINT, ADDRINT);
+    void (*storePtr)(THREADID, ADDRINT, ADDRINT);
     void (*bblPtr)(THREADID, ADDRINT, BblInfo*);
     void (*branchPtr)(THREADID, ADDRINT, BOOL, ADDRINT, ADDRINT);
     // Same as load/store functions, but last arg indicated whether op is executing
-    void (*predLoadPtr)(THREADID, ADDRINT, BOOL);
-    void (*predStorePtr)(THREADID, ADDRINT, BOOL);
+    void (*predLoadPtr)(THREADID, ADDRINT, ADDRINT, BOOL);
+    void (*predStorePtr)(THREADID, ADDRINT, ADDRINT, BOOL);
     uint64_t type;
     uint64_t pad[1];
     //NOTE: By having the struct be a power of 2 bytes, indirect calls are simpler (w/ gcc 4.4 -O3, 6->5 instructions, and those instructions are simpler)
@@ -60,6 +61,26 @@ struct InstrFuncPtrs {  // NOLINT(whitespace)
 #define FPTR_NOP (2L)
 #define FPTR_RETRY (3L)
 
+/* Top-down CPI stack: every issue slot of a core's unhalted cycles goes to one component. Slots where a uop issues
+ * are retiring; the others are charged to whatever made the core advance its issue cycle. Backend memory stalls are
+ * split by the cache level that served the outstanding load (L2..L4, or main memory).
+ */
+enum CPIStackComponent {
+    CPI_RETIRING,
+    CPI_FE_FETCH,       // waiting on instruction fetch
+    CPI_FE_MISPRED,     // refetching after a branch misprediction
+    CPI_FE_DECODE,      // decoder or uop queue throughput
+    CPI_BE_CORE,        // issue window, ROB, LSQ or RF ports full, not waiting on a cache miss
+    CPI_BE_L2,
+    CPI_BE_L3,
+    CPI_BE_L4,
+    CPI_BE_MEM,
+    CPI_CONTENTION,     // cycles added by the weave phase
+    CPI_COMPONENTS
+};
+
+extern const char* cpiStackComponentNames[CPI_COMPONENTS];
+
 //Generic core class
 
 class Core : public GlobAlloc {
@@ -78,6 +99,7 @@ class Core : public GlobAlloc {
         virtual uint64_t getCycles() const = 0;
 
         virtual void initStats(AggregateStat* parentStat) = 0;
+        virtual bool getCPIStack(uint64_t* slots) const {return false;} //fills CPI_COMPONENTS issue slot counts, if the core model keeps them
         virtual void contextSwitch(int32_t gid) = 0; //gid == -1 means descheduled, otherwise this is the new gid
 
         //Called by scheduler on every leave and join action, before barrier methods are called
@@ -159,6 +159,7 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
       deferredWrites(_deferredWrites), closedPage(_closedPage), domain(_domain), name(_name)
 {
     sysFreqKHz = 1000 * _sysFreqMHz;
+    detailedStats = false;
     initTech(tech);  // sets all tXX and memFreqKHz
     if (memFreqKHz >= sysFreqKHz/2) {
         panic("You may need to tweak the scheduling code, which works with system cycles." \
@@ -235,6 +236,10 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
     latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); memStats->append(&latencyHist);
+    if (detailedStats) {
+        profRdLatHist.init("rdlatHist", "Latency distribution of read requests", 1 << 16); memStats->append(&profRdLatHist);
+        profWrLatHist.init("wrlatHist", "Latency distribution of write requests", 1 << 16); memStats->append(&profWrLatHist);
+    }
     parentStat->append(memStats);
 }
 
@@ -612,6 +617,7 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         uint32_t scDelay = doneSysCycle - r->startSysCycle;
         profReads.inc();
         profTotalRdLat.inc(scDelay);
+        if (detailedStats) profRdLatHist.inc(scDelay);
         if (rowHit) profReadHits.inc();
         uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
         latencyHist.inc(bucket, 1);
@@ -619,6 +625,7 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
         profWrites.inc();
         profTotalWrLat.inc(scDelay);
+        if (detailedStats) profWrLatHist.inc(scDelay);
         if (rowHit) profWriteHits.inc();
     }
 
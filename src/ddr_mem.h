@@ -238,6 +238,8 @@ class DDRMemory : public MemObject {
         Counter profTotalRdLat, profTotalWrLat;
         Counter profReadHits, profWriteHits;  // row buffer hits
         VectorCounter latencyHist;
+        Histogram profRdLatHist, profWrLatHist;  // only if detailedStats
+        bool detailedStats;
         static const uint32_t BINSIZE = 10, NUMBINS = 100;
         PAD();
 
@@ -265,6 +267,7 @@ class DDRMemory : public MemObject {
 
         void initStats(AggregateStat* parentStat);
         const char* getName() {return name.c_str();}
+        void setDetailedStats(bool enable) {detailedStats = enable;}  // before initStats()
 
         // Bound phase interface
         uint64_t access(MemReq& req);
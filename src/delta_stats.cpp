@@ -0,0 +1,372 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "delta_stats.h"
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include "access_tracing.h"
+#include "bithacks.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "stats_gather.h"
+#include "stats_writer.h"
+
+// Concatenate HDF5 header path prefix with the header file names, because
+// Ubuntu 15.04 and later change the HDF5 header path.
+#define _STR(x) #x
+#define STR(x) _STR(x)
+#ifdef HDF5INCPREFIX
+#include STR(HDF5INCPREFIX/hdf5.h)
+#include STR(HDF5INCPREFIX/hdf5_hl.h)
+#else
+#include <hdf5.h>
+#include <hdf5_hl.h>
+#endif
+#undef STR
+#undef _STR
+
+#define DELTA_STATS_DATA_CHUNK (64*1024)
+#define DELTA_STATS_GROUPS 4 //groups in flight to the writer thread; dumps only block if it falls this far behind
+
+static hid_t getIndexType(uint32_t numBlocks) {
+    hsize_t dims[] = {DELTA_STATS_INDEX_HEADER + numBlocks + 1};
+    return H5Tarray_create2(H5T_NATIVE_ULONG, 1 /*rank*/, dims);
+}
+
+static void writeAttr(hid_t fid, const char* name, uint32_t val) {
+    hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attr = H5Acreate2(fid, name, H5T_NATIVE_UINT, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr, H5T_NATIVE_UINT, &val);
+    H5Aclose(attr);
+    H5Sclose(space);
+}
+
+static uint32_t readAttr(hid_t fid, const char* name) {
+    uint32_t val;
+    hid_t attr = H5Aopen(fid, name, H5P_DEFAULT);
+    if (attr < 0) panic("Delta stats file has no %s attribute", name);
+    H5Aread(attr, H5T_NATIVE_UINT, &val);
+    H5Aclose(attr);
+    return val;
+}
+
+/* Like the HDF5 backend, hands finished groups to the stats writer thread if there is one (through a ring of group
+ * slots that works the same way as HDF5BackendImpl's buffer ring), and writes them synchronously otherwise. Either
+ * way, the file is only open while groups are appended, so it is always complete between appends.
+ */
+class DeltaBackendImpl : public GlobAlloc, public StatsWriterClient {
+    private:
+        const char* filename;
+        StatGatherPlan* plan;
+        uint32_t numColumns;
+        uint32_t numBlocks;
+        uint32_t keyframeInterval;
+
+        uint64_t* cur;
+        uint64_t* prev;
+        g_vector<uint8_t>* segments; //per block, for the current group
+
+        uint64_t groupFirstRow;
+        uint32_t groupRows;
+        uint64_t dataBytes; //encoded so far
+
+        //Groups encoded but not yet written: the producer fills slot tail % DELTA_STATS_GROUPS, the writer drains head
+        struct GroupSlot {
+            g_vector<uint64_t> entry;
+            g_vector<uint8_t> data;
+        };
+        StatsWriter* writer;
+        GroupSlot* slots;
+        uint32_t numSlots;
+        volatile uint64_t head;
+        volatile uint64_t tail;
+        volatile uint64_t syncReq;
+        volatile uint64_t syncAck;
+        bool stalled;
+
+    public:
+        DeltaBackendImpl(const char* _filename, AggregateStat* rootStat, uint32_t _keyframeInterval, bool skipVectors, bool sumRegularAggregates, StatsWriter* _writer) :
+            filename(_filename), keyframeInterval(_keyframeInterval), writer(_writer)
+        {
+            assert(keyframeInterval > 0);
+            plan = new StatGatherPlan(rootStat, skipVectors, sumRegularAggregates);
+            numColumns = plan->size();
+            numBlocks = MAX(1u, (numColumns + DELTA_STATS_BLOCK_WORDS - 1)/DELTA_STATS_BLOCK_WORDS);
+            cur = gm_calloc<uint64_t>(numColumns + 1, GM_TAG_STATS);
+            prev = gm_calloc<uint64_t>(numColumns + 1, GM_TAG_STATS);
+            segments = gm_calloc<g_vector<uint8_t>>(numBlocks, GM_TAG_STATS);
+            for (uint32_t b = 0; b < numBlocks; b++) new (&segments[b]) g_vector<uint8_t>();
+            groupFirstRow = 0;
+            groupRows = 0;
+            dataBytes = 0;
+            numSlots = writer? DELTA_STATS_GROUPS : 1;
+            slots = gm_calloc<GroupSlot>(numSlots, GM_TAG_STATS);
+            for (uint32_t i = 0; i < numSlots; i++) new (&slots[i]) GroupSlot();
+            head = tail = 0;
+            syncReq = syncAck = 0;
+            stalled = false;
+
+            std::vector<std::string> names;
+            GetGatherPlanNames(rootStat, skipVectors, sumRegularAggregates, names);
+            assert(names.size() == numColumns);
+
+            scoped_mutex sm(hdf5Lock);
+            info("Delta stats backend: Opening %s", filename);
+            hid_t fid = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            if (fid < 0) panic("Could not create HDF5 file %s", filename);
+
+            // Same approach as the trace writer: create raw chunked datasets, append to them with the packet table API
+            auto createDataset = [&](const char* name, hid_t type, hsize_t chunk, int compression) {
+                hsize_t dims[1] = {0};
+                hsize_t dimsChunk[1] = {chunk};
+                hsize_t maxDims[1] = {H5S_UNLIMITED};
+                hid_t space = H5Screate_simple(1, dims, maxDims);
+                hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+                H5Pset_chunk(plist, 1, dimsChunk);
+                if (compression) H5Pset_deflate(plist, compression);
+                hid_t ds = H5Dcreate2(fid, name, type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+                if (ds < 0) panic("Could not create HDF5 dataset %s in %s", name, filename);
+                H5Dclose(ds);
+                H5Pclose(plist);
+                H5Sclose(space);
+            };
+            createDataset("data", H5T_NATIVE_UINT8, DELTA_STATS_DATA_CHUNK, 6 /*deflate still squeezes varints a bit*/);
+            hid_t indexType = getIndexType(numBlocks);
+            createDataset("index", indexType, 64, 0);
+            H5Tclose(indexType);
+
+            // Column names, as fixed-length strings
+            size_t maxLen = 1;
+            for (const std::string& n : names) maxLen = MAX(maxLen, n.size() + 1);
+            std::vector<char> nameBuf(maxLen*numColumns, 0);
+            for (uint32_t i = 0; i < numColumns; i++) names[i].copy(&nameBuf[i*maxLen], maxLen - 1);
+            hid_t strType = H5Tcopy(H5T_C_S1);
+            H5Tset_size(strType, maxLen);
+            hsize_t nameDims[1] = {numColumns};
+            hid_t nameSpace = H5Screate_simple(1, nameDims, nullptr);
+            hid_t nameDs = H5Dcreate2(fid, "columns", strType, nameSpace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            if (numColumns) H5Dwrite(nameDs, strType, H5S_ALL, H5S_ALL, H5P_DEFAULT, &nameBuf[0]);
+            H5Dclose(nameDs);
+            H5Sclose(nameSpace);
+            H5Tclose(strType);
+
+            writeAttr(fid, "columns", numColumns);
+            writeAttr(fid, "blockWords", DELTA_STATS_BLOCK_WORDS);
+            writeAttr(fid, "keyframeInterval", keyframeInterval);
+            H5Fclose(fid);
+            info("Delta stats backend: %d columns, %d blocks, keyframe every %d rows%s", numColumns, numBlocks, keyframeInterval, writer? ", writer thread" : "");
+        }
+
+        void dump(bool buffered) {
+            plan->gather(cur);
+            for (uint32_t b = 0; b < numBlocks; b++) {
+                uint32_t first = b*DELTA_STATS_BLOCK_WORDS;
+                uint32_t n = MIN(DELTA_STATS_BLOCK_WORDS, numColumns - first);
+                deltaEncodeRow(segments[b], cur + first, groupRows? prev + first : nullptr, n);
+            }
+            std::swap(cur, prev);
+            groupRows++;
+
+            if (groupRows == keyframeInterval || !buffered) publishGroup(!buffered);
+        }
+
+        //Called by the writer thread: appends all published groups
+        void write(uint64_t curNs, uint64_t flushIntervalNs) {
+            uint64_t sync = syncReq;
+            __sync_synchronize();
+            uint64_t t = tail; //>= sync
+            if (head < t) appendGroups(t);
+            if (sync != syncAck) {
+                __sync_synchronize();
+                syncAck = sync;
+            }
+        }
+
+    private:
+        //Moves the current group to a slot and hands it to the writer, or writes it if there is no writer
+        void publishGroup(bool sync) {
+            if (tail - head == numSlots) { //only with the writer; without it, groups are written right away
+                if (!stalled) warn("Delta stats (%s): Stats writer thread is falling behind, dumps will wait for it", filename);
+                stalled = true;
+                while (tail - head == DELTA_STATS_GROUPS) usleep(100);
+            }
+
+            GroupSlot& slot = slots[tail % numSlots];
+            slot.entry.assign(DELTA_STATS_INDEX_HEADER + numBlocks + 1, 0);
+            slot.entry[0] = groupFirstRow;
+            slot.entry[1] = groupRows;
+            slot.data.clear();
+            for (uint32_t b = 0; b < numBlocks; b++) {
+                slot.entry[DELTA_STATS_INDEX_HEADER + b] = dataBytes + slot.data.size();
+                slot.data.insert(slot.data.end(), segments[b].begin(), segments[b].end());
+                segments[b].clear();
+            }
+            slot.entry[DELTA_STATS_INDEX_HEADER + numBlocks] = dataBytes + slot.data.size();
+
+            dataBytes += slot.data.size();
+            groupFirstRow += groupRows;
+            groupRows = 0;
+
+            __sync_synchronize(); //slot contents must be visible before tail
+            tail = tail + 1;
+            if (writer) {
+                if (sync) syncReq = tail;
+                writer->wake();
+                if (sync) {
+                    while (syncAck != tail) usleep(1000);
+                }
+            } else {
+                appendGroups(tail);
+            }
+        }
+
+        //Appends groups [head, t) to the file
+        void appendGroups(uint64_t t) {
+            scoped_mutex sm(hdf5Lock);
+            hid_t fid = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+            if (fid < 0) panic("Could not open HDF5 file %s", filename);
+            hid_t dataTable = H5PTopen(fid, "data");
+            hid_t indexTable = H5PTopen(fid, "index");
+            if (dataTable < 0 || indexTable < 0) panic("Could not open delta stats tables in %s", filename);
+            while (head < t) {
+                GroupSlot& slot = slots[head % numSlots];
+                if (slot.data.size()) H5PTappend(dataTable, slot.data.size(), &slot.data[0]);
+                H5PTappend(indexTable, 1, &slot.entry[0]);
+                __sync_synchronize(); //done with the slot before freeing it
+                head = head + 1;
+            }
+            H5PTclose(dataTable);
+            H5PTclose(indexTable);
+            H5Fclose(fid);
+        }
+};
+
+DeltaBackend::DeltaBackend(const char* filename, AggregateStat* rootStat, uint32_t keyframeInterval, bool skipVectors, bool sumRegularAggregates) {
+    StatsWriter* writer = StatsWriter::instance();
+    backend = new DeltaBackendImpl(filename, rootStat, keyframeInterval, skipVectors, sumRegularAggregates, writer);
+    if (writer) writer->registerClient(backend);
+}
+
+void DeltaBackend::dump(bool buffered) {
+    backend->dump(buffered);
+}
+
+
+DeltaStatsReader::DeltaStatsReader(const std::string& _fname) : fname(_fname) {
+    scoped_mutex sm(hdf5Lock);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid < 0) panic("Could not open HDF5 file %s", fname.c_str());
+    numColumns = readAttr(fid, "columns");
+    blockWords = readAttr(fid, "blockWords");
+    numBlocks = MAX(1u, (numColumns + blockWords - 1)/blockWords);
+    indexWords = DELTA_STATS_INDEX_HEADER + numBlocks + 1;
+
+    hid_t indexTable = H5PTopen(fid, "index");
+    if (indexTable < 0) panic("Could not open index table in %s", fname.c_str());
+    hsize_t numGroups;
+    H5PTget_num_packets(indexTable, &numGroups);
+    index.resize(numGroups*indexWords);
+    if (numGroups) H5PTread_packets(indexTable, 0, numGroups, &index[0]);
+    H5PTclose(indexTable);
+    H5Fclose(fid);
+
+    numRows = numGroups? index[(numGroups-1)*indexWords] + index[(numGroups-1)*indexWords + 1] : 0;
+    dataBytes = numGroups? index[numGroups*indexWords - 1] : 0;
+}
+
+std::vector<std::string> DeltaStatsReader::getColumnNames() const {
+    scoped_mutex sm(hdf5Lock);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid < 0) panic("Could not open HDF5 file %s", fname.c_str());
+    hid_t ds = H5Dopen2(fid, "columns", H5P_DEFAULT);
+    hid_t type = H5Dget_type(ds);
+    size_t maxLen = H5Tget_size(type);
+    std::vector<char> buf(maxLen*numColumns + 1, 0);
+    if (numColumns) H5Dread(ds, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buf[0]);
+    H5Tclose(type);
+    H5Dclose(ds);
+    H5Fclose(fid);
+
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < numColumns; i++) {
+        const char* s = &buf[i*maxLen];
+        names.push_back(std::string(s, strnlen(s, maxLen)));
+    }
+    return names;
+}
+
+void DeltaStatsReader::read(uint32_t firstCol, uint32_t lastCol, uint64_t firstRow, uint64_t lastRow, std::vector<uint64_t>& out) const {
+    assert(firstCol <= lastCol && lastCol <= numColumns);
+    assert(firstRow <= lastRow && lastRow <= numRows);
+    uint32_t cols = lastCol - firstCol;
+    out.resize((lastRow - firstRow)*cols);
+    if (out.empty()) return;
+
+    scoped_mutex sm(hdf5Lock);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid < 0) panic("Could not open HDF5 file %s", fname.c_str());
+    hid_t dataTable = H5PTopen(fid, "data");
+    if (dataTable < 0) panic("Could not open data table in %s", fname.c_str());
+
+    std::vector<uint8_t> seg;
+    std::vector<uint64_t> vals(blockWords);
+    uint32_t firstBlock = firstCol/blockWords;
+    uint32_t lastBlock = (lastCol - 1)/blockWords; //inclusive
+    for (uint64_t g = 0; g < getNumGroups(); g++) {
+        const uint64_t* entry = &index[g*indexWords];
+        uint64_t gFirst = entry[0];
+        uint64_t gRows = entry[1];
+        if (gFirst + gRows <= firstRow || gFirst >= lastRow) continue;
+        const uint64_t* offsets = entry + DELTA_STATS_INDEX_HEADER;
+
+        for (uint32_t b = firstBlock; b <= lastBlock; b++) {
+            uint64_t segBytes = offsets[b+1] - offsets[b];
+            seg.resize(segBytes + 1);
+            if (segBytes) H5PTread_packets(dataTable, offsets[b], segBytes, &seg[0]);
+
+            uint32_t bFirst = b*blockWords;
+            uint32_t n = MIN(blockWords, numColumns - bFirst);
+            uint32_t c0 = MAX(firstCol, bFirst);
+            uint32_t c1 = MIN(lastCol, bFirst + n);
+            const uint8_t* p = &seg[0];
+            //Rows must be decoded from the keyframe, but we can stop at the last row we need
+            uint64_t rowsToDecode = MIN(gRows, lastRow - gFirst);
+            for (uint64_t r = 0; r < rowsToDecode; r++) {
+                deltaDecodeRow(p, &vals[0], r == 0, n);
+                uint64_t row = gFirst + r;
+                if (row < firstRow) continue;
+                uint64_t* dst = &out[(row - firstRow)*cols];
+                for (uint32_t c = c0; c < c1; c++) dst[c - firstCol] = vals[c - bFirst];
+            }
+            assert(rowsToDecode < gRows || p == &seg[segBytes]);
+        }
+    }
+
+    H5PTclose(dataTable);
+    H5Fclose(fid);
+}
@@ -0,0 +1,151 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTA_STATS_H_
+#define DELTA_STATS_H_
+
+/* Delta-compressed periodic stats format.
+ *
+ * Periodic stats rows are mostly counters that barely change between dumps, so storing each row as absolute uint64_t
+ * values wastes most of the space. The delta format splits each row (in gather plan order, see stats_gather.h) into
+ * blocks of DELTA_STATS_BLOCK_WORDS columns, and groups rows into groups of keyframeInterval rows. Each (group, block)
+ * segment is encoded independently: its first row (the keyframe) holds absolute values, and the other rows hold
+ * deltas from the previous row. So reading a column range of a row range only decodes the segments that overlap it.
+ *
+ * Each value is zigzag-encoded (so decreasing values also stay small) and written as a LEB128 varint, except that
+ * runs of zeros are written as a 0x00 byte followed by the run length as a varint. No nonzero varint starts with
+ * 0x00, so this is unambiguous.
+ *
+ * The HDF5 file has:
+ *  - "data": packet table of bytes, the concatenation of all segments.
+ *  - "index": packet table with one entry per group: first row, number of rows, and numBlocks+1 offsets into data
+ *    (segment b of the group spans [offsets[b], offsets[b+1])).
+ *  - "columns": names of all columns.
+ *  - Attributes: columns, blockWords, keyframeInterval.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "log.h"
+
+#define DELTA_STATS_BLOCK_WORDS 1024u
+#define DELTA_STATS_INDEX_HEADER 2 //first row, rows
+
+// Output buffers are templated so that the backend can use g_vectors
+template <typename V>
+static inline void deltaPutVarint(V& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static inline uint64_t deltaGetVarint(const uint8_t*& p) {
+    uint64_t v = 0;
+    uint32_t shift = 0;
+    while (*p & 0x80) {
+        v |= ((uint64_t)(*p++ & 0x7f)) << shift;
+        shift += 7;
+    }
+    v |= ((uint64_t)*p++) << shift;
+    return v;
+}
+
+// Encodes vals[0..n) as deltas from base[0..n), or as absolute values if base is nullptr (keyframes)
+template <typename V>
+static inline void deltaEncodeRow(V& out, const uint64_t* vals, const uint64_t* base, uint32_t n) {
+    uint32_t zeros = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        int64_t d = (int64_t)(vals[i] - (base? base[i] : 0));
+        uint64_t zz = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+        if (zz == 0) {
+            zeros++;
+            continue;
+        }
+        if (zeros) {
+            out.push_back(0);
+            deltaPutVarint(out, zeros);
+            zeros = 0;
+        }
+        deltaPutVarint(out, zz);
+    }
+    if (zeros) {
+        out.push_back(0);
+        deltaPutVarint(out, zeros);
+    }
+}
+
+// Decodes a row encoded by deltaEncodeRow; vals must hold the previous row (or anything, for keyframes)
+static inline void deltaDecodeRow(const uint8_t*& p, uint64_t* vals, bool keyframe, uint32_t n) {
+    uint32_t i = 0;
+    while (i < n) {
+        if (*p == 0) {
+            p++;
+            uint64_t zeros = deltaGetVarint(p);
+            assert(i + zeros <= n);
+            if (keyframe) {
+                for (uint64_t j = 0; j < zeros; j++) vals[i + j] = 0;
+            }
+            i += zeros;
+        } else {
+            uint64_t zz = deltaGetVarint(p);
+            uint64_t d = (zz >> 1) ^ -(zz & 1);
+            vals[i] = (keyframe? 0 : vals[i]) + d;
+            i++;
+        }
+    }
+}
+
+/* Reads delta-compressed stats files. Only needs to keep the index in memory. */
+class DeltaStatsReader {
+    private:
+        std::string fname;
+        uint32_t numColumns;
+        uint32_t blockWords;
+        uint32_t numBlocks;
+        uint32_t indexWords;
+        uint64_t numRows;
+        uint64_t dataBytes;
+        std::vector<uint64_t> index; //numGroups*indexWords
+
+    public:
+        explicit DeltaStatsReader(const std::string& fname);
+
+        uint32_t getNumColumns() const {return numColumns;}
+        uint64_t getNumRows() const {return numRows;}
+        uint64_t getNumGroups() const {return index.size()/indexWords;}
+        uint64_t getDataBytes() const {return dataBytes;}
+
+        std::vector<std::string> getColumnNames() const;
+
+        /* Reconstructs columns [firstCol, lastCol) of rows [firstRow, lastRow), row-major, into out (which is
+         * resized to (lastRow-firstRow)*(lastCol-firstCol) values). Only decodes the segments that overlap.
+         */
+        void read(uint32_t firstCol, uint32_t lastCol, uint64_t firstRow, uint64_t lastRow, std::vector<uint64_t>& out) const;
+};
+
+#endif  // DELTA_STATS_H_
@@ -0,0 +1,103 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Reads delta-compressed periodic stats (see delta_stats.h). Only decodes the parts of the file that are needed, so
+ * pulling a few columns out of a huge file is cheap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "delta_stats.h"
+#include "galloc.h"
+#include "log.h"
+
+// Parses "first[:last]" (last exclusive; defaults to first+1, or to max if ":" is given with nothing after it)
+static void parseRange(const char* str, uint64_t max, uint64_t& first, uint64_t& last) {
+    char* end;
+    first = strtoul(str, &end, 0);
+    if (*end == 0) {
+        last = first + 1;
+    } else if (*end == ':') {
+        last = (end[1] == 0)? max : strtoul(end + 1, nullptr, 0);
+    } else {
+        panic("Invalid range %s, use first[:last]", str);
+    }
+    if (first >= last || last > max) panic("Invalid range %s (%ld:%ld), max is %ld", str, first, last, max);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc < 2 || argc > 4) {
+        info("Prints delta-compressed periodic stats");
+        info("Usage: %s <stats file> [-l | <columns> [<rows>]]", argv[0]);
+        info("  No args: print a summary");
+        info("  -l: list column indexes and names");
+        info("  columns/rows: first[:last] ranges (last exclusive, empty means to the end)");
+        exit(1);
+    }
+
+    gm_init(32<<20 /*32 MB, not really used*/);
+    DeltaStatsReader dr(argv[1]);
+
+    if (argc == 2) {
+        uint64_t rawBytes = dr.getNumRows()*dr.getNumColumns()*sizeof(uint64_t);
+        info("%s: %ld rows x %d columns, %ld groups", argv[1], dr.getNumRows(), dr.getNumColumns(), dr.getNumGroups());
+        info("Encoded data: %ld bytes (%ld bytes raw, %.1fx)", dr.getDataBytes(), rawBytes,
+                dr.getDataBytes()? ((double)rawBytes)/dr.getDataBytes() : 0.0);
+        return 0;
+    }
+
+    std::vector<std::string> names = dr.getColumnNames();
+    if (strcmp(argv[2], "-l") == 0) {
+        for (uint32_t i = 0; i < names.size(); i++) printf("%8d %s\n", i, names[i].c_str());
+        return 0;
+    }
+
+    uint64_t firstCol, lastCol, firstRow, lastRow;
+    parseRange(argv[2], dr.getNumColumns(), firstCol, lastCol);
+    if (argc == 4) {
+        parseRange(argv[3], dr.getNumRows(), firstRow, lastRow);
+    } else {
+        firstRow = 0;
+        lastRow = dr.getNumRows();
+    }
+
+    std::vector<uint64_t> vals;
+    dr.read(firstCol, lastCol, firstRow, lastRow, vals);
+
+    uint32_t cols = lastCol - firstCol;
+    printf("row");
+    for (uint32_t c = firstCol; c < lastCol; c++) printf("\t%s", names[c].c_str());
+    printf("\n");
+    for (uint64_t r = firstRow; r < lastRow; r++) {
+        printf("%ld", r);
+        for (uint32_t c = 0; c < cols; c++) printf("\t%ld", vals[(r - firstRow)*cols + c]);
+        printf("\n");
+    }
+    return 0;
+}
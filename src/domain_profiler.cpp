@@ -0,0 +1,219 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "domain_profiler.h"
+#include <algorithm>
+#include <sstream>
+#include <stdio.h>
+#include <vector>
+#include "contention_sim.h"
+#include "log.h"
+#include "zsim.h"
+
+uint32_t DomainProfiler::addComponent(const std::string& group, uint32_t idx, uint32_t count, bool split) {
+    ComponentGroup* grp = nullptr;
+    for (ComponentGroup& g : groups) if (g.name == group.c_str()) grp = &g;
+    if (!grp) {
+        groups.push_back(ComponentGroup());
+        grp = &groups.back();
+        grp->name = group.c_str();
+        grp->components.resize(count, (uint32_t)-1);
+        grp->evenDomains.resize(count, 0);
+    }
+    assert(grp->components.size() == count && idx < count);
+    assert_msg(grp->components[idx] == (uint32_t)-1, "%s-%d registered twice", group.c_str(), idx);
+    grp->components[idx] = numComponents;
+    grp->evenDomains[idx] = split? idx*targetDomains/count : 0;
+    return numComponents++;
+}
+
+/* Partitions a graph with node weights w and symmetric edge weights adj into k parts, balancing node weights and
+ * minimizing the weight of cut edges. Parts are first grown one at a time from the heaviest free node, adding the
+ * free node most connected to the part until the part reaches its share of the remaining weight; then nodes move to
+ * the part they are most connected to while that reduces the cut and keeps every part within maxImbalance of the
+ * average weight (a greedy variant of Kernighan-Lin/Fiduccia-Mattheyses refinement).
+ */
+static std::vector<uint32_t> PartitionGraph(const std::vector<double>& w, const std::vector<std::vector<double>>& adj,
+        uint32_t k, double maxImbalance) {
+    uint32_t n = w.size();
+    std::vector<uint32_t> part(n, k);  // k == unassigned
+    std::vector<double> partW(k, 0.0);
+    double total = 0.0;
+    double maxNodeW = 0.0;
+    for (double x : w) {
+        total += x;
+        maxNodeW = std::max(maxNodeW, x);
+    }
+
+    // Growing
+    double remaining = total;
+    uint32_t unassigned = n;
+    std::vector<double> conn(n);
+    for (uint32_t p = 0; p < k && unassigned; p++) {
+        if (p == k - 1) {  // last part takes the rest
+            for (uint32_t i = 0; i < n; i++) if (part[i] == k) {
+                part[i] = p;
+                partW[p] += w[i];
+            }
+            break;
+        }
+
+        double target = remaining/(k - p);
+        std::fill(conn.begin(), conn.end(), 0.0);
+        uint32_t v = n;
+        for (uint32_t i = 0; i < n; i++) if (part[i] == k && (v == n || w[i] > w[v])) v = i;
+        while (true) {
+            part[v] = p;
+            partW[p] += w[v];
+            remaining -= w[v];
+            unassigned--;
+            for (uint32_t i = 0; i < n; i++) conn[i] += adj[v][i];
+            if (!unassigned || partW[p] >= target) break;
+
+            uint32_t next = n;
+            for (uint32_t i = 0; i < n; i++) {
+                if (part[i] != k) continue;
+                if (next == n || conn[i] > conn[next] || (conn[i] == conn[next] && w[i] > w[next])) next = i;
+            }
+            // Stop if adding it overshoots the target by more than we are short of it
+            if (partW[p] + w[next] - target > target - partW[p]) break;
+            v = next;
+        }
+    }
+
+    // Refinement
+    double maxPartW = std::max(total/k*(1.0 + maxImbalance), maxNodeW);
+    std::vector<double> connTo(k);
+    for (uint32_t pass = 0; pass < 32; pass++) {
+        bool moved = false;
+        for (uint32_t i = 0; i < n; i++) {
+            std::fill(connTo.begin(), connTo.end(), 0.0);
+            for (uint32_t j = 0; j < n; j++) if (j != i) connTo[part[j]] += adj[i][j];
+            uint32_t cur = part[i];
+            uint32_t best = cur;
+            double bestGain = 0.0;
+            for (uint32_t p = 0; p < k; p++) {
+                double gain = connTo[p] - connTo[cur];
+                if (p != cur && gain > bestGain && partW[p] + w[i] <= maxPartW) {
+                    best = p;
+                    bestGain = gain;
+                }
+            }
+            if (best != cur) {
+                partW[cur] -= w[i];
+                partW[best] += w[i];
+                part[i] = best;
+                moved = true;
+            }
+        }
+        if (!moved) break;
+    }
+    return part;
+}
+
+static double CutWeight(const std::vector<std::vector<double>>& adj, const std::vector<uint32_t>& part) {
+    double cut = 0.0;
+    for (uint32_t i = 0; i < part.size(); i++) {
+        for (uint32_t j = i + 1; j < part.size(); j++) if (part[i] != part[j]) cut += adj[i][j];
+    }
+    return cut;
+}
+
+// Heaviest part over the average, 1.0 is perfect balance
+static double Imbalance(const std::vector<double>& w, const std::vector<uint32_t>& part, uint32_t k) {
+    std::vector<double> partW(k, 0.0);
+    double total = 0.0;
+    for (uint32_t i = 0; i < part.size(); i++) {
+        partW[part[i]] += w[i];
+        total += w[i];
+    }
+    return total? *std::max_element(partW.begin(), partW.end())*k/total : 1.0;
+}
+
+void DomainProfiler::writeReport(const char* outputDir) {
+    ContentionSim* csim = zinfo->contentionSim;
+    uint32_t n = numComponents;
+    assert(n <= zinfo->numDomains && csim->isProfilingDomains());  // the rest are empty padding domains
+
+    // Balance host time; fall back to events if the clock did not tick (or nothing ran)
+    std::vector<double> w(n);
+    uint64_t totalNs = 0;
+    uint64_t totalEvents = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        totalNs += csim->getProfNs(i);
+        totalEvents += csim->getProfEvents(i);
+    }
+    for (uint32_t i = 0; i < n; i++) w[i] = totalNs? csim->getProfNs(i) : csim->getProfEvents(i);
+
+    std::vector<std::vector<double>> adj(n, std::vector<double>(n, 0.0));
+    uint64_t totalCrossings = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t j = 0; j < n; j++) {
+            uint64_t c = csim->getProfCrossings(i, j);
+            totalCrossings += c;
+            if (i != j) {
+                adj[i][j] += c;
+                adj[j][i] += c;
+            }
+        }
+    }
+
+    std::vector<uint32_t> evenPart(n);
+    for (const ComponentGroup& g : groups) {
+        for (uint32_t i = 0; i < g.components.size(); i++) evenPart[g.components[i]] = g.evenDomains[i];
+    }
+    std::vector<uint32_t> part = PartitionGraph(w, adj, targetDomains, 0.1);
+
+    double evenCut = CutWeight(adj, evenPart);
+    double cut = CutWeight(adj, part);
+    double evenImbalance = Imbalance(w, evenPart, targetDomains);
+    double imbalance = Imbalance(w, part, targetDomains);
+
+    std::stringstream ss;
+    ss << outputDir << "/zsim-domains.cfg";
+    FILE* f = fopen(ss.str().c_str(), "w");
+    if (!f) {
+        warn("Could not write domain map to %s", ss.str().c_str());
+        return;
+    }
+    fprintf(f, "// zsim weave domain map, computed by a domain profiling run (sim.profileDomains = true)\n");
+    fprintf(f, "// @include this file in the config of later runs to use it; it overrides sim.domains\n");
+    fprintf(f, "// Profiled %d components: %ld crossings, %ld events, %.3f s of weave host time\n",
+            n, totalCrossings, totalEvents, totalNs/1e9);
+    fprintf(f, "// Crossings between domains: %.0f with this map, %.0f when split evenly\n", cut, evenCut);
+    fprintf(f, "// Heaviest domain over the average %s: %.2f with this map, %.2f when split evenly\n",
+            totalNs? "host time" : "events", imbalance, evenImbalance);
+    fprintf(f, "domainMap = {\n");
+    fprintf(f, "    domains = %d;\n", targetDomains);
+    for (const ComponentGroup& g : groups) {
+        fprintf(f, "    %s = \"", g.name.c_str());
+        for (uint32_t i = 0; i < g.components.size(); i++) fprintf(f, i? " %d" : "%d", part[g.components[i]]);
+        fprintf(f, "\";\n");
+    }
+    fprintf(f, "};\n");
+    fclose(f);
+    info("Wrote domain map to %s: %d components in %d domains, %.0f of %ld crossings cut (%.0f when split evenly), "
+         "imbalance %.2f (%.2f)", ss.str().c_str(), n, targetDomains, cut, totalCrossings, evenCut, imbalance, evenImbalance);
+}
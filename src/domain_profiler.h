@@ -0,0 +1,72 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DOMAIN_PROFILER_H_
+#define DOMAIN_PROFILER_H_
+
+/* Automatic partitioning of the weave phase into domains.
+ *
+ * Domains are normally assigned by splitting each group of components (cores, cache banks, memory controllers)
+ * evenly among sim.domains domains. A poor split makes components that talk a lot live in different domains, and
+ * each such request then needs a CrossingEvent. In a profiling run (sim.profileDomains = true), every weave component
+ * gets its own domain, and the contention simulation counts crossings between every pair of components and the
+ * events run and host time spent in each. At the end of the run, proc 0 partitions the components into sim.domains
+ * domains, balancing host time while minimizing the crossings between domains, and writes the result to
+ * zsim-domains.cfg as a domainMap setting. Later runs that @include that file use its assignment instead of the even
+ * split (see AssignDomain in init.cpp).
+ */
+
+#include <stdint.h>
+#include <string>
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+
+class DomainProfiler : public GlobAlloc {
+    private:
+        struct ComponentGroup {
+            g_string name;
+            g_vector<uint32_t> components;  // component (profiling domain) of each instance
+            g_vector<uint32_t> evenDomains;  // domain of each instance when split evenly among targetDomains
+        };
+
+        const uint32_t targetDomains;
+        uint32_t numComponents;
+        g_vector<ComponentGroup> groups;
+
+    public:
+        explicit DomainProfiler(uint32_t _targetDomains) : targetDomains(_targetDomains), numComponents(0) {}
+
+        // Registers component idx (of count) of the group and returns its domain, a new one for every component.
+        // split tells whether the group is normally split evenly among domains (else it all goes to domain 0).
+        uint32_t addComponent(const std::string& group, uint32_t idx, uint32_t count, bool split);
+
+        uint32_t getNumComponents() const { return numComponents; }
+
+        // Called by proc 0 at the end of the run
+        void writeReport(const char* outputDir);
+};
+
+#endif  // DOMAIN_PROFILER_H_
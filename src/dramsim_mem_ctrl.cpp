@@ -24,7 +24,6 @@
  */
 
 #include "dramsim_mem_ctrl.h"
-#include <map>
 #include <string>
 #include "event_recorder.h"
 #include "tick_event.h"
@@ -44,8 +43,9 @@ class DRAMSimAccEvent : public TimingEvent {
 
     public:
         uint64_t sCycle;
+        DRAMSimAccEvent* nextInflight; //next in-flight request to the same address
 
-        DRAMSimAccEvent(DRAMSimMemory* _dram, bool _write, Address _addr, int32_t domain) :  TimingEvent(0, 0, domain), dram(_dram), write(_write), addr(_addr) {}
+        DRAMSimAccEvent(DRAMSimMemory* _dram, bool _write, Address _addr, int32_t domain) :  TimingEvent(0, 0, domain), dram(_dram), write(_write), addr(_addr), nextInflight(nullptr) {}
 
         bool isWrite() const {
             return write;
@@ -132,14 +132,20 @@ uint32_t DRAMSimMemory::tick(uint64_t cycle) {
 void DRAMSimMemory::enqueue(DRAMSimAccEvent* ev, uint64_t cycle) {
     //info("[%s] %s access to %lx added at %ld, %ld inflight reqs", getName(), ev->isWrite()? "Write" : "Read", ev->getAddr(), cycle, inflightRequests.size());
     dramCore->addTransaction(ev->isWrite(), ev->getAddr());
-    inflightRequests.insert(std::pair<Address, DRAMSimAccEvent*>(ev->getAddr(), ev));
+    ev->nextInflight = nullptr;
+    InflightList& list = inflightRequests[ev->getAddr()]; //value-initialized to empty
+    if (list.tail) list.tail->nextInflight = ev;
+    else list.head = ev;
+    list.tail = ev;
     ev->hold();
 }
 
 void DRAMSimMemory::DRAM_read_return_cb(uint32_t id, uint64_t addr, uint64_t memCycle) {
-    std::multimap<uint64_t, DRAMSimAccEvent*>::iterator it = inflightRequests.find(addr);
+    g_flat_map<uint64_t, InflightList>::iterator it = inflightRequests.find(addr);
     assert((it != inflightRequests.end()));
-    DRAMSimAccEvent* ev = it->second;
+    DRAMSimAccEvent* ev = it->second.head;
+    if (ev->nextInflight) it->second.head = ev->nextInflight;
+    else inflightRequests.erase(it);
 
     uint32_t lat = curCycle+1 - ev->sCycle;
     if (ev->isWrite()) {
@@ -152,8 +158,7 @@ void DRAMSimMemory::DRAM_read_return_cb(uint32_t id, uint64_t addr, uint64_t mem
 
     ev->release();
     ev->done(curCycle+1);
-    inflightRequests.erase(it);
-    //info("[%s] %s access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), it->second->isWrite()? "Write" : "Read", it->second->getAddr(), curCycle, curCycle-it->second->sCycle, inflightRequests.size());
+    //info("[%s] %s access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), ev->isWrite()? "Write" : "Read", ev->getAddr(), curCycle, curCycle-ev->sCycle, inflightRequests.size());
 }
 
 void DRAMSimMemory::DRAM_write_return_cb(uint32_t id, uint64_t addr, uint64_t memCycle) {
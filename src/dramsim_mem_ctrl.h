@@ -26,8 +26,8 @@
 #ifndef DRAMSIM_MEM_CTRL_H_
 #define DRAMSIM_MEM_CTRL_H_
 
-#include <map>
 #include <string>
+#include "g_std/g_flat_map.h"
 #include "g_std/g_string.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
@@ -47,7 +47,13 @@ class DRAMSimMemory : public MemObject { //one DRAMSim controller
 
         DRAMSim::MultiChannelMemorySystem* dramCore;
 
-        std::multimap<uint64_t, DRAMSimAccEvent*> inflightRequests;
+        //DRAMSim returns requests to the same address in order, so in-flight requests are kept in a FIFO per address,
+        //chained through the events themselves
+        struct InflightList {
+            DRAMSimAccEvent* head;
+            DRAMSimAccEvent* tail;
+        };
+        g_flat_map<uint64_t, InflightList> inflightRequests;
 
         uint64_t curCycle; //processor cycle, used in callbacks
 
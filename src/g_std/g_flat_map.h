@@ -0,0 +1,274 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef G_FLAT_MAP_H_
+#define G_FLAT_MAP_H_
+
+#include <functional>
+#include <new>
+#include <stdint.h>
+#include <utility>
+#include "g_std/stl_galloc.h"
+#include "log.h"
+
+/* Open-addressing hash map with linear probing, for small-value maps probed in the hot path (e.g., per-line state).
+ * Entries live in a single power-of-two array, so a lookup usually touches one or two cache lines instead of
+ * chasing bucket and node pointers. Deletions use backward shifting, so there are no tombstones and probe sequences
+ * stay short under churn.
+ *
+ * Differences with std::unordered_map to keep in mind:
+ *  - Inserts may rehash, and erases may move other entries: ANY insert or erase invalidates all iterators and
+ *    pointers to values. Users that hold pointers to values across operations must defer erases (see TraceDriver).
+ *  - Keys and values must be copyable (entries are moved on growth and erases).
+ *  - value_type is std::pair<K, V>; don't modify the key through an iterator.
+ *
+ * Hash values are scrambled with a multiplicative (Fibonacci) hash, so std::hash's identity function on integers
+ * works fine even for strided keys such as line addresses.
+ *
+ * Allocates from the global heap by default; the allocator parameter exists so that it can be benchmarked
+ * against the standard containers with std::allocator.
+ */
+template <typename K, typename V, typename H = std::hash<K>, typename A = StlGlobAlloc<std::pair<K, V> > >
+class g_flat_map : public GlobAlloc {
+    public:
+        typedef K key_type;
+        typedef V mapped_type;
+        typedef std::pair<K, V> value_type;
+        typedef size_t size_type;
+
+    private:
+        typedef typename A::template rebind<value_type>::other EntryAlloc;
+        typedef typename A::template rebind<uint8_t>::other UsedAlloc;
+
+        value_type* entries;
+        uint8_t* used;
+        size_t numEntries;
+        size_t mask; //capacity - 1
+        uint32_t shift; //64 - log2(capacity)
+        H hasher;
+        EntryAlloc entryAlloc;
+        UsedAlloc usedAlloc;
+
+        static const size_t MIN_CAPACITY = 8;
+
+    public:
+        template <typename M, typename E>
+        class iterator_base {
+            private:
+                M* map;
+                size_t pos;
+                friend class g_flat_map;
+
+                void skip() {
+                    while (pos <= map->mask && !map->used[pos]) pos++;
+                }
+
+            public:
+                iterator_base() : map(nullptr), pos(0) {}
+                iterator_base(M* _map, size_t _pos) : map(_map), pos(_pos) {}
+                //Allows iterator -> const_iterator conversion
+                template <typename M2, typename E2>
+                iterator_base(const iterator_base<M2, E2>& it) : map(it.map), pos(it.pos) {}
+
+                E& operator*() const {return map->entries[pos];}
+                E* operator->() const {return &map->entries[pos];}
+                iterator_base& operator++() {pos++; skip(); return *this;}
+                bool operator==(const iterator_base& other) const {return pos == other.pos;}
+                bool operator!=(const iterator_base& other) const {return pos != other.pos;}
+
+                template <typename M2, typename E2> friend class iterator_base;
+        };
+
+        typedef iterator_base<g_flat_map, value_type> iterator;
+        typedef iterator_base<const g_flat_map, const value_type> const_iterator;
+
+        g_flat_map() : entries(nullptr), used(nullptr), numEntries(0), mask(0), shift(64) {}
+
+        g_flat_map(const g_flat_map& other) : entries(nullptr), used(nullptr), numEntries(0), mask(0), shift(64) {
+            *this = other;
+        }
+
+        ~g_flat_map() {
+            clear();
+            release();
+        }
+
+        g_flat_map& operator=(const g_flat_map& other) {
+            if (this == &other) return *this;
+            clear();
+            reserve(other.size());
+            for (const value_type& e : other) insertNew(e.first, e.second);
+            return *this;
+        }
+
+        size_t size() const {return numEntries;}
+        bool empty() const {return numEntries == 0;}
+        size_t capacity() const {return entries? mask + 1 : 0;}
+
+        iterator begin() {iterator it(this, 0); if (entries) it.skip(); return it;}
+        iterator end() {return iterator(this, entries? mask + 1 : 0);}
+        const_iterator begin() const {const_iterator it(this, 0); if (entries) it.skip(); return it;}
+        const_iterator end() const {return const_iterator(this, entries? mask + 1 : 0);}
+
+        iterator find(const K& key) {
+            size_t pos;
+            return lookup(key, pos)? iterator(this, pos) : end();
+        }
+
+        const_iterator find(const K& key) const {
+            size_t pos;
+            return lookup(key, pos)? const_iterator(this, pos) : end();
+        }
+
+        size_t count(const K& key) const {
+            size_t pos;
+            return lookup(key, pos)? 1 : 0;
+        }
+
+        //Value-initializes the value if key is not present
+        V& operator[](const K& key) {
+            size_t pos;
+            if (!lookup(key, pos)) pos = insertNew(key, V()); //may rehash, so don't read entries before
+            return entries[pos].second;
+        }
+
+        std::pair<iterator, bool> insert(const value_type& v) {
+            size_t pos;
+            if (lookup(v.first, pos)) return std::make_pair(iterator(this, pos), false);
+            return std::make_pair(iterator(this, insertNew(v.first, v.second)), true);
+        }
+
+        size_t erase(const K& key) {
+            size_t pos;
+            if (!lookup(key, pos)) return 0;
+            eraseAt(pos);
+            return 1;
+        }
+
+        void erase(iterator it) {
+            assert(it.map == this && it.pos <= mask && used[it.pos]);
+            eraseAt(it.pos);
+        }
+
+        void clear() {
+            if (!entries) return;
+            for (size_t i = 0; i <= mask; i++) {
+                if (used[i]) {
+                    entries[i].~value_type();
+                    used[i] = 0;
+                }
+            }
+            numEntries = 0;
+        }
+
+        //Sizes the table so that n entries fit without rehashing
+        void reserve(size_t n) {
+            size_t cap = MIN_CAPACITY;
+            while (cap*3 < n*4) cap *= 2;
+            if (cap > capacity()) rehash(cap);
+        }
+
+    private:
+        inline size_t home(const K& key) const {
+            return (uint64_t)(hasher(key) * 0x9E3779B97F4A7C15ULL) >> shift;
+        }
+
+        //Returns true and the position of key if found; otherwise, the first free position in key's probe sequence
+        inline bool lookup(const K& key, size_t& pos) const {
+            if (!entries) return false;
+            pos = home(key);
+            while (used[pos]) {
+                if (entries[pos].first == key) return true;
+                pos = (pos + 1) & mask;
+            }
+            return false;
+        }
+
+        //key must not be present. Grows at 75% occupancy
+        size_t insertNew(const K& key, const V& value) {
+            if ((numEntries + 1)*4 > capacity()*3) rehash(entries? 2*(mask + 1) : MIN_CAPACITY);
+            size_t pos = home(key);
+            while (used[pos]) pos = (pos + 1) & mask;
+            new (&entries[pos]) value_type(key, value);
+            used[pos] = 1;
+            numEntries++;
+            return pos;
+        }
+
+        void eraseAt(size_t hole) {
+            entries[hole].~value_type();
+            used[hole] = 0;
+            numEntries--;
+            //Backward shift: pull back every following entry in the cluster that may legally sit in the hole (its home
+            //position is not within the cyclic range (hole, pos])
+            for (size_t pos = (hole + 1) & mask; used[pos]; pos = (pos + 1) & mask) {
+                size_t h = home(entries[pos].first);
+                if (((pos - h) & mask) >= ((pos - hole) & mask)) {
+                    new (&entries[hole]) value_type(entries[pos]);
+                    used[hole] = 1;
+                    entries[pos].~value_type();
+                    used[pos] = 0;
+                    hole = pos;
+                }
+            }
+        }
+
+        void rehash(size_t newCap) {
+            assert((newCap & (newCap - 1)) == 0 && newCap >= MIN_CAPACITY);
+            value_type* oldEntries = entries;
+            uint8_t* oldUsed = used;
+            size_t oldCap = capacity();
+
+            entries = entryAlloc.allocate(newCap);
+            used = usedAlloc.allocate(newCap);
+            for (size_t i = 0; i < newCap; i++) used[i] = 0;
+            mask = newCap - 1;
+            shift = 64 - __builtin_ctzl(newCap);
+            numEntries = 0;
+
+            for (size_t i = 0; i < oldCap; i++) {
+                if (oldUsed[i]) {
+                    insertNew(oldEntries[i].first, oldEntries[i].second);
+                    oldEntries[i].~value_type();
+                }
+            }
+            if (oldEntries) {
+                entryAlloc.deallocate(oldEntries, oldCap);
+                usedAlloc.deallocate(oldUsed, oldCap);
+            }
+        }
+
+        void release() {
+            if (!entries) return;
+            entryAlloc.deallocate(entries, mask + 1);
+            usedAlloc.deallocate(used, mask + 1);
+            entries = nullptr;
+            used = nullptr;
+            mask = 0;
+            shift = 64;
+        }
+};
+
+#endif  // G_FLAT_MAP_H_
@@ -24,15 +24,24 @@
  */
 
 #include "galloc.h"
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <sys/ipc.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "log.h"  // NOLINT must precede dlmalloc, which defines assert if undefined
 #include "g_heap/dlmalloc.h.c"
+#include "bithacks.h"
 #include "locks.h"
 #include "pad.h"
 
@@ -50,54 +59,245 @@
  */
 #define GM_BASE_ADDR ((const void*)0x00ABBA000000)
 
+/* Growth. Every process reserves the heap's maximum size of address space (PROT_NONE, no memory behind it) at
+ * GM_BASE_ADDR, so nothing else gets mapped there. The heap starts as a single SysV segment at the base, and when
+ * the mspace runs out, the allocating process creates a new segment right after the last one, maps it over the
+ * reservation, and hands it to dlmalloc. Other processes map new segments lazily: on their next gm_* call, or when
+ * they fault on a pointer into a segment they have not mapped yet (see gm_handle_fault()).
+ *
+ * The reservation counts against RLIMIT_AS in every process, so the maximum size defaults to GM_DEFAULT_MAX_BYTES
+ * and is capped to half the limit.
+ *
+ * Segments are marked for destruction as soon as they are created, so they never outlive the simulation, even if
+ * the harness is killed. A segment is then destroyed when no process has it mapped, so one added by a process that
+ * exits before anyone else maps it would be lost. To avoid this, the process that called gm_init (the harness in
+ * zsim), which outlives all others, keeps a thread in gm_wait_new_segments() that maps segments as soon as they are
+ * added, and gm_grow() waits for it before returning.
+ */
+#define GM_DEFAULT_MAX_BYTES (64ul << 30)
+#define GM_MAX_SEGMENTS 1024
+#define GM_INIT_MAP_TIMEOUT_MS 5000
+
+/* Small-object caches. Every mspace call needs the global lock, which many simulation threads across processes
+ * contend on. So small blocks (up to GM_CACHE_MAX_BYTES) are recycled through caches of free lists, one per size
+ * class, that are refilled and drained in batches, taking the global lock once per batch.
+ *
+ * Caches would ideally be per-thread, but pintools can't use native TLS and this code also runs in the harness and
+ * tools, so they are per-CPU instead (by sched_getcpu()), each with its own lock. Threads on different CPUs never
+ * share a cache, so these locks are almost always uncontended; the lock only matters when a thread migrates in the
+ * middle of an operation. Caches live in the segment, so a block freed by one process may be reused by another,
+ * just like the mspace itself.
+ *
+ * A freed block's class comes from its usable size, so any mspace block of the right size can go to a cache.
+ * Caches hold at most GM_CACHE_CLASS_BYTES per class, and move half of that on each refill or drain.
+ */
+#define GM_CACHES 64
+#define GM_CLASS_BYTES 16
+#define GM_SIZE_CLASSES 32
+#define GM_CACHE_MAX_BYTES (GM_CLASS_BYTES*GM_SIZE_CLASSES)
+#define GM_CACHE_CLASS_BYTES 4096
+
+struct gm_free_block {
+    gm_free_block* next;
+};
+
+struct gm_cache {
+    lock_t lock;
+    gm_free_block* lists[GM_SIZE_CLASSES];
+    uint32_t counts[GM_SIZE_CLASSES];
+    uint64_t allocs, frees; //served/absorbed by this cache
+    PAD();
+};
+
+struct gm_tag_counters {
+    volatile int64_t bytes; //live; signed because frees race with allocs
+    volatile int64_t peakBytes;
+    volatile uint64_t allocs;
+    PAD();
+};
+
+struct gm_segment_desc {
+    int shmid;
+    char* base;
+    size_t size;
+};
+
 struct gm_segment {
     volatile void* base_regp; //common data structure, accessible with glob_ptr; threads poll on gm_isready to determine when everything has been initialized
     volatile void* secondary_regp; //secondary data structure, used to exchange information between harness and initializing process
+    volatile void* lockprof_regp; //lock profiler's name table, see lock_prof.cpp
     mspace mspace_ptr;
 
+    gm_cache* caches; //nullptr if caching is disabled
+    uint32_t numCaches;
+
+    size_t size; //all segments
+    gm_page_mode pageMode; //attaching processes must madvise THP segments too
+    gm_numa_mode numaMode;
+    uint64_t numaNodeMask;
+
+    //Segment table, lives in the first segment. Written under lock; numSegments is bumped after the entry is set
+    gm_segment_desc* segments;
+    volatile uint32_t numSegments;
+    pid_t initPid; //maps segments as they are added, see above
+    volatile uint32_t initMappedSegments; //segments the init process has mapped; futex
+    size_t reservedBytes; //address space reserved at GM_BASE_ADDR, and the maximum heap size
+    size_t growBytes; //minimum size of new segments
+
+    gm_tag_counters* tagCounters; //[GM_TAGS], lives in the first segment
+
+    char* dirtyEnd; //end of the highest block ever handed out; under lock
+
     PAD();
     lock_t lock;
+    uint64_t lockAcquires; //all under lock
+    uint64_t mspaceAllocs;
+    uint64_t mspaceFrees;
     PAD();
 };
 
 static gm_segment* GM = nullptr;
 static int gm_shmid = 0;
 
-/* Heap segment size, in bytes. Can't grow for now, so choose something sensible, and within the machine's limits (see sysctl vars kernel.shmmax and kernel.shmall) */
-int gm_init(size_t segmentSize) {
-    /* Create a SysV IPC shared memory segment, attach to it, and mark the segment to
-     * auto-destroy when the number of attached processes becomes 0.
-     *
-     * IMPORTANT: There is a small window of vulnerability between shmget and shmctl that
-     * can lead to major issues: between these calls, we have a segment of persistent
-     * memory that will survive the program if it dies (e.g. someone just happens to send us
-     * a SIGKILL)
-     */
+//Per-process: segments mapped so far, and a lock to map new ones
+static volatile uint32_t gm_mappedSegments = 0;
+static lock_t gm_mapLock;
+static size_t gm_reservedBytes = 0;
 
-    assert(GM == nullptr);
-    assert(gm_shmid == 0);
-    gm_shmid = shmget(IPC_PRIVATE, segmentSize, 0644 | IPC_CREAT /*| SHM_HUGETLB*/);
-    if (gm_shmid == -1) {
+static inline void gm_futex_wait(volatile uint32_t* addr, uint32_t val, uint32_t timeoutMs) {
+    struct timespec ts = {timeoutMs/1000, (timeoutMs % 1000)*1000*1000l};
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+static inline void gm_futex_wake(volatile uint32_t* addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1 << 30, nullptr, nullptr, 0);
+}
+
+#define GM_HUGE_PAGE_BYTES (2ul << 20)
+
+// Applies the NUMA policy to the whole segment. mbind on SysV shm sets a shared policy, so it covers pages faulted
+// by any process, but only pages faulted after this call
+static void gm_set_numa(void* base, size_t size, gm_numa_mode numa, uint64_t nodeMask) {
+    if (numa == GM_NUMA_DEFAULT) return;
+    // Raw syscall to avoid depending on libnuma; values from linux/mempolicy.h
+    const int MPOL_BIND_ = 2, MPOL_INTERLEAVE_ = 3;
+    int mode = (numa == GM_NUMA_BIND)? MPOL_BIND_ : MPOL_INTERLEAVE_;
+    if (!nodeMask) {
+        warn("gm: NUMA %s requested with an empty node mask, using default placement", (numa == GM_NUMA_BIND)? "bind" : "interleave");
+        return;
+    }
+    if (syscall(SYS_mbind, base, size, mode, &nodeMask, 64 /*maxnode*/, 0) != 0) {
+        warn("gm: mbind failed (%s), using default NUMA placement", strerror(errno));
+    }
+}
+
+static void gm_set_thp(void* base, size_t size) {
+    if (madvise(base, size, MADV_HUGEPAGE) != 0) {
+        warn("gm: madvise(MADV_HUGEPAGE) failed (%s), segment will use base pages", strerror(errno));
+    }
+}
+
+/* Heap segment size, in bytes. Can't grow for now, so choose something sensible, and within the machine's limits (see sysctl vars kernel.shmmax and kernel.shmall)
+ * Huge pages: GM_PAGES_HUGETLB needs reserved huge pages (vm.nr_hugepages), and falls back to base pages if there are
+ * not enough; GM_PAGES_THP asks for transparent huge pages, which shm segments only get if
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled is advise or always. gm_report_backing() tells what we got.
+ */
+//Reserves [GM_BASE_ADDR + start, GM_BASE_ADDR + bytes)
+static void gm_reserve(size_t start, size_t bytes) {
+    futex_init(&gm_mapLock);
+    gm_reservedBytes = bytes;
+    if (start >= bytes) return;
+    char* addr = static_cast<char*>(const_cast<void*>(GM_BASE_ADDR)) + start;
+    void* res = mmap(addr, bytes - start, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (res != addr) {
+        if (res != MAP_FAILED) munmap(res, bytes - start);
+        panic("gm: could not reserve %ld MB of address space at %p for the global heap (check ulimit -v, or lower sim.gmMaxMBytes)",
+                (bytes - start) >> 20, addr);
+    }
+}
+
+static size_t gm_max_bytes(size_t segmentSize, size_t maxBytes) {
+    size_t bytes = maxBytes? maxBytes : GM_DEFAULT_MAX_BYTES;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_AS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && bytes > rl.rlim_cur/2) {
+        bytes = rl.rlim_cur/2;
+        warn("gm: address space is limited to %ld MB (ulimit -v), capping the global heap at %ld MB", rl.rlim_cur >> 20, bytes >> 20);
+    }
+    bytes = MAX(bytes, segmentSize);
+    return (bytes + GM_HUGE_PAGE_BYTES - 1) & ~(GM_HUGE_PAGE_BYTES - 1);
+}
+
+/* Creates a SysV IPC shared memory segment, attaches to it at addr, and marks the segment to
+ * auto-destroy when the number of attached processes becomes 0 (Linux still lets other processes
+ * attach it until then). Returns the shmid, or -1 if the segment could not be created. size and
+ * pages are updated with what we got.
+ *
+ * IMPORTANT: There is a small window of vulnerability between shmget and shmctl that
+ * can lead to major issues: between these calls, we have a segment of persistent
+ * memory that will survive the program if it dies (e.g. someone just happens to send us
+ * a SIGKILL)
+ */
+static int gm_create_segment(char* addr, size_t& size, gm_page_mode& pages, gm_numa_mode numa, uint64_t nodeMask) {
+    int shmid = -1;
+    if (pages != GM_PAGES_DEFAULT) size = (size + GM_HUGE_PAGE_BYTES - 1) & ~(GM_HUGE_PAGE_BYTES - 1);
+    if (pages == GM_PAGES_HUGETLB) {
+        shmid = shmget(IPC_PRIVATE, size, 0644 | IPC_CREAT | SHM_HUGETLB);
+        if (shmid == -1) {
+            warn("gm: could not allocate a %ld MB hugetlb segment (%s), check vm.nr_hugepages; falling back to base pages",
+                    size >> 20, strerror(errno));
+            pages = GM_PAGES_DEFAULT;
+        }
+    }
+    if (pages != GM_PAGES_HUGETLB) shmid = shmget(IPC_PRIVATE, size, 0644 | IPC_CREAT);
+    if (shmid == -1) {
         perror("gm_create failed shmget");
-        exit(1);
+        return -1;
     }
-    GM = static_cast<gm_segment*>(shmat(gm_shmid, GM_BASE_ADDR, 0));
-    if (GM != GM_BASE_ADDR) {
+    if (shmat(shmid, addr, SHM_REMAP) != addr) {
         perror("gm_create failed shmat");
-        warn("shmat failed, shmid %d. Trying not to leave garbage behind before dying...", gm_shmid);
-        int ret = shmctl(gm_shmid, IPC_RMID, nullptr);
+        warn("shmat failed, shmid %d. Trying not to leave garbage behind before dying...", shmid);
+        int ret = shmctl(shmid, IPC_RMID, nullptr);
         if (ret) {
             perror("shmctl failed, we're leaving garbage behind!");
-            panic("Check /proc/sysvipc/shm and manually delete segment with shmid %d", gm_shmid);
+            panic("Check /proc/sysvipc/shm and manually delete segment with shmid %d", shmid);
         } else {
             panic("shmctl succeeded, we're dying in peace");
         }
     }
 
     //Mark the segment to auto-destroy when the number of attached processes becomes 0.
-    int ret = shmctl(gm_shmid, IPC_RMID, nullptr);
+    int ret = shmctl(shmid, IPC_RMID, nullptr);
     assert(!ret);
 
+    //Before we touch anything
+    gm_set_numa(addr, size, numa, nodeMask);
+    if (pages == GM_PAGES_THP) gm_set_thp(addr, size);
+    return shmid;
+}
+
+/* segmentSize is the size of the first segment, and the minimum size of the segments added as the heap grows. Keep
+ * each segment within the machine's limits (see sysctl vars kernel.shmmax and kernel.shmall).
+ * Huge pages: GM_PAGES_HUGETLB needs reserved huge pages (vm.nr_hugepages), and falls back to base pages if there are
+ * not enough; GM_PAGES_THP asks for transparent huge pages, which shm segments only get if
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled is advise or always. gm_report_backing() tells what we got.
+ */
+int gm_init(size_t segmentSize, gm_page_mode pages, gm_numa_mode numa, uint64_t nodeMask, size_t maxBytes) {
+    assert(GM == nullptr);
+    assert(gm_shmid == 0);
+    size_t reservedBytes = gm_max_bytes(segmentSize, maxBytes);
+    gm_reserve(0, reservedBytes);
+    gm_shmid = gm_create_segment(reinterpret_cast<char*>(const_cast<void*>(GM_BASE_ADDR)), segmentSize, pages, numa, nodeMask);
+    if (gm_shmid == -1) exit(1);
+    GM = static_cast<gm_segment*>(const_cast<void*>(GM_BASE_ADDR));
+
+    GM->size = segmentSize;
+    GM->pageMode = pages;
+    GM->numaMode = numa;
+    GM->numaNodeMask = nodeMask;
+    GM->initPid = getpid();
+    GM->initMappedSegments = 1;
+    GM->reservedBytes = reservedBytes;
+
     char* alloc_start = reinterpret_cast<char*>(GM) + 1024;
     size_t alloc_size = segmentSize - 1 - 1024;
     GM->base_regp = nullptr;
@@ -105,59 +305,494 @@ int gm_init(size_t segmentSize) {
     GM->mspace_ptr = create_mspace_with_base(alloc_start, alloc_size, 1 /*locked*/);
     futex_init(&GM->lock);
     assert(GM->mspace_ptr);
+    GM->lockAcquires = GM->mspaceAllocs = GM->mspaceFrees = 0;
+
+    GM->tagCounters = static_cast<gm_tag_counters*>(mspace_memalign(GM->mspace_ptr, CACHE_LINE_BYTES, GM_TAGS*sizeof(gm_tag_counters)));
+    assert(GM->tagCounters);
+    memset(GM->tagCounters, 0, GM_TAGS*sizeof(gm_tag_counters));
+
+    GM->segments = static_cast<gm_segment_desc*>(mspace_malloc(GM->mspace_ptr, GM_MAX_SEGMENTS*sizeof(gm_segment_desc)));
+    assert(GM->segments);
+    GM->segments[0] = {gm_shmid, reinterpret_cast<char*>(GM), segmentSize};
+    GM->numSegments = 1;
+    GM->dirtyEnd = nullptr;
+    gm_mappedSegments = 1;
+    GM->growBytes = segmentSize;
+
+    GM->caches = nullptr;
+    gm_set_caching(true);
+    futex_prof_name(&GM->lock, "gm");  // allocates the name table under LOCK_PROFILE, so the heap must be ready
 
     return gm_shmid;
 }
 
+//Maps the segments other processes have added since our last check
+static void gm_map_segments() {
+    futex_lock(&gm_mapLock);
+    uint32_t numSegments = GM->numSegments;
+    __sync_synchronize();
+    for (uint32_t i = gm_mappedSegments; i < numSegments; i++) {
+        gm_segment_desc& s = GM->segments[i];
+        if (shmat(s.shmid, s.base, SHM_REMAP) != s.base) {
+            panic("gm: could not map global heap segment %d (shmid %d, %ld MB at %p): %s", i, s.shmid, s.size >> 20, s.base, strerror(errno));
+        }
+        if (GM->pageMode == GM_PAGES_THP) gm_set_thp(s.base, s.size);
+    }
+    gm_mappedSegments = numSegments;
+    if (getpid() == GM->initPid && GM->initMappedSegments < numSegments) {
+        GM->initMappedSegments = numSegments;
+        gm_futex_wake(&GM->initMappedSegments);
+    }
+    futex_unlock(&gm_mapLock);
+}
+
+static inline void gm_sync() {
+    if (unlikely(gm_mappedSegments != GM->numSegments)) gm_map_segments();
+}
+
+void gm_map_new_segments() {
+    assert(GM);
+    gm_sync();
+}
+
+void gm_wait_new_segments(uint32_t timeoutMs) {
+    assert(GM && getpid() == GM->initPid);
+    uint32_t numSegments = GM->numSegments;
+    if (numSegments == gm_mappedSegments) gm_futex_wait(&GM->numSegments, numSegments, timeoutMs);
+    gm_sync();
+}
+
+//Takes the global lock. Segments are only added under it, so after this the mspace can touch any of them
+static inline void gm_lock() {
+    futex_lock(&GM->lock);
+    GM->lockAcquires++;
+    gm_sync();
+}
+
+bool gm_handle_fault(const void* addr) {
+    if (!GM || addr < GM_BASE_ADDR || addr >= static_cast<const char*>(GM_BASE_ADDR) + GM->size) return false;
+    if (gm_mappedSegments == GM->numSegments) return false;  // a real fault
+    gm_map_segments();
+    return true;
+}
+
+//Called with GM->lock held, after an allocation of bytes failed. Adds a segment big enough to fit it.
+//Called with GM->lock held after every mspace allocation
+static inline void gm_mark_dirty(void* ptr) {
+    char* end = static_cast<char*>(ptr) + mspace_usable_size(ptr);
+    if (end > GM->dirtyEnd) GM->dirtyEnd = end;
+}
+
+static bool gm_grow(size_t bytes) {
+    if (GM->numSegments == GM_MAX_SEGMENTS) return false;
+    gm_sync();  // we only add after the last segment, so we must have mapped all others
+    size_t size = MAX(GM->growBytes, bytes + (1ul << 20) /*dlmalloc segment overheads, alignment*/);
+    size = (size + 4095) & ~4095ul;
+    if (GM->size + size > GM->reservedBytes) return false;
+
+    char* base = reinterpret_cast<char*>(GM) + GM->size;
+    gm_page_mode pages = GM->pageMode;
+    int shmid = gm_create_segment(base, size, pages, GM->numaMode, GM->numaNodeMask);
+    if (shmid == -1) return false;
+    if (GM->size + size > GM->reservedBytes) panic("gm: grew past the reserved range");  // only if rounded to huge pages
+
+    mstate ms = static_cast<mstate>(GM->mspace_ptr);
+    if ((ms->footprint += size) > ms->max_footprint) ms->max_footprint = ms->footprint;
+    add_segment(ms, base, size, 0);
+
+    uint32_t idx = GM->numSegments;
+    GM->segments[idx] = {shmid, base, size};
+    GM->size += size;
+    __sync_synchronize();
+    GM->numSegments = idx + 1;
+    gm_mappedSegments = idx + 1;
+    info("gm: grew global heap by %ld MB to %ld MB (%d segments)", size >> 20, GM->size >> 20, idx + 1);
+
+    // The segment is already marked for destruction, so it dies with us until the init process maps it
+    if (getpid() == GM->initPid) {
+        GM->initMappedSegments = idx + 1;
+    } else {
+        gm_futex_wake(&GM->numSegments);
+        uint32_t waitedMs = 0;
+        while (GM->initMappedSegments <= idx && waitedMs < GM_INIT_MAP_TIMEOUT_MS) {
+            gm_futex_wait(&GM->initMappedSegments, GM->initMappedSegments, 10);
+            waitedMs += 10;
+        }
+        if (GM->initMappedSegments <= idx) {
+            warn("gm: the init process has not mapped heap segment %d after %d ms; it will be lost if this process exits first",
+                    idx, GM_INIT_MAP_TIMEOUT_MS);
+        }
+    }
+    return true;
+}
+
+void gm_set_caching(bool enable) {
+    assert(GM);
+    if (!enable) {
+        GM->caches = nullptr;  // cached blocks are leaked, so call this right after gm_init
+        return;
+    }
+    if (GM->caches) return;
+
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);  // NOLINT(runtime/int)
+    uint32_t numCaches = (cpus > 0 && cpus < GM_CACHES)? cpus : GM_CACHES;
+    gm_cache* caches = static_cast<gm_cache*>(mspace_memalign(GM->mspace_ptr, CACHE_LINE_BYTES, numCaches*sizeof(gm_cache)));
+    if (!caches) panic("gm_set_caching(): Out of global heap memory");
+    memset(caches, 0, numCaches*sizeof(gm_cache));
+    for (uint32_t i = 0; i < numCaches; i++) futex_init(&caches[i].lock);
+    GM->numCaches = numCaches;
+    GM->caches = caches;
+}
+
+static inline gm_cache* gm_get_cache() {
+    int cpu = sched_getcpu();
+    return &GM->caches[((uint32_t)MAX(cpu, 0)) % GM->numCaches];
+}
+
+static inline uint32_t gm_class_blocks(uint32_t cls) {
+    return GM_CACHE_CLASS_BYTES/((cls + 1)*GM_CLASS_BYTES);
+}
+
+//Called with the cache's lock held
+static void gm_refill(gm_cache* c, uint32_t cls) {
+    size_t size = (cls + 1)*GM_CLASS_BYTES;
+    uint32_t batch = MAX(gm_class_blocks(cls)/2, 1u);
+    gm_lock();
+    for (uint32_t i = 0; i < batch; i++) {
+        gm_free_block* b = static_cast<gm_free_block*>(mspace_malloc(GM->mspace_ptr, size));
+        if (!b) break;
+        gm_mark_dirty(b);
+        GM->mspaceAllocs++;
+        b->next = c->lists[cls];
+        c->lists[cls] = b;
+        c->counts[cls]++;
+    }
+    futex_unlock(&GM->lock);
+}
+
+//Called with the cache's lock held
+static void gm_drain(gm_cache* c, uint32_t cls) {
+    uint32_t batch = MAX(gm_class_blocks(cls)/2, 1u);
+    gm_lock();
+    for (uint32_t i = 0; i < batch && c->lists[cls]; i++) {
+        gm_free_block* b = c->lists[cls];
+        c->lists[cls] = b->next;
+        c->counts[cls]--;
+        mspace_free(GM->mspace_ptr, b);
+        GM->mspaceFrees++;
+    }
+    futex_unlock(&GM->lock);
+}
+
+static inline void* gm_cached_malloc(size_t size) {
+    uint32_t cls = (MAX(size, (size_t)1) - 1)/GM_CLASS_BYTES;
+    gm_cache* c = gm_get_cache();
+    futex_lock(&c->lock);
+    if (!c->lists[cls]) gm_refill(c, cls);
+    gm_free_block* b = c->lists[cls];
+    if (b) {
+        c->lists[cls] = b->next;
+        c->counts[cls]--;
+        c->allocs++;
+    }
+    futex_unlock(&c->lock);
+    if (b) gm_sync();  // another process may have carved it from a segment we have not mapped yet
+    return b;
+}
+
+static inline bool gm_cached_free(void* ptr) {
+    size_t usable = mspace_usable_size(ptr);
+    if (usable < GM_CLASS_BYTES || usable >= GM_CACHE_MAX_BYTES + GM_CLASS_BYTES) return false;
+    uint32_t cls = MIN(usable/GM_CLASS_BYTES, (size_t)GM_SIZE_CLASSES) - 1;  // largest class this block can hold
+    gm_cache* c = gm_get_cache();
+    futex_lock(&c->lock);
+    gm_free_block* b = static_cast<gm_free_block*>(ptr);
+    b->next = c->lists[cls];
+    c->lists[cls] = b;
+    c->counts[cls]++;
+    c->frees++;
+    if (c->counts[cls] > gm_class_blocks(cls)) gm_drain(c, cls);
+    futex_unlock(&c->lock);
+    return true;
+}
+
 void gm_attach(int shmid) {
     assert(GM == nullptr);
     assert(gm_shmid == 0);
     gm_shmid = shmid;
+    // Map the first segment to learn how much to reserve; without SHM_REMAP, so this fails instead of clobbering a mapping
     GM = static_cast<gm_segment*>(shmat(gm_shmid, GM_BASE_ADDR, 0));
     if (GM != GM_BASE_ADDR) {
         warn("shmid %d \n", shmid);
         panic("gm_attach failed allocation");
     }
+    gm_reserve(GM->segments[0].size, GM->reservedBytes);
+    if (GM->pageMode == GM_PAGES_THP) gm_set_thp(GM, GM->segments[0].size);
+    gm_mappedSegments = 1;
+    gm_sync();
 }
 
-
-void* gm_malloc(size_t size) {
+void gm_report_backing() {
     assert(GM);
-    assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
+    const char* pageModes[] = {"base pages", "hugetlb", "THP"};
+    uint64_t base = (uint64_t)GM;
+
+    // smaps entry of the segment: page size and how much of it is resident and huge-page-mapped. hugetlb pages are
+    // not counted in Rss, but in Shared_Hugetlb/Private_Hugetlb (the segment is shared, so normally the former)
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inSegment = false;
+    uint64_t kernelPageKB = 0, rssKB = 0, hugeKB = 0, hugetlbKB = 0;
+    while (std::getline(smaps, line)) {
+        uint64_t start, end;
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > line.find(' ')) {
+            inSegment = (start == base);
+            continue;
+        }
+        if (!inSegment) continue;
+        std::istringstream iss(line);
+        std::string key;
+        uint64_t kb;
+        if (!(iss >> key >> kb)) continue;
+        if (key == "KernelPageSize:") kernelPageKB = kb;
+        else if (key == "Rss:") rssKB = kb;
+        else if (key == "AnonHugePages:" || key == "ShmemPmdMapped:" || key == "ShmemHugePages:") hugeKB = MAX(hugeKB, kb);
+        else if (key == "Shared_Hugetlb:" || key == "Private_Hugetlb:") hugetlbKB += kb;
+    }
+    rssKB += hugetlbKB;
+    hugeKB += hugetlbKB;
+
+    // NUMA policy of the segment
+    std::ifstream numaMaps("/proc/self/numa_maps");
+    std::string policy = "unknown";
+    while (std::getline(numaMaps, line)) {
+        uint64_t start;
+        if (sscanf(line.c_str(), "%lx ", &start) == 1 && start == base) {
+            std::istringstream iss(line);
+            std::string addr;
+            iss >> addr >> policy;
+            break;
+        }
+    }
+
+    info("Global heap: %ld MB in %d segments at %p, requested %s; first segment: kernel page size %ld KB, %ld MB resident "
+            "(%ld MB in huge pages), NUMA policy %s", GM->size >> 20, GM->numSegments, GM, pageModes[GM->pageMode],
+            kernelPageKB, rssKB >> 10, hugeKB >> 10, policy.c_str());
+}
+
+
+static void* gm_raw_malloc(size_t size) {
+    if (GM->caches && size <= GM_CACHE_MAX_BYTES) {
+        void* ptr = gm_cached_malloc(size);
+        if (ptr) return ptr;
+    }
+    gm_lock();
+    GM->mspaceAllocs++;
     void* ptr = mspace_malloc(GM->mspace_ptr, size);
+    if (!ptr && gm_grow(size)) ptr = mspace_malloc(GM->mspace_ptr, size);
+    if (ptr) gm_mark_dirty(ptr);
     futex_unlock(&GM->lock);
-    if (!ptr) panic("gm_malloc(): Out of global heap memory, use a larger GM segment");
+    if (!ptr) panic("gm_malloc(): Out of global heap memory (%ld MB in %d segments)", GM->size >> 20, GM->numSegments);
     return ptr;
 }
 
-void* __gm_calloc(size_t num, size_t size) {
-    assert(GM);
-    assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    void* ptr = mspace_calloc(GM->mspace_ptr, num, size);
+static void* gm_raw_calloc(size_t size) {
+    if (GM->caches && size <= GM_CACHE_MAX_BYTES) {
+        void* ptr = gm_cached_malloc(size);
+        if (ptr) {
+            memset(ptr, 0, size);
+            return ptr;
+        }
+    }
+    /* Lazy zeroing: memory above dirtyEnd has never been handed out, and the kernel zeroes fresh shared memory, so a
+     * block carved from the top chunk above it needs no memset. This keeps large arrays (tags, directories, ...)
+     * from being written at init, and leaves their pages unfaulted until the simulation touches them.
+     */
+    gm_lock();
+    GM->mspaceAllocs++;
+    char* top = reinterpret_cast<char*>(static_cast<mstate>(GM->mspace_ptr)->top);
+    void* ptr = mspace_malloc(GM->mspace_ptr, size);
+    if (!ptr && gm_grow(size)) {
+        top = reinterpret_cast<char*>(static_cast<mstate>(GM->mspace_ptr)->top);
+        ptr = mspace_malloc(GM->mspace_ptr, size);
+    }
+    bool fresh = ptr && reinterpret_cast<char*>(mem2chunk(ptr)) == top && static_cast<char*>(ptr) >= GM->dirtyEnd;
+    if (ptr) gm_mark_dirty(ptr);
     futex_unlock(&GM->lock);
-    if (!ptr) panic("gm_calloc(): Out of global heap memory, use a larger GM segment");
+    if (!ptr) panic("gm_calloc(): Out of global heap memory (%ld MB in %d segments)", GM->size >> 20, GM->numSegments);
+    if (!fresh) memset(ptr, 0, size);  // outside the lock
     return ptr;
 }
 
-void* __gm_memalign(size_t blocksize, size_t bytes) {
-    assert(GM);
-    assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
+static void* gm_raw_memalign(size_t blocksize, size_t bytes) {
+    gm_lock();
+    GM->mspaceAllocs++;
     void* ptr = mspace_memalign(GM->mspace_ptr, blocksize, bytes);
+    if (!ptr && gm_grow(bytes + blocksize)) ptr = mspace_memalign(GM->mspace_ptr, blocksize, bytes);
+    if (ptr) gm_mark_dirty(ptr);
     futex_unlock(&GM->lock);
-    if (!ptr) panic("gm_memalign(): Out of global heap memory, use a larger GM segment");
+    if (!ptr) panic("gm_memalign(): Out of global heap memory (%ld MB in %d segments)", GM->size >> 20, GM->numSegments);
     return ptr;
 }
 
+static void gm_raw_free(void* ptr) {
+    if (GM->caches && gm_cached_free(ptr)) return;
+    gm_lock();
+    GM->mspaceFrees++;
+    mspace_free(GM->mspace_ptr, ptr);
+    futex_unlock(&GM->lock);
+}
+
+/* Tagged allocation. Every block has a trailer at the end of its usable space with its size and tag, so frees can be
+ * charged back to the tag without callers passing it. It goes at the end rather than in front so that blocks keep
+ * the address the allocator gave them, and it costs GM_TRL_BYTES per block. Aligned blocks are the exception: with a
+ * trailer, a block as large as its alignment (e.g., a 64KB slab) takes two alignment units, so they have none and
+ * gm_free_aligned() gets their size and tag from the caller.
+ * Per-tag counters are shared by all processes and updated with atomics.
+ */
+struct gm_block_trl {
+    uint64_t size;
+    uint64_t tag;
+};
+
+#define GM_TRL_BYTES sizeof(gm_block_trl)
+
+static gm_tag gm_defaultTag = GM_TAG_OTHER;  // per process
+
+static const char* gm_tagNames[] = {"other", "caches", "coherence", "cores", "mem", "events", "stats", "trace"};
+static_assert(sizeof(gm_tagNames)/sizeof(gm_tagNames[0]) == GM_TAGS, "missing gm tag names");
+
+const char* gm_tag_name(gm_tag tag) {
+    assert(tag < GM_TAGS);
+    return gm_tagNames[tag];
+}
+
+gm_tag gm_set_default_tag(gm_tag tag) {
+    assert(tag < GM_TAGS);
+    gm_tag prev = gm_defaultTag;
+    gm_defaultTag = tag;
+    return prev;
+}
+
+static int gm_defaultNode = -1;  // per process
+
+int gm_set_default_node(int node) {
+    assert(node >= -1 && node < 64);
+    int prev = gm_defaultNode;
+    gm_defaultNode = node;
+    return prev;
+}
+
+void gm_place(void* ptr, size_t size, int node) {
+    if (node < 0 || node >= 64) return;
+    uintptr_t pageBytes = (GM->pageMode == GM_PAGES_HUGETLB)? GM_HUGE_PAGE_BYTES : 4096;
+    uintptr_t start = (reinterpret_cast<uintptr_t>(ptr) + pageBytes - 1) & ~(pageBytes - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(pageBytes - 1);
+    if (end <= start) return;
+    // Raw syscall as in gm_set_numa; values from linux/mempolicy.h
+    const int MPOL_PREFERRED_ = 1;
+    const int MPOL_MF_MOVE_ = 1 << 1;
+    uint64_t nodeMask = 1ul << node;
+    if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED_, &nodeMask, 64 /*maxnode*/, MPOL_MF_MOVE_) != 0) {
+        static bool warned = false;
+        if (!warned) warn("gm: mbind to node %d failed (%s), using the heap's NUMA placement", node, strerror(errno));
+        warned = true;
+    }
+}
+
+static inline void* gm_place_block(void* ptr, size_t size) {
+    if (gm_defaultNode >= 0 && size >= GM_PLACE_MIN_BYTES) gm_place(ptr, size, gm_defaultNode);
+    return ptr;
+}
+
+static inline gm_block_trl* gm_trailer(void* ptr) {
+    return reinterpret_cast<gm_block_trl*>(static_cast<char*>(ptr) + mspace_usable_size(ptr) - GM_TRL_BYTES);
+}
+
+static inline void gm_charge_tag(size_t size, gm_tag tag) {
+    assert(tag < GM_TAGS);
+    gm_tag_counters& c = GM->tagCounters[tag];
+    int64_t cur = __sync_add_and_fetch(&c.bytes, size);
+    __sync_fetch_and_add(&c.allocs, 1);
+    int64_t peak = c.peakBytes;
+    while (cur > peak && !__sync_bool_compare_and_swap(&c.peakBytes, peak, cur)) peak = c.peakBytes;
+}
+
+static inline void* gm_tag_block(void* ptr, size_t size, gm_tag tag) {
+    gm_block_trl* trl = gm_trailer(ptr);
+    trl->size = size;
+    trl->tag = tag;
+    gm_charge_tag(size, tag);
+    return ptr;
+}
+
+void* gm_malloc(size_t size, gm_tag tag) {
+    assert(GM);
+    assert(GM->mspace_ptr);
+    return gm_place_block(gm_tag_block(gm_raw_malloc(size + GM_TRL_BYTES), size, tag), size);
+}
+
+void* __gm_calloc(size_t num, size_t size, gm_tag tag) {
+    assert(GM);
+    assert(GM->mspace_ptr);
+    if (size && num > (SIZE_MAX - GM_TRL_BYTES)/size) panic("gm_calloc(): %ld x %ld bytes overflows", num, size);
+    return gm_place_block(gm_tag_block(gm_raw_calloc(num*size + GM_TRL_BYTES), num*size, tag), num*size);
+}
+
+void* __gm_memalign(size_t blocksize, size_t bytes, gm_tag tag) {
+    assert(GM);
+    assert(GM->mspace_ptr);
+    void* ptr = gm_raw_memalign(blocksize, bytes);
+    gm_charge_tag(bytes, tag);
+    return gm_place_block(ptr, bytes);
+}
+
+void* gm_malloc(size_t size) {return gm_malloc(size, gm_defaultTag);}
+void* __gm_calloc(size_t num, size_t size) {return __gm_calloc(num, size, gm_defaultTag);}
+void* __gm_memalign(size_t blocksize, size_t bytes) {return __gm_memalign(blocksize, bytes, gm_defaultTag);}
 
 void gm_free(void* ptr) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    mspace_free(GM->mspace_ptr, ptr);
-    futex_unlock(&GM->lock);
+    if (!ptr) return;
+    gm_sync();
+    gm_block_trl* trl = gm_trailer(ptr);
+    assert(trl->tag < GM_TAGS);
+    __sync_fetch_and_sub(&GM->tagCounters[trl->tag].bytes, trl->size);
+    gm_raw_free(ptr);
+}
+
+void gm_free_aligned(void* ptr, size_t bytes, gm_tag tag) {
+    assert(GM);
+    assert(GM->mspace_ptr);
+    assert(tag < GM_TAGS);
+    if (!ptr) return;
+    gm_sync();
+    assert(mspace_usable_size(ptr) >= bytes);
+    __sync_fetch_and_sub(&GM->tagCounters[tag].bytes, bytes);
+    gm_raw_free(ptr);
+}
+
+void gm_get_alloc_stats(gm_alloc_stats* stats) {
+    assert(GM);
+    stats->lockAcquires = GM->lockAcquires;
+    stats->mspaceAllocs = GM->mspaceAllocs;
+    stats->mspaceFrees = GM->mspaceFrees;
+    stats->heapBytes = GM->size;
+    stats->segments = GM->numSegments;
+    stats->cachedAllocs = stats->cachedFrees = 0;
+    for (uint32_t t = 0; t < GM_TAGS; t++) {
+        stats->tagBytes[t] = MAX(GM->tagCounters[t].bytes, 0l);
+        stats->tagPeakBytes[t] = GM->tagCounters[t].peakBytes;
+        stats->tagAllocs[t] = GM->tagCounters[t].allocs;
+    }
+    gm_cache* caches = GM->caches;
+    if (caches) {
+        for (uint32_t i = 0; i < GM->numCaches; i++) {
+            stats->cachedAllocs += caches[i].allocs;
+            stats->cachedFrees += caches[i].frees;
+        }
+    }
 }
 
 
@@ -193,9 +828,25 @@ void* gm_get_secondary_ptr() {
     return const_cast<void*>(GM->secondary_regp);  // devolatilize
 }
 
+void gm_set_lock_prof_ptr(void* ptr) {
+    assert(GM);
+    assert(GM->lockprof_regp == nullptr);
+    GM->lockprof_regp = ptr;
+}
+
+void* gm_get_lock_prof_ptr() {
+    assert(GM);
+    return const_cast<void*>(GM->lockprof_regp);  // devolatilize; nullptr until set
+}
+
 void gm_stats() {
     assert(GM);
     mspace_malloc_stats(GM->mspace_ptr);
+    fprintf(stderr, "%10s %14s %14s %12s\n", "tag", "bytes", "peak bytes", "allocs");
+    for (uint32_t t = 0; t < GM_TAGS; t++) {
+        gm_tag_counters& c = GM->tagCounters[t];
+        fprintf(stderr, "%10s %14ld %14ld %12ld\n", gm_tagNames[t], c.bytes, c.peakBytes, c.allocs);
+    }
 }
 
 bool gm_isready() {
@@ -205,7 +856,10 @@ bool gm_isready() {
 
 void gm_detach() {
     assert(GM);
+    for (uint32_t i = gm_mappedSegments; i > 1; i--) shmdt(GM->segments[i-1].base);
     shmdt(GM);
+    munmap(const_cast<void*>(GM_BASE_ADDR), gm_reservedBytes);
+    gm_mappedSegments = 0;
     GM = nullptr;
     gm_shmid = 0;
 }
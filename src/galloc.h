@@ -26,27 +26,103 @@
 #ifndef GALLOC_H_
 #define GALLOC_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-int gm_init(size_t segmentSize);
+enum gm_page_mode {GM_PAGES_DEFAULT, GM_PAGES_HUGETLB, GM_PAGES_THP};
+enum gm_numa_mode {GM_NUMA_DEFAULT, GM_NUMA_INTERLEAVE, GM_NUMA_BIND};
+
+// nodeMask is a bitmask of NUMA nodes, used for interleave and bind. The heap grows by adding segments of at least
+// segmentSize, up to maxBytes (0 = a default bound); every process reserves maxBytes of address space, capped to half
+// of RLIMIT_AS
+int gm_init(size_t segmentSize, gm_page_mode pages = GM_PAGES_DEFAULT, gm_numa_mode numa = GM_NUMA_DEFAULT, uint64_t nodeMask = 0,
+        size_t maxBytes = 0);
+
+// Small-object caches are on by default; disabling them must happen right after gm_init
+void gm_set_caching(bool enable);
 
 void gm_attach(int shmid);
 
+// Maps segments other processes have added. gm_* calls do this on their own; use it before touching heap data
+// without allocating, in processes that can't use gm_handle_fault()
+void gm_map_new_segments();
+
+// Waits until another process adds a segment (or timeoutMs pass) and maps it. Segments die with the last process
+// that maps them, so if other processes grow the heap, the process that called gm_init must keep a thread looping on
+// this; gm_* calls that grow the heap wait for it
+void gm_wait_new_segments(uint32_t timeoutMs);
+
+// Call on a segfault at addr. Returns true if addr was in a heap segment this process had not mapped yet, which is
+// now mapped, so the faulting access can be retried
+bool gm_handle_fault(const void* addr);
+
+/* Allocation tags, to account heap usage per component (see gm_alloc_stats). Allocations without an explicit tag
+ * get the process's default tag, which init code sets with GMTagScope while it builds each component. The default
+ * is per process, not per thread, so only change it from single-threaded code.
+ */
+enum gm_tag {
+    GM_TAG_OTHER,
+    GM_TAG_CACHES,     // tag arrays, replacement state
+    GM_TAG_COHERENCE,  // coherence state and directories
+    GM_TAG_CORES,
+    GM_TAG_MEM,        // memory controllers
+    GM_TAG_EVENTS,     // weave-phase events and contention simulation
+    GM_TAG_STATS,      // stats and their backends
+    GM_TAG_TRACE,      // trace buffers
+    GM_TAGS
+};
+
+const char* gm_tag_name(gm_tag tag);
+gm_tag gm_set_default_tag(gm_tag tag);  // returns the previous one
+
+class GMTagScope {
+    private:
+        gm_tag prev;
+    public:
+        explicit GMTagScope(gm_tag tag) : prev(gm_set_default_tag(tag)) {}
+        ~GMTagScope() {gm_set_default_tag(prev);}
+};
+
+/* NUMA placement of individual allocations. gm_place() asks for the pages fully inside [ptr, ptr+size) to come from
+ * node, and moves the ones already faulted in; it's best-effort, and ignored if the heap can't honor it. Like the default
+ * tag, the default node is per process: while it is set (with GMNodeScope), allocations of at least
+ * GM_PLACE_MIN_BYTES are placed on it. -1 means no preference (the heap's policy applies).
+ */
+#define GM_PLACE_MIN_BYTES (64*1024)
+void gm_place(void* ptr, size_t size, int node);
+int gm_set_default_node(int node);  // returns the previous one
+
+class GMNodeScope {
+    private:
+        int prev;
+    public:
+        explicit GMNodeScope(int node) : prev(gm_set_default_node(node)) {}
+        ~GMNodeScope() {gm_set_default_node(prev);}
+};
+
 // C-style interface
 void* gm_malloc(size_t size);
+void* gm_malloc(size_t size, gm_tag tag);
 void* __gm_calloc(size_t num, size_t size);  //deprecated, only used internally
+void* __gm_calloc(size_t num, size_t size, gm_tag tag);
 void* __gm_memalign(size_t blocksize, size_t bytes);  // deprecated, only used internally
+void* __gm_memalign(size_t blocksize, size_t bytes, gm_tag tag);
 char* gm_strdup(const char* str);
 void gm_free(void* ptr);
+// Aligned blocks carry no size/tag trailer (it would push large aligned blocks past their alignment), so they are
+// freed with the size and tag they were allocated with; never with gm_free
+void gm_free_aligned(void* ptr, size_t bytes, gm_tag tag);
 
 // C++-style alloc interface (preferred)
 template <typename T> T* gm_malloc() {return static_cast<T*>(gm_malloc(sizeof(T)));}
 template <typename T> T* gm_malloc(size_t objs) {return static_cast<T*>(gm_malloc(sizeof(T)*objs));}
 template <typename T> T* gm_calloc() {return static_cast<T*>(__gm_calloc(1, sizeof(T)));}
 template <typename T> T* gm_calloc(size_t objs) {return static_cast<T*>(__gm_calloc(objs, sizeof(T)));}
+template <typename T> T* gm_calloc(size_t objs, gm_tag tag) {return static_cast<T*>(__gm_calloc(objs, sizeof(T), tag));}
 template <typename T> T* gm_memalign(size_t blocksize) {return static_cast<T*>(__gm_memalign(blocksize, sizeof(T)));}
 template <typename T> T* gm_memalign(size_t blocksize, size_t objs) {return static_cast<T*>(__gm_memalign(blocksize, sizeof(T)*objs));}
+template <typename T> T* gm_memalign(size_t blocksize, size_t objs, gm_tag tag) {return static_cast<T*>(__gm_memalign(blocksize, sizeof(T)*objs, tag));}
 template <typename T> T* gm_dup(T* src, size_t objs) {
     T* dst = gm_malloc<T>(objs);
     memcpy(dst, src, sizeof(T)*objs);
@@ -59,8 +135,24 @@ void* gm_get_glob_ptr();
 void gm_set_secondary_ptr(void* ptr);
 void* gm_get_secondary_ptr();
 
+void gm_set_lock_prof_ptr(void* ptr);
+void* gm_get_lock_prof_ptr();
+
 void gm_stats();
 
+// Logs the page size, huge page coverage and NUMA policy the segment actually got
+void gm_report_backing();
+
+// Allocation counters, to see how much traffic goes through the global lock
+struct gm_alloc_stats {
+    uint64_t lockAcquires;  // of the global heap lock
+    uint64_t mspaceAllocs, mspaceFrees;  // calls into the underlying allocator (some batched)
+    uint64_t cachedAllocs, cachedFrees;  // served by the small-object caches, without the global lock
+    uint64_t heapBytes, segments;  // committed so far; grows on demand
+    uint64_t tagBytes[GM_TAGS], tagPeakBytes[GM_TAGS], tagAllocs[GM_TAGS];  // live, high-water mark, and total allocs
+};
+void gm_get_alloc_stats(gm_alloc_stats* stats);
+
 bool gm_isready();
 void gm_detach();
 
@@ -73,6 +165,11 @@ class GlobAlloc {
             return gm_malloc(sz);
         }
 
+        //Tagged new, e.g., new (GM_TAG_CACHES) Foo(...)
+        inline void* operator new (size_t sz, gm_tag tag) {
+            return gm_malloc(sz, tag);
+        }
+
         //Placement new
         inline void* operator new (size_t sz, void* ptr) {
             return ptr;
@@ -84,6 +181,7 @@ class GlobAlloc {
 
         //Placement delete... make ICC happy. This would only fire on an exception
         void operator delete (void* p, void* ptr) {}
+        void operator delete (void* p, gm_tag tag) {gm_free(p);}
 };
 
 #endif  // GALLOC_H_
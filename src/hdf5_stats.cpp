@@ -40,22 +40,39 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include "access_tracing.h"
+#include "g_std/g_vector.h"
 #include "galloc.h"
+#include "locks.h"
 #include "log.h"
+#include "pin.H"
+#include "profile_stats.h"
 #include "stats.h"
+#include "stats_gather.h"
+#include "stats_writer.h"
 #include "zsim.h"
 
+#if H5_VERSION_GE(1, 10, 0)
+#define HDF5_SWMR_WRITE H5F_ACC_SWMR_WRITE
+#else
+#define HDF5_SWMR_WRITE 0
+#endif
+
 /** Implements the HDF5 backend. Creates one big table in the file, and writes one row per dump.
- * NOTE: Because dump may be called from multiple processes, we close and open the HDF5 file every dump.
- * This is inefficient, but dumps are not that common anyhow, and we get the ability to read hdf5 files mid-simulation.
- * (alternatively, we could have an extra thread exclusively dedicated to writing stats).
+ * NOTE: Dump may be called from multiple processes. By default, the backend hands filled record buffers to the
+ * stats writer thread (see stats_writer.h), which keeps the file open and flushes it periodically. Without
+ * the writer thread, we close and open the HDF5 file every time we write, which is slow but simple.
  */
-class HDF5BackendImpl : public GlobAlloc {
+
+#define HDF5_STATS_BUFS 4 //buffers per backend; dumps only block if the writer falls this far behind
+
+class HDF5BackendImpl : public GlobAlloc, public StatsWriterClient {
     private:
         const char* filename;
         AggregateStat* rootStat;
         bool skipVectors;
         bool sumRegularAggregates;
+        StatGatherPlan* plan; //gathers a record from the stats tree
 
         uint64_t* dataBuf; //buffered record data
         uint64_t* curPtr; //points to next element to write in dump
@@ -64,46 +81,31 @@ class HDF5BackendImpl : public GlobAlloc {
 
         uint32_t bufferedRecords; //number of records buffered (dumped w/o being written), <= recordsPerWrite
 
+        /* With the writer thread, dataBuf is one of a ring of buffers. Dumps are serialized (they happen at the end of
+         * a phase or of the simulation), so the ring has a single producer at a time and a single consumer, the
+         * writer, and needs no locks: the producer fills bufs[tail % HDF5_STATS_BUFS] and publishes it by
+         * incrementing tail; the writer appends bufs[head % HDF5_STATS_BUFS] and frees it by incrementing head.
+         */
+        StatsWriter* writer;
+        uint64_t* bufs[HDF5_STATS_BUFS];
+        uint32_t bufRecords[HDF5_STATS_BUFS];
+        volatile uint64_t head;
+        volatile uint64_t tail;
+        volatile uint64_t syncReq; //unbuffered dumps ask the writer to write, flush and close up to this tail...
+        volatile uint64_t syncAck; //...and wait until it does
+        bool stalled; //producer waited for a free buffer at least once
+
+        //Writer-side state, only touched by the writer thread
+        hid_t fileID; //-1 if closed
+        bool dirty; //written since last flush
+        uint64_t lastFlushNs;
+
+
         // Always have a single function to determine when to skip a stat to avoid inconsistencies in the code
         bool skipStat(Stat* s) {
             return skipVectors && dynamic_cast<VectorStat*>(s);
         }
 
-        // Dump the stats, inorder walk
-        void dumpWalk(Stat* s) {
-            if (skipStat(s)) return;
-            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                if (as->isRegular() && sumRegularAggregates) {
-                    //Dump first record
-                    uint64_t* startPtr = curPtr;
-                    dumpWalk(as->get(0));
-                    uint64_t* tmpPtr = curPtr;
-                    uint32_t sz = tmpPtr - startPtr;
-                    //Dump others below, and add them up
-                    for (uint32_t i = 1; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                        //Add record with previous ones
-                        assert(curPtr == tmpPtr + sz);
-                        for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
-                        //Rewind
-                        curPtr = tmpPtr;
-                    }
-                } else {
-                    for (uint32_t i = 0; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                    }
-                }
-            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *(curPtr++) = ss->get();
-            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                for (uint32_t i = 0; i < vs->size(); i++) {
-                    *(curPtr++) = vs->count(i);
-                }
-            } else {
-                panic("Unrecognized stat type");
-            }
-        }
-
         //Note this is a local vector, b/c it's only used at initialization.
         std::vector<hid_t> uniqueTypes;
 
@@ -200,12 +202,16 @@ class HDF5BackendImpl : public GlobAlloc {
         }
 
     public:
-        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates) :
-            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
+        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates, StatsWriter* _writer) :
+            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates), writer(_writer)
         {
+            scoped_mutex sm(hdf5Lock); //the writer thread may be running
+
             // Create stats file
             info("HDF5 backend: Opening %s", filename);
-            hid_t fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            hid_t fapl = fileAccessPlist();
+            hid_t fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+            H5Pclose(fapl);
 
             hid_t rootType = getH5Type(rootStat);
 
@@ -224,14 +230,28 @@ class HDF5BackendImpl : public GlobAlloc {
                     nullptr, 9 /*compression*/, nullptr);
             assert(hErrVal == 0);
 
+            plan = new StatGatherPlan(rootStat, skipVectors, sumRegularAggregates);
+            assert_msg(plan->size()*sizeof(uint64_t) == recordSize, "HDF5 (%s): gather plan has %d words, record has %ld bytes", filename, plan->size(), recordSize);
+
             size_t bufSize = recordsPerWrite*recordSize;
-            if (sumRegularAggregates) bufSize += recordSize; //conservatively add space for a record. See dumpWalk(), we bleed into the buffer a bit when dumping a regular aggregate.
-            dataBuf = static_cast<uint64_t*>(gm_malloc(bufSize));
+            uint32_t numBufs = writer? HDF5_STATS_BUFS : 1;
+            for (uint32_t i = 0; i < HDF5_STATS_BUFS; i++) {
+                bufs[i] = (i < numBufs)? static_cast<uint64_t*>(gm_malloc(bufSize, GM_TAG_STATS)) : nullptr;
+                bufRecords[i] = 0;
+            }
+            head = tail = 0;
+            syncReq = syncAck = 0;
+            stalled = false;
+            this->fileID = -1;
+            dirty = false;
+            lastFlushNs = 0;
+
+            dataBuf = bufs[0];
             curPtr = dataBuf;
 
             bufferedRecords = 0;
 
-            info("HDF5 backend: Created table, %ld bytes/record, %d records/write", recordSize, recordsPerWrite);
+            info("HDF5 backend: Created table, %ld bytes/record, %d records/write%s", recordSize, recordsPerWrite, writer? ", writer thread" : "");
             H5Fclose(fileID);
         }
 
@@ -239,33 +259,119 @@ class HDF5BackendImpl : public GlobAlloc {
 
         void dump(bool buffered) {
             // Copy stats to data buffer
-            dumpWalk(rootStat);
+            plan->gather(curPtr);
+            curPtr += plan->size();
             bufferedRecords++;
 
             assert_msg(dataBuf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, dataBuf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
 
             // Write to table if needed
             if (bufferedRecords == recordsPerWrite || !buffered) {
-                hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+                if (writer) {
+                    publish(!buffered);
+                } else {
+                    scoped_mutex sm(hdf5Lock);
+                    hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
 
-                size_t fieldOffsets[] = {0};
-                size_t fieldSizes[] = {recordSize};
-                H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
-                H5Fclose(fileID);
+                    size_t fieldOffsets[] = {0};
+                    size_t fieldSizes[] = {recordSize};
+                    H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
+                    H5Fclose(fileID);
+                }
 
                 //Rewind
                 bufferedRecords = 0;
                 curPtr = dataBuf;
             }
         }
+
+        /* Called by the writer thread: appends all published buffers, and flushes the file if it has unflushed
+         * data older than flushIntervalNs. Returns after an unbuffered dump with the file closed.
+         */
+        void write(uint64_t curNs, uint64_t flushIntervalNs) {
+            uint64_t sync = syncReq;
+            __sync_synchronize();
+            uint64_t t = tail; //>= sync
+            if (head == t && sync == syncAck && !(dirty && curNs - lastFlushNs >= flushIntervalNs)) return;
+
+            scoped_mutex sm(hdf5Lock);
+            size_t fieldOffsets[] = {0};
+            size_t fieldSizes[] = {recordSize};
+            while (head < t) {
+                if (fileID < 0) {
+                    hid_t fapl = fileAccessPlist();
+                    fileID = H5Fopen(filename, H5F_ACC_RDWR | HDF5_SWMR_WRITE, fapl);
+                    H5Pclose(fapl);
+                    if (fileID < 0) panic("HDF5 (%s): Could not open stats file", filename);
+                }
+                uint32_t slot = head % HDF5_STATS_BUFS;
+                H5TBappend_records(fileID, "stats", bufRecords[slot], recordSize, fieldOffsets, fieldSizes, bufs[slot]);
+                dirty = true;
+                __sync_synchronize(); //done with the buffer before freeing it
+                head = head + 1;
+            }
+
+            if (sync != syncAck) {
+                //Unbuffered dump, likely the last one: close the file so that it is complete if we exit
+                if (fileID >= 0) H5Fclose(fileID);
+                fileID = -1;
+                dirty = false;
+                lastFlushNs = curNs;
+                __sync_synchronize();
+                syncAck = sync;
+            } else if (dirty && curNs - lastFlushNs >= flushIntervalNs) {
+                H5Fflush(fileID, H5F_SCOPE_LOCAL);
+                dirty = false;
+                lastFlushNs = curNs;
+            }
+        }
+
+    private:
+        //Hands dataBuf to the writer, and grabs the next buffer. Waits for the writer if all buffers are taken.
+        void publish(bool sync) {
+            bufRecords[tail % HDF5_STATS_BUFS] = bufferedRecords;
+            __sync_synchronize(); //buffer contents must be visible before tail
+            tail = tail + 1;
+            if (sync) syncReq = tail;
+            writer->wake();
+
+            if (sync) {
+                while (syncAck != tail) usleep(1000);
+            }
+
+            if (tail - head == HDF5_STATS_BUFS) {
+                if (!stalled) warn("HDF5 (%s): Stats writer thread is falling behind, dumps will wait for it", filename);
+                stalled = true;
+                while (tail - head == HDF5_STATS_BUFS) usleep(100);
+            }
+            dataBuf = bufs[tail % HDF5_STATS_BUFS];
+        }
+
+        //With the writer thread, files are kept open and written in SWMR mode, so they can be read mid-simulation
+        hid_t fileAccessPlist() {
+            hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+#if H5_VERSION_GE(1, 10, 0)
+            if (writer) H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST); //required by SWMR
+#endif
+            return fapl;
+        }
 };
 
 
+void HDF5Backend::startWriterThread(uint32_t flushIntervalSecs) {
+    StatsWriter*& writer = StatsWriter::instance();  //only set in the process that creates stats backends
+    assert(!writer);
+    writer = new StatsWriter(flushIntervalSecs);
+    info("Stats writer: Started writer thread, flushing every %d s", flushIntervalSecs);
+    PIN_SpawnInternalThread(StatsWriter::WriterThread, writer, 1024*1024, nullptr);
+}
+
 HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates) {
-    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates);
+    StatsWriter* writer = StatsWriter::instance();
+    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates, writer);
+    if (writer) writer->registerClient(backend);
 }
 
 void HDF5Backend::dump(bool buffered) {
     backend->dump(buffered);
 }
-
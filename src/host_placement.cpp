@@ -0,0 +1,193 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_placement.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fstream>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bithacks.h"
+#include "log.h"
+
+// Parses the kernel's CPU list format (e.g., "0-3,8,10-11")
+static std::vector<uint32_t> ParseCpuList(const std::string& str) {
+    std::vector<uint32_t> cpus;
+    const char* s = str.c_str();
+    while (*s) {
+        while (*s == ',' || *s == ' ' || *s == '\n') s++;
+        if (!*s) break;
+        char* end;
+        uint32_t first = strtoul(s, &end, 10);
+        if (end == s) panic("Invalid CPU list '%s'", str.c_str());
+        uint32_t last = first;
+        s = end;
+        if (*s == '-') {
+            last = strtoul(s + 1, &end, 10);
+            if (end == s + 1 || last < first) panic("Invalid CPU list '%s'", str.c_str());
+            s = end;
+        }
+        for (uint32_t c = first; c <= last; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+HostPlacement::Mode HostPlacement::parseMode(const std::string& str) {
+    if (str == "none") return NONE;
+    if (str == "node") return NODE;
+    if (str == "core") return CORE;
+    panic("Invalid host placement mode %s, must be none, node, or core", str.c_str());
+}
+
+HostPlacement::HostPlacement(Mode _mode, const std::string& cpuList, uint32_t _numCores, uint32_t coresPerGroup)
+    : mode(_mode), numCores(_numCores)
+{
+    assert(mode != NONE && numCores > 0 && coresPerGroup > 0);
+
+    // Usable CPUs: the ones we may run on, optionally restricted by cpuList
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) panic("sched_getaffinity failed (%s)", strerror(errno));
+    if (!cpuList.empty()) {
+        cpu_set_t listed;
+        CPU_ZERO(&listed);
+        for (uint32_t c : ParseCpuList(cpuList)) if (c < CPU_SETSIZE) CPU_SET(c, &listed);
+        CPU_AND(&allowed, &allowed, &listed);
+    }
+    if (CPU_COUNT(&allowed) == 0) panic("Host placement: no usable host CPUs (sim.hostCpus = '%s')", cpuList.c_str());
+
+    // NUMA nodes, from sysfs; machines without NUMA support have a single node
+    std::vector<uint32_t> nodes;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent* de;
+        while ((de = readdir(dir))) {
+            uint32_t node;
+            char tail;
+            if (sscanf(de->d_name, "node%u%c", &node, &tail) == 1) nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    for (uint32_t node : nodes) {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string line;
+        std::getline(f, line);
+        g_vector<uint32_t> cpus;
+        for (uint32_t c : ParseCpuList(line)) {
+            if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) {
+                cpus.push_back(c);
+                CPU_CLR(c, &allowed);
+            }
+        }
+        if (cpus.empty()) continue;
+        nodeCpus.push_back(cpus);
+        nodeIds.push_back(node);
+    }
+    if (CPU_COUNT(&allowed)) {  // no NUMA info, or CPUs missing from it; keep them in a node of their own
+        g_vector<uint32_t> cpus;
+        for (uint32_t c = 0; c < CPU_SETSIZE; c++) if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        if (nodeCpus.empty()) {
+            nodeCpus.push_back(cpus);
+            nodeIds.push_back(0);
+        } else {
+            nodeCpus[0].insert(nodeCpus[0].end(), cpus.begin(), cpus.end());
+        }
+    }
+
+    // Split the core groups among nodes in proportion to their CPUs, placing each group where its middle falls
+    uint32_t totalCpus = 0;
+    for (auto& cpus : nodeCpus) totalCpus += cpus.size();
+    uint32_t numGroups = (numCores + coresPerGroup - 1)/coresPerGroup;
+    coreNode.resize(numCores);
+    coreCpu.resize(numCores);
+    g_vector<uint32_t> nodeCores(nodeCpus.size(), 0);
+    for (uint32_t g = 0; g < numGroups; g++) {
+        uint64_t pos = (2*g + 1)*(uint64_t)totalCpus/(2*numGroups);  // in [0, totalCpus)
+        uint32_t n = 0;
+        while (pos >= nodeCpus[n].size()) pos -= nodeCpus[n++].size();
+        for (uint32_t cid = g*coresPerGroup; cid < MIN((g+1)*coresPerGroup, numCores); cid++) {
+            coreNode[cid] = n;
+            coreCpu[cid] = nodeCpus[n][nodeCores[n]++ % nodeCpus[n].size()];
+        }
+    }
+
+    info("Host placement: %s pinning of %d cores (groups of %d) over %d usable CPUs in %ld nodes",
+            (mode == NODE)? "node" : "core", numCores, coresPerGroup, totalCpus, nodeCpus.size());
+    for (uint32_t n = 0; n < nodeCpus.size(); n++) {
+        uint32_t first = numCores, last = 0;
+        for (uint32_t cid = 0; cid < numCores; cid++) {
+            if (coreNode[cid] == n) {
+                first = MIN(first, cid);
+                last = cid;
+            }
+        }
+        if (first < numCores) {
+            info(" node %d: %ld CPUs, cores %d-%d", nodeIds[n], nodeCpus[n].size(), first, last);
+        } else {
+            info(" node %d: %ld CPUs, no cores", nodeIds[n], nodeCpus[n].size());
+        }
+    }
+}
+
+void HostPlacement::pin(uint32_t cid, const char* what, uint32_t idx) const {
+    assert(cid < numCores);
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (mode == CORE) {
+        CPU_SET(coreCpu[cid], &cpuset);
+    } else {
+        for (uint32_t c : nodeCpus[coreNode[cid]]) CPU_SET(c, &cpuset);
+    }
+    // 0 is the calling thread, not the process
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+        warn("Host placement: could not pin %s %d (%s)", what, idx, strerror(errno));
+    }
+}
+
+void HostPlacement::pinThread(uint32_t cid) const {
+    pin(cid, "thread for core", cid);
+}
+
+void HostPlacement::noteDomain(uint32_t domain, uint32_t cid) {
+    assert(cid < numCores);
+    if (domain >= domainCore.size()) domainCore.resize(domain + 1, -1);
+    if (domainCore[domain] == -1) domainCore[domain] = cid;
+}
+
+void HostPlacement::pinWeaveThread(uint32_t thid, uint32_t firstDomain, uint32_t supDomain, uint32_t numDomains) const {
+    assert(firstDomain < supDomain && supDomain <= numDomains);
+    for (uint32_t d = firstDomain; d < MIN(supDomain, (uint32_t)domainCore.size()); d++) {
+        if (domainCore[d] >= 0) {
+            pin(domainCore[d], "weave thread", thid);
+            return;
+        }
+    }
+    pin(firstDomain*numCores/numDomains, "weave thread", thid);  // only shared components (or none) in these domains
+}
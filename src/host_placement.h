@@ -0,0 +1,78 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_PLACEMENT_H_
+#define HOST_PLACEMENT_H_
+
+#include <stdint.h>
+#include <string>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+
+/* Placement of simulation threads and per-core structures on the host.
+ *
+ * Simulated cores are split into contiguous blocks, one per host NUMA node, sized by how many usable host CPUs each
+ * node has. Blocks never split a group of cores that share a cache (the group size is given at construction), so
+ * e.g. cores sharing an L2 stay on one socket. Bound-phase threads are pinned when they get a core, and weave
+ * threads to the host placement of the first core noted in their domains (init notes the core each weave component
+ * belongs to, so this follows the domain map), or of an even share of cores if their domains have none:
+ * - NODE: pin to all the usable CPUs of the core's node, and let the kernel balance within the node.
+ * - CORE: pin to a single CPU; cores of a node are spread round-robin over the node's CPUs.
+ * getNode() also lets init code put each core's private structures on its node (see GMNodeScope).
+ */
+class HostPlacement : public GlobAlloc {
+    public:
+        enum Mode {NONE, NODE, CORE};
+
+    private:
+        Mode mode;
+        uint32_t numCores;
+        g_vector< g_vector<uint32_t> > nodeCpus;  // usable host CPUs of each node with any
+        g_vector<uint32_t> nodeIds;  // host node id of each entry in nodeCpus
+        g_vector<uint32_t> coreNode;  // index into nodeCpus
+        g_vector<uint32_t> coreCpu;
+        g_vector<int32_t> domainCore;  // first core noted in each weave domain, or -1
+
+    public:
+        // cpuList restricts the usable host CPUs (e.g., "0-7,16-23"; empty means all CPUs we are allowed to run on)
+        HostPlacement(Mode _mode, const std::string& cpuList, uint32_t _numCores, uint32_t coresPerGroup);
+
+        static Mode parseMode(const std::string& str);
+
+        // Host NUMA node of the core, for memory placement
+        int getNode(uint32_t cid) const { return nodeIds[coreNode[cid]]; }
+
+        // Record that a weave component of this domain belongs to (or is private to the cores starting at) cid
+        void noteDomain(uint32_t domain, uint32_t cid);
+
+        // Pin the calling thread
+        void pinThread(uint32_t cid) const;
+        void pinWeaveThread(uint32_t thid, uint32_t firstDomain, uint32_t supDomain, uint32_t numDomains) const;
+
+    private:
+        void pin(uint32_t cid, const char* what, uint32_t idx) const;
+};
+
+#endif  // HOST_PLACEMENT_H_
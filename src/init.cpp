@@ -25,6 +25,7 @@
  */
 
 #include "init.h"
+#include <functional>
 #include <list>
 #include <sstream>
 #include <stdlib.h>
@@ -39,6 +40,7 @@
 #include "core.h"
 #include "detailed_mem.h"
 #include "detailed_mem_params.h"
+#include "domain_profiler.h"
 #include "ddr_mem.h"
 #include "debug_zsim.h"
 #include "dramsim_mem_ctrl.h"
@@ -46,13 +48,18 @@
 #include "filter_cache.h"
 #include "galloc.h"
 #include "hash.h"
+#include "host_placement.h"
 #include "ideal_arrays.h"
+#include "live_stats.h"
+#include "pc_miss_table.h"
+#include "pc_profiler.h"
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
+#include "opt_repl_policy.h"
 #include "part_repl_policies.h"
 #include "pin_cmd.h"
 #include "prefetcher.h"
@@ -62,7 +69,9 @@
 #include "profile_stats.h"
 #include "repl_policies.h"
 #include "scheduler.h"
+#include "self_prof.h"
 #include "simple_core.h"
+#include "stack_distance.h"
 #include "stats.h"
 #include "stats_filter.h"
 #include "str.h"
@@ -77,12 +86,14 @@
 
 extern void EndOfPhaseActions(); //in zsim.cpp
 
+static bool usesOPT = false; //set if any cache uses OPT replacement, which needs the trace's next-use index
+
 /* zsim should be initialized in a deterministic and logical order, to avoid re-reading config vars
  * all over the place and give a predictable global state to constructors. Ideally, this should just
  * follow the layout of zinfo, top-down.
  */
 
-BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain) {
+BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain, StackDistanceProfiler* sdProf) {
     string type = config.get<const char*>(prefix + "type", "Simple");
     // Shortcut for TraceDriven type
     if (type == "TraceDriven") {
@@ -164,6 +175,10 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         rp = new NRUReplPolicy(numLines, candidates);
     } else if (replType == "Rand") {
         rp = new RandReplPolicy(candidates);
+    } else if (replType == "OPT") {
+        if (!zinfo->traceDriven) panic("%s: OPT replacement requires trace-driven simulation", name.c_str());
+        rp = new OPTReplPolicy(numLines);
+        usesOPT = true;
     } else if (replType == "WayPart" || replType == "Vantage" || replType == "IdealLRUPart") {
         if (replType == "WayPart" && arrayType != "SetAssoc") panic("WayPart replacement requires SetAssoc array");
 
@@ -275,7 +290,12 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             uint32_t mshrs = config.get<uint32_t>(prefix + "mshrs", 16);
             uint32_t tagLat = config.get<uint32_t>(prefix + "tagLat", 5);
             uint32_t timingCandidates = config.get<uint32_t>(prefix + "timingCandidates", candidates);
-            cache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, tagLat, ways, timingCandidates, domain, name);
+            TimingCache* tcache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, tagLat, ways, timingCandidates, domain, name);
+            //Below this load (tag lookups/cycle), estimate contention analytically instead of simulating it; 0 always simulates
+            tcache->setAnalyticalLoad(config.get<double>(prefix + "analyticalLoad", 0.0));
+            //Latency histograms and hybrid mode stats; off by default, as they add ~200 counters per bank
+            tcache->setDetailedStats(config.get<bool>(prefix + "detailedStats", false));
+            cache = tcache;
         } else if (type == "Tracing") {
             g_string traceFile = config.get<const char*>(prefix + "traceFile","");
             if (traceFile.empty()) traceFile = g_string(zinfo->outputDir) + "/" + name + ".trace";
@@ -290,6 +310,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name);
     }
 
+    // Optional LRU stack distance profile, shared by all the banks of this cache (see BuildCacheGroup)
+    if (sdProf) cache->setStackDistanceProfiler(sdProf);
+
+    // Optional table of the PCs that miss the most in this bank (needs cores that track PCs, i.e., not trace-driven)
+    if (config.get<bool>(prefix + "missPCs.enable", false)) {
+        uint32_t entries = config.get<uint32_t>(prefix + "missPCs.entries", 64);
+        if (entries == 0) panic("%s: missPCs.entries must be > 0", name.c_str());
+        cache->setPCMissTable(new PCMissTable(entries));
+    }
+
 #if 0
     info("Built L%d bank, %d bytes, %d lines, %d ways (%d candidates if array is Z), %s array, %s hash, %s replacement, accLat %d, invLat %d name %s",
             level, bankSize, numLines, ways, candidates, arrayType.c_str(), hashType.c_str(), replType.c_str(), accLat, invLat, name.c_str());
@@ -320,10 +350,12 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
 
     auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
             addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
+    mem->setDetailedStats(config.get<bool>(prefix + "detailedStats", false));  // latency histograms
     return mem;
 }
 
 MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name) {
+    GMTagScope tagScope(GM_TAG_MEM);
     //Type
     string type = config.get<const char*>("sys.mem.type", "Simple");
 
@@ -341,11 +373,15 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         // Peak bandwidth (in MB/s)
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
 
-        mem = new MD1Memory(lineSize, frequency, bandwidth, latency, name);
+        MD1Memory* md1 = new MD1Memory(lineSize, frequency, bandwidth, latency, name);
+        md1->setDetailedStats(config.get<bool>("sys.mem.detailedStats", false));  // latency histograms
+        mem = md1;
     } else if (type == "WeaveMD1") {
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
         uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", latency);
-        mem = new WeaveMD1Memory(lineSize, frequency, bandwidth, latency, boundLatency, domain, name);
+        WeaveMD1Memory* md1 = new WeaveMD1Memory(lineSize, frequency, bandwidth, latency, boundLatency, domain, name);
+        md1->setDetailedStats(config.get<bool>("sys.mem.detailedStats", false));
+        mem = md1;
     } else if (type == "WeaveSimple") {
         uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", 100);
         mem = new WeaveSimpleMemory(latency, boundLatency, domain, name);
@@ -371,7 +407,76 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
 
 typedef vector<vector<BaseCache*>> CacheGroup;
 
+/* Weave domains (see domain_profiler.h). Cores, cache banks and memory controllers that simulate contention are
+ * weave components; others take a domain too, but never use it.
+ */
+
+static bool IsWeaveCacheGroup(Config& config, const string& name, bool isTerminal) {
+    string prefix = "sys.caches." + name + ".";
+    if (isTerminal || config.get<bool>(prefix + "isPrefetcher", false)) return false;
+    return config.get<const char*>(prefix + "type", "Simple") == string("Timing");
+}
+
+static bool IsWeaveMemory(Config& config) {
+    string type = config.get<const char*>("sys.mem.type", "Simple");
+    return type == "WeaveMD1" || type == "WeaveSimple" || type == "DDR" || type == "DRAMSim" || type == "Detailed";
+}
+
+// Number of weave components, i.e., of domains in a profiling run. Must match the AssignDomain calls of InitSystem.
+static uint32_t CountWeaveComponents(Config& config) {
+    uint32_t components = 0;
+    vector<const char*> cacheGroupNames;
+    config.subgroups("sys.caches", cacheGroupNames);
+    for (const char* grp : cacheGroupNames) {
+        string prefix = string("sys.caches.") + grp + ".";
+        bool isTerminal = ParseList<string>(config.get<const char*>(prefix + "children", "")).empty();
+        if (!IsWeaveCacheGroup(config, grp, isTerminal)) continue;
+        components += config.get<uint32_t>(prefix + "caches", 1) * config.get<uint32_t>(prefix + "banks", 1);
+    }
+
+    if (!zinfo->traceDriven) {
+        vector<const char*> coreGroupNames;
+        config.subgroups("sys.cores", coreGroupNames);
+        for (const char* grp : coreGroupNames) {
+            string prefix = string("sys.cores.") + grp + ".";
+            string type = config.get<const char*>(prefix + "type", "Simple");
+            if (type == "Timing" || type == "OOO") components += config.get<uint32_t>(prefix + "cores", 1);
+        }
+    }
+
+    if (IsWeaveMemory(config)) components += config.get<uint32_t>("sys.mem.controllers", 1);
+    return components;
+}
+
+// Domain of component idx (of count) of the group. Profiling runs give every weave component its own domain. Otherwise,
+// weave components take their entry in the group's domainMap list if a profiling run produced one, and groups
+// without one are split evenly among domains (or all go to domain 0 if !split).
+static uint32_t AssignDomain(Config& config, const string& group, uint32_t idx, uint32_t count, bool weave, bool split = true) {
+    uint32_t evenDomain = split? idx*zinfo->numDomains/count : 0;
+    if (!weave) return evenDomain;
+
+    string mapStr = config.get<const char*>("domainMap." + group, "");  //read even when profiling, so re-profiling with a map passes strict config checks
+    if (zinfo->domainProfiler) return zinfo->domainProfiler->addComponent(group, idx, count, split);
+    if (mapStr.empty()) return evenDomain;
+    vector<uint32_t> domainMap = ParseList<uint32_t>(mapStr);
+    if (domainMap.size() != count) {
+        panic("domainMap.%s has %ld domains, but there are %d %s components", group.c_str(), domainMap.size(), count, group.c_str());
+    }
+    if (domainMap[idx] >= zinfo->numDomains) {
+        panic("domainMap.%s: %s-%d has domain %d, but there are %d domains", group.c_str(), group.c_str(), idx, domainMap[idx], zinfo->numDomains);
+    }
+    return domainMap[idx];
+}
+
+// Host NUMA node of the cores that use cache idx of a group of caches, or -1 if there is no placement or the cache is
+// shared by all cores (see host_placement.h)
+static int CacheHostNode(uint32_t caches, uint32_t idx) {
+    if (!zinfo->hostPlacement || caches < 2 || zinfo->numCores % caches) return -1;
+    return zinfo->hostPlacement->getNode(idx*(zinfo->numCores/caches));
+}
+
 CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal) {
+    GMTagScope tagScope(GM_TAG_CACHES);
     CacheGroup* cgp = new CacheGroup;
     CacheGroup& cg = *cgp;
 
@@ -395,6 +500,8 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
     uint32_t banks = config.get<uint32_t>(prefix + "banks", 1);
     uint32_t caches = config.get<uint32_t>(prefix + "caches", 1);
 
+    bool weave = IsWeaveCacheGroup(config, name, isTerminal);
+
     uint32_t bankSize = size/banks;
     if (size % banks != 0) {
         panic("%s: banks (%d) does not divide the size (%d bytes)", name.c_str(), banks, size);
@@ -403,7 +510,22 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
     cg.resize(caches);
     for (vector<BaseCache*>& bg : cg) bg.resize(banks);
 
+    // Optional LRU stack distance profile of each cache, gives miss ratio curves for all sizes up to maxLines in one run.
+    // Banks interleave lines, so all banks of a cache feed a single profile (one curve per cache, not per bank)
+    bool sdEnable = config.get<bool>(prefix + "stackDist.enable", false);
+    uint32_t sdMaxLines = 0, sdBuckets = 0;
+    bool sdPerChild = false;
+    if (sdEnable) {
+        if (isTerminal) panic("%s: stackDist not supported on terminal caches (filter cache hits bypass the access path)", name.c_str());
+        sdMaxLines = config.get<uint32_t>(prefix + "stackDist.maxLines", 4*(size/zinfo->lineSize));
+        sdBuckets = config.get<uint32_t>(prefix + "stackDist.buckets", 64);
+        sdPerChild = config.get<bool>(prefix + "stackDist.perChild", false);
+        if (sdBuckets == 0 || sdBuckets > sdMaxLines) panic("%s: stackDist.buckets must be in [1, maxLines]", name.c_str());
+    }
+
     for (uint32_t i = 0; i < caches; i++) {
+        GMNodeScope nodeScope(CacheHostNode(caches, i));
+        StackDistanceProfiler* sdProf = sdEnable? new StackDistanceProfiler(sdMaxLines, sdBuckets, sdPerChild) : nullptr;
         for (uint32_t j = 0; j < banks; j++) {
             stringstream ss;
             ss << name << "-" << i;
@@ -411,8 +533,9 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
                 ss << "b" << j;
             }
             g_string bankName(ss.str().c_str());
-            uint32_t domain = (i*banks + j)*zinfo->numDomains/(caches*banks); //(banks > 1)? nextDomain() : (i*banks + j)*zinfo->numDomains/(caches*banks);
-            cg[i][j] = BuildCacheBank(config, prefix, bankName, bankSize, isTerminal, domain);
+            uint32_t domain = AssignDomain(config, name, i*banks + j, caches*banks, weave);
+            if (weave && CacheHostNode(caches, i) >= 0) zinfo->hostPlacement->noteDomain(domain, i*(zinfo->numCores/caches));
+            cg[i][j] = BuildCacheBank(config, prefix, bankName, bankSize, isTerminal, domain, sdProf);
         }
     }
 
@@ -433,6 +556,31 @@ static void InitSystem(Config& config) {
         return cVec;
     };
 
+    uint64_t startNs = getNs();
+
+    // Pin simulation threads and place per-core structures on the host (see host_placement.h); needs to be set up
+    // before building the caches, so private ones are allocated on their cores' node
+    HostPlacement::Mode placementMode = HostPlacement::parseMode(config.get<const char*>("sim.hostPlacement", "none"));
+    string hostCpuList = config.get<const char*>("sim.hostCpus", "");
+    if (placementMode != HostPlacement::NONE && !zinfo->traceDriven && zinfo->numCores) {
+        // Keep groups of cores that share a cache on the same node: each group of N caches splits the cores in N
+        // contiguous blocks, so node boundaries must fall on multiples of every such block size
+        vector<const char*> groupNames;
+        config.subgroups("sys.caches", groupNames);
+        uint32_t coresPerGroup = 1;
+        for (const char* grp : groupNames) {
+            uint32_t caches = config.get<uint32_t>(string("sys.caches.") + grp + ".caches", 1);
+            if (caches < 2 || zinfo->numCores % caches) continue;
+            uint32_t block = zinfo->numCores/caches;
+            uint32_t a = coresPerGroup, b = block;
+            while (b) { uint32_t t = a % b; a = b; b = t; }  // a = gcd
+            coresPerGroup = MIN(coresPerGroup/a*block, zinfo->numCores);  // lcm, capped
+        }
+        zinfo->hostPlacement = new HostPlacement(placementMode, hostCpuList, zinfo->numCores, coresPerGroup);
+    } else {
+        zinfo->hostPlacement = nullptr;
+    }
+
     // If a network file is specified, build a Network
     string networkFile = config.get<const char*>("sys.networkFile", "");
     Network* network = (networkFile != "")? new Network(networkFile.c_str()) : nullptr;
@@ -499,13 +647,13 @@ static void InitSystem(Config& config) {
 
     g_vector<MemObject*> mems;
     mems.resize(memControllers);
+    bool weaveMem = IsWeaveMemory(config);
 
     for (uint32_t i = 0; i < memControllers; i++) {
         stringstream ss;
         ss << "mem-" << i;
         g_string name(ss.str().c_str());
-        //uint32_t domain = nextDomain(); //i*zinfo->numDomains/memControllers;
-        uint32_t domain = i*zinfo->numDomains/memControllers;
+        uint32_t domain = AssignDomain(config, "mem", i, memControllers, weaveMem);
         mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
     }
 
@@ -606,6 +754,38 @@ static void InitSystem(Config& config) {
         }
     }
 
+    //Number the levels: terminal caches are level 0, and each parent is one level above its highest child
+    std::function<uint32_t(const string&)> level = [&](const string& group) -> uint32_t {
+        uint32_t l = 0;
+        for (auto& childVec : childMap[group]) for (const string& child : childVec) l = MAX(l, level(child) + 1);
+        return l;
+    };
+    vector<string> levelNames(PC_PROF_MAX_LEVELS);
+    for (const char* grp : cacheGroupNames) {
+        uint32_t l = level(grp);
+        for (vector<BaseCache*>& banks : *cMap[grp]) for (BaseCache* bank : banks) {
+            Cache* cache = dynamic_cast<Cache*>(bank);
+            if (!cache) continue;
+            cache->setLevel(l);
+            if (zinfo->pcProf && l < PC_PROF_MAX_LEVELS) cache->setPCProfiler(zinfo->pcProf);
+        }
+        if (l < PC_PROF_MAX_LEVELS) {
+            levelNames[l] += (levelNames[l].empty()? "" : "/") + string(grp);
+        } else if (zinfo->pcProf) {
+            warn("PC profiler: cache group %s is at level %d, only %d levels are profiled", grp, l, PC_PROF_MAX_LEVELS);
+        }
+    }
+    zinfo->numCacheLevels = level(llc) + 1;
+    if (zinfo->pcProf) {
+        for (uint32_t l = 0; l < PC_PROF_MAX_LEVELS; l++) {
+            if (!levelNames[l].empty()) zinfo->pcProf->setLevelName(l, levelNames[l].c_str());
+        }
+    }
+
+    //Caches tell cores which level served each access through these
+    zinfo->coreMissLevels = gm_memalign<CoreMissLevel>(CACHE_LINE_BYTES, MAX(zinfo->numCores, 1u));
+    for (uint32_t c = 0; c < zinfo->numCores; c++) zinfo->coreMissLevels[c].level = 0;
+
     //Tracks how many terminal caches have been allocated to cores
     unordered_map<string, uint32_t> assignedCaches;
     for (const char* grp : cacheGroupNames) if (isTerminal(grp)) assignedCaches[grp] = 0;
@@ -619,6 +799,7 @@ static void InitSystem(Config& config) {
         uint32_t coreIdx = 0;
         for (const char* group : coreGroupNames) {
             if (parentMap.count(group)) panic("Core group name %s is invalid, a cache group already has that name", group);
+            GMTagScope tagScope(GM_TAG_CORES);
 
             coreMap[group] = vector<Core*>();
 
@@ -627,6 +808,7 @@ static void InitSystem(Config& config) {
             string type = config.get<const char*>(prefix + "type", "Simple");
 
             //Build the core group
+            size_t coreBytes = 0;  // per core, for placement
             union {
                 SimpleCore* simpleCores;
                 TimingCore* timingCores;
@@ -635,10 +817,13 @@ static void InitSystem(Config& config) {
             };
             if (type == "Simple") {
                 simpleCores = gm_memalign<SimpleCore>(CACHE_LINE_BYTES, cores);
+                coreBytes = sizeof(SimpleCore);
             } else if (type == "Timing") {
                 timingCores = gm_memalign<TimingCore>(CACHE_LINE_BYTES, cores);
+                coreBytes = sizeof(TimingCore);
             } else if (type == "OOO") {
                 oooCores = gm_memalign<OOOCore>(CACHE_LINE_BYTES, cores);
+                coreBytes = sizeof(OOOCore);
                 zinfo->oooDecode = true; //enable uop decoding, this is false by default, must be true if even one OOO cpu is in the system
             } else if (type == "Null") {
                 nullCores = gm_memalign<NullCore>(CACHE_LINE_BYTES, cores);
@@ -658,6 +843,8 @@ static void InitSystem(Config& config) {
                     ss << group << "-" << j;
                     g_string name(ss.str().c_str());
                     Core* core;
+                    int node = zinfo->hostPlacement? zinfo->hostPlacement->getNode(coreIdx) : -1;
+                    GMNodeScope nodeScope(node);
 
                     //Get the caches
                     CacheGroup& igroup = *cMap[icache];
@@ -684,18 +871,22 @@ static void InitSystem(Config& config) {
                     if (type == "Simple") {
                         core = new (&simpleCores[j]) SimpleCore(ic, dc, name);
                     } else if (type == "Timing") {
-                        uint32_t domain = j*zinfo->numDomains/cores;
+                        uint32_t domain = AssignDomain(config, group, j, cores, true);
+                        if (zinfo->hostPlacement) zinfo->hostPlacement->noteDomain(domain, coreIdx);
                         TimingCore* tcore = new (&timingCores[j]) TimingCore(ic, dc, domain, name);
                         zinfo->eventRecorders[coreIdx] = tcore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = tcore;
                     } else {
                         assert(type == "OOO");
-                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        uint32_t domain = AssignDomain(config, group, j, cores, true, false /*OOO cores share domain 0*/);
+                        if (zinfo->hostPlacement) zinfo->hostPlacement->noteDomain(domain, coreIdx);
+                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, domain, name);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = ocore;
                     }
+                    gm_place(core, coreBytes, node);
                     coreMap[group].push_back(core);
                     coreIdx++;
                 }
@@ -748,10 +939,15 @@ static void InitSystem(Config& config) {
         //FIXME: For now, we assume we are driving a single-bank LLC
         string traceFile = config.get<const char*>("sim.traceFile");
         string retraceFile = config.get<const char*>("sim.retraceFile", ""); //leave empty to not retrace
+        string nextUseFile = config.get<const char*>("sim.nextUseFile", ""); //built by nextusetrace, only needed for OPT
+        if (usesOPT && nextUseFile == "") panic("OPT replacement needs the trace's next-use index; build it with nextusetrace and set sim.nextUseFile");
+        GMTagScope tagScope(GM_TAG_TRACE);
         zinfo->traceDriver = new TraceDriver(traceFile, retraceFile, proxies,
                 config.get<bool>("sim.useSkews", true), // incorporate skews in to playback and simulator results, not only the output trace
                 config.get<bool>("sim.playPuts", true),
-                config.get<bool>("sim.playAllGets", true));
+                config.get<bool>("sim.playAllGets", true),
+                config.get<uint32_t>("sim.traceThreads", 1), // >1 replays children in parallel within each phase, parent must be thread-safe (e.g., a regular cache)
+                nextUseFile);
         zinfo->traceDriver->initStats(zinfo->rootStat);
     }
 
@@ -775,7 +971,8 @@ static void InitSystem(Config& config) {
     for (pair<string, CacheGroup*> kv : cMap) delete kv.second;
     cMap.clear();
 
-    info("Initialized system");
+    zinfo->initSystemNs = getNs() - startNs;
+    info("Initialized system in %.2f s", zinfo->initSystemNs/1e9);
 }
 
 static void PreInitStats() {
@@ -792,21 +989,42 @@ static void PostInitStats(bool perProcessDir, Config& config) {
 
     // Absolute paths for stats files. Note these must be in the global heap.
     const char* pStatsFile = gm_strdup((pathStr + "zsim.h5").c_str());
+    const char* pdStatsFile = gm_strdup((pathStr + "zsim-delta.h5").c_str());
     const char* evStatsFile = gm_strdup((pathStr + "zsim-ev.h5").c_str());
     const char* cmpStatsFile = gm_strdup((pathStr + "zsim-cmp.h5").c_str());
     const char* statsFile = gm_strdup((pathStr + "zsim.out").c_str());
 
+    // Write HDF5 stats from a separate thread that keeps files open; with small statsPhaseIntervals, opening and
+    // writing files on every dump stalls the whole simulation. The writer is a Pin internal thread, which only runs
+    // once the application starts, so trace-driven runs (which never start it) write stats synchronously
+    bool statsWriterThread = config.get<bool>("sim.statsWriterThread", true);
+    if (statsWriterThread && zinfo->traceDriven) {
+        info("Trace-driven run, writing stats without the stats writer thread");
+    } else if (statsWriterThread) {
+        HDF5Backend::startWriterThread(config.get<uint32_t>("sim.statsFlushInterval", 10));
+    }
+
     if (zinfo->statsPhaseInterval) {
         const char* periodicStatsFilter = config.get<const char*>("sim.periodicStatsFilter", "");
         AggregateStat* prStat = (!strlen(periodicStatsFilter))? zinfo->rootStat : FilterStats(zinfo->rootStat, periodicStatsFilter);
         if (!prStat) panic("No stats match sim.periodicStatsFilter regex (%s)! Set interval to 0 to avoid periodic stats", periodicStatsFilter);
-        zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        // "table" writes uncompressed rows to zsim.h5; "delta" writes delta-compressed rows to zsim-delta.h5, read with deltastats
+        const char* periodicStatsFormat = config.get<const char*>("sim.periodicStatsFormat", "table");
+        if (strcmp(periodicStatsFormat, "table") == 0) {
+            zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        } else if (strcmp(periodicStatsFormat, "delta") == 0) {
+            uint32_t keyframeInterval = config.get<uint32_t>("sim.periodicStatsKeyframeInterval", 64);
+            zinfo->periodicStatsBackend = new DeltaBackend(pdStatsFile, prStat, keyframeInterval, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        } else {
+            panic("Invalid sim.periodicStatsFormat %s, must be table or delta", periodicStatsFormat);
+        }
         zinfo->periodicStatsBackend->dump(true); //must have a first sample
 
         class PeriodicStatsDumpEvent : public Event {
             public:
                 explicit PeriodicStatsDumpEvent(uint32_t period) : Event(period) {}
                 void callback() {
+                    SelfProfScope sps(SPR_STATS);
                     zinfo->trigger = 10000;
                     zinfo->periodicStatsBackend->dump(true /*buffered*/);
                 }
@@ -828,6 +1046,7 @@ static void PostInitStats(bool perProcessDir, Config& config) {
             auto getInstrs = [i]() { return zinfo->cores[i]->getInstrs(); };
             auto dumpStats = [i]() {
                 info("Dumping eventual stats for core %d", i);
+                SelfProfScope sps(SPR_STATS);
                 zinfo->trigger = i;
                 zinfo->eventualStatsBackend->dump(true /*buffered*/);
             };
@@ -840,6 +1059,15 @@ static void PostInitStats(bool perProcessDir, Config& config) {
     StatsBackend* textStats = new TextBackend(statsFile, zinfo->rootStat);
     zinfo->statsBackends->push_back(compactStats);
     zinfo->statsBackends->push_back(textStats);
+
+    // Live stats for external monitors (zsimtop); the segment is /dev/shm/zsim-live-<liveStatsName>
+    if (config.get<bool>("sim.liveStats", false)) {
+        std::string liveName = config.get<const char*>("sim.liveStatsName", "");
+        if (liveName.empty()) liveName = std::to_string(getpid());
+        zinfo->liveStats = new LiveStats((LIVE_STATS_PREFIX + liveName).c_str(), zinfo->rootStat, config.get<uint32_t>("sim.liveStatsIntervalMs", 500));
+    } else {
+        zinfo->liveStats = nullptr;
+    }
 }
 
 static void InitGlobalStats() {
@@ -855,10 +1083,66 @@ static void InitGlobalStats() {
     ProxyStat* phaseStat = new ProxyStat();
     phaseStat->init("phase", "Simulated phases", &zinfo->numPhases);
     zinfo->rootStat->append(phaseStat);
+
+    AggregateStat* startupStat = new AggregateStat();
+    startupStat->init("startup", "Simulator initialization time");
+    ProxyStat* initNsStat = new ProxyStat();
+    initNsStat->init("totalNs", "Wall-clock time of initialization (ns)", &zinfo->initNs);
+    startupStat->append(initNsStat);
+    ProxyStat* initSystemNsStat = new ProxyStat();
+    initSystemNsStat->init("systemNs", "Time building the memory hierarchy and cores (ns)", &zinfo->initSystemNs);
+    startupStat->append(initSystemNsStat);
+    zinfo->rootStat->append(startupStat);
+
+    //Global heap traffic
+    AggregateStat* heapStat = new AggregateStat();
+    heapStat->init("heap", "Global heap allocator stats");
+    auto gmStat = [](uint64_t gm_alloc_stats::* field) {
+        return [field]() { gm_alloc_stats s; gm_get_alloc_stats(&s); return s.*field; };
+    };
+    auto lockStat = makeLambdaStat(gmStat(&gm_alloc_stats::lockAcquires));
+    lockStat->init("lockAcqs", "Global heap lock acquisitions");
+    heapStat->append(lockStat);
+    auto mallocStat = makeLambdaStat(gmStat(&gm_alloc_stats::mspaceAllocs));
+    mallocStat->init("mspaceAllocs", "Allocations from the underlying allocator (incl. cache refills)");
+    heapStat->append(mallocStat);
+    auto freeStat = makeLambdaStat(gmStat(&gm_alloc_stats::mspaceFrees));
+    freeStat->init("mspaceFrees", "Frees to the underlying allocator (incl. cache drains)");
+    heapStat->append(freeStat);
+    auto cachedMallocStat = makeLambdaStat(gmStat(&gm_alloc_stats::cachedAllocs));
+    cachedMallocStat->init("cachedAllocs", "Allocations served by the small-object caches");
+    heapStat->append(cachedMallocStat);
+    auto cachedFreeStat = makeLambdaStat(gmStat(&gm_alloc_stats::cachedFrees));
+    cachedFreeStat->init("cachedFrees", "Frees absorbed by the small-object caches");
+    heapStat->append(cachedFreeStat);
+    auto heapBytesStat = makeLambdaStat(gmStat(&gm_alloc_stats::heapBytes));
+    heapBytesStat->init("bytes", "Committed global heap size, in bytes");
+    heapStat->append(heapBytesStat);
+    auto segmentsStat = makeLambdaStat(gmStat(&gm_alloc_stats::segments));
+    segmentsStat->init("segments", "Shared memory segments backing the global heap");
+    heapStat->append(segmentsStat);
+
+    //Per-component usage, by allocation tag
+    for (uint32_t t = 0; t < GM_TAGS; t++) {
+        AggregateStat* tagStat = new AggregateStat();
+        tagStat->init(gm_tag_name((gm_tag)t), "Global heap usage by component");
+        auto tagBytesStat = makeLambdaStat([t]() { gm_alloc_stats s; gm_get_alloc_stats(&s); return s.tagBytes[t]; });
+        tagBytesStat->init("bytes", "Live bytes");
+        tagStat->append(tagBytesStat);
+        auto tagPeakStat = makeLambdaStat([t]() { gm_alloc_stats s; gm_get_alloc_stats(&s); return s.tagPeakBytes[t]; });
+        tagPeakStat->init("peakBytes", "High-water mark of live bytes");
+        tagStat->append(tagPeakStat);
+        auto tagAllocsStat = makeLambdaStat([t]() { gm_alloc_stats s; gm_get_alloc_stats(&s); return s.tagAllocs[t]; });
+        tagAllocsStat->init("allocs", "Allocations");
+        tagStat->append(tagAllocsStat);
+        heapStat->append(tagStat);
+    }
+    zinfo->rootStat->append(heapStat);
 }
 
 
 void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
+    uint64_t initStartNs = getNs();
     zinfo = gm_calloc<GlobSimInfo>();
     zinfo->outputDir = gm_strdup(outputDir);
     zinfo->statsBackends = new g_vector<StatsBackend*>();
@@ -899,10 +1183,25 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     }
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
+    zinfo->numDomains = config.get<uint32_t>("domainMap.domains", zinfo->numDomains); //a profiled domain map sets its own
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+
+    //In a domain profiling run, each weave component is its own domain (see domain_profiler.h), plus empty domains
+    //to round up to a multiple of the contention threads
+    uint32_t profComponents = 0;
+    if (config.get<bool>("sim.profileDomains", false)) {
+        zinfo->domainProfiler = new DomainProfiler(zinfo->numDomains);
+        profComponents = MAX(CountWeaveComponents(config), (uint32_t)1);
+        zinfo->numDomains = (profComponents + numSimThreads - 1)/numSimThreads*numSimThreads;
+        info("Profiling weave domains: %d components, %d contention threads", profComponents, numSimThreads);
+    } else {
+        zinfo->domainProfiler = nullptr;
+    }
+
+    zinfo->contentionSim = new (GM_TAG_EVENTS) ContentionSim(zinfo->numDomains, numSimThreads);
+    if (zinfo->domainProfiler) zinfo->contentionSim->enableDomainProfiling();
     zinfo->contentionSim->initStats(zinfo->rootStat);
-    zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores, GM_TAG_EVENTS);
 
     zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
 
@@ -957,6 +1256,22 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     InitGlobalStats();
 
+    // Host-time breakdown of simulator components (root.selfProf)
+    if (config.get<bool>("sim.selfProfile", false)) {
+        zinfo->selfProf = new SelfProfiler();
+        zinfo->selfProf->initStats(zinfo->rootStat);
+    } else {
+        zinfo->selfProf = nullptr;
+    }
+
+    // Sampling profiler of the simulated code (zsim-pcprof.txt); must exist before the memory hierarchy is built
+    uint64_t pcProfileInterval = config.get<uint64_t>("sim.pcProfileInterval", 0);  // cycles, 0 disables
+    if (pcProfileInterval && !zinfo->traceDriven) {
+        zinfo->pcProf = new PCProfiler(zinfo->numCores, pcProfileInterval, config.get<uint32_t>("sim.pcProfileTop", 50));
+    } else {
+        zinfo->pcProf = nullptr;
+    }
+
     //Core stats (initialized here for cosmetic reasons, to be above cache stats)
     AggregateStat* allCoreStats = new AggregateStat(false);
     allCoreStats->init("core", "Core stats");
@@ -978,6 +1293,9 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     //Caches, cores, memory controllers
     InitSystem(config);
+    if (zinfo->domainProfiler && zinfo->domainProfiler->getNumComponents() != profComponents) {
+        panic("Domain profiling: counted %d weave components, but %d were built", profComponents, zinfo->domainProfiler->getNumComponents());
+    }
 
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
@@ -1006,10 +1324,16 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     if (printMemoryStats) {
         gm_stats();
     }
+    gm_report_backing(); //after init, so residency and huge page coverage reflect the simulated system
 
     //HACK: Read all variables that are read in the harness but not in init
     //This avoids warnings on those elements
     config.get<uint32_t>("sim.gmMBytes", (1 << 10));
+    config.get<uint32_t>("sim.gmMaxMBytes", 0);
+    config.get<bool>("sim.gmCaches", true);
+    config.get<const char*>("sim.gmPages", "default");
+    config.get<const char*>("sim.gmNuma", "none");
+    config.get<const char*>("sim.gmNumaNodes", "0:64");
     if (!zinfo->attachDebugger) config.get<bool>("sim.deadlockDetection", true);
     config.get<bool>("sim.aslr", false);
 
@@ -1019,7 +1343,8 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->contentionSim->postInit();
 
-    info("Initialization complete");
+    zinfo->initNs = getNs() - initStartNs;
+    info("Initialization complete (%.2f s)", zinfo->initNs/1e9);
 
     //Causes every other process to wake up
     gm_set_glob_ptr(zinfo);
@@ -0,0 +1,125 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "live_stats.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "log.h"
+#include "profile_stats.h"
+#include "stats.h"
+#include "stats_gather.h"
+#include "zsim.h"
+
+// The segment is mapped at a different address in each process, so the mapping is process-local
+static LiveStatsHeader* liveSegment = nullptr;
+
+LiveStats::LiveStats(const char* name, AggregateStat* rootStat, uint32_t intervalMs) {
+    snprintf(shmName, sizeof(shmName), "/%s", name);
+    intervalNs = intervalMs*1000000ul;
+    lastUpdateNs = 0;
+
+    // Same layout as the periodic stats, but with all vectors and aggregates, so monitors see every core
+    plan = new StatGatherPlan(rootStat, false /*skipVectors*/, false /*sumRegularAggregates*/);
+    std::vector<std::string> names;
+    GetGatherPlanNames(rootStat, false, false, names);
+    assert(names.size() == plan->size());
+
+    uint64_t namesBytes = 0;
+    for (const std::string& n : names) namesBytes += n.size() + 1;
+    valuesOffset = (sizeof(LiveStatsHeader) + namesBytes + 7) & ~7ul;
+    segmentBytes = valuesOffset + names.size()*sizeof(uint64_t);
+
+    int fd = shm_open(shmName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) panic("Could not create live stats segment %s: %s", shmName, strerror(errno));
+    if (ftruncate(fd, segmentBytes) != 0) panic("Could not size live stats segment %s: %s", shmName, strerror(errno));
+    void* seg = mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED) panic("Could not map live stats segment %s: %s", shmName, strerror(errno));
+    close(fd);
+    liveSegment = (LiveStatsHeader*) seg;
+
+    LiveStatsHeader* hdr = liveSegment;
+    hdr->version = LIVE_STATS_VERSION;
+    hdr->numStats = names.size();
+    hdr->namesOffset = sizeof(LiveStatsHeader);
+    hdr->valuesOffset = valuesOffset;
+    hdr->totalBytes = segmentBytes;
+    hdr->phaseLength = zinfo->phaseLength;
+    hdr->freqMHz = zinfo->freqMHz;
+    hdr->numCores = zinfo->numCores;
+    hdr->seq = 0;
+    hdr->phase = 0;
+    hdr->updateNs = getNs();
+    hdr->finished = 0;
+
+    char* namesBuf = ((char*)hdr) + hdr->namesOffset;
+    for (const std::string& n : names) {
+        memcpy(namesBuf, n.c_str(), n.size() + 1);
+        namesBuf += n.size() + 1;
+    }
+
+    // Write the magic last, so monitors that attach early never see a partially-filled header
+    __sync_synchronize();
+    memcpy(hdr->magic, LIVE_STATS_MAGIC, sizeof(hdr->magic));
+    info("Live stats: %ld stats (%ld bytes) in /dev/shm%s, updated every %d ms", names.size(), segmentBytes, shmName, intervalMs);
+}
+
+LiveStatsHeader* LiveStats::getSegment() {
+    if (unlikely(!liveSegment)) {
+        int fd = shm_open(shmName, O_RDWR, 0);
+        if (fd == -1) panic("Could not open live stats segment %s: %s", shmName, strerror(errno));
+        void* seg = mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (seg == MAP_FAILED) panic("Could not map live stats segment %s: %s", shmName, strerror(errno));
+        close(fd);
+        liveSegment = (LiveStatsHeader*) seg;
+    }
+    return liveSegment;
+}
+
+void LiveStats::update(uint64_t phase, bool force) {
+    uint64_t curNs = getNs();
+    if (!force && curNs - lastUpdateNs < intervalNs) return;
+    lastUpdateNs = curNs;
+
+    // Phase ends are serialized, so there is a single writer; monitors retry while seq is odd
+    LiveStatsHeader* hdr = getSegment();
+    hdr->seq = hdr->seq + 1;
+    __sync_synchronize();
+    plan->gather((uint64_t*)(((char*)hdr) + valuesOffset));
+    hdr->phase = phase;
+    hdr->updateNs = curNs;
+    __sync_synchronize();
+    hdr->seq = hdr->seq + 1;
+}
+
+void LiveStats::finish(uint64_t phase) {
+    LiveStatsHeader* hdr = getSegment();
+    hdr->finished = 1;  // not seqlock-protected, but the forced update below bumps seq after it
+    update(phase, true);
+    shm_unlink(shmName);
+}
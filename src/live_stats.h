@@ -0,0 +1,109 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVE_STATS_H_
+#define LIVE_STATS_H_
+
+/* Live stats endpoint: a read-only shared-memory segment (POSIX shm, /dev/shm/zsim-live-*) that holds a flattened
+ * copy of the stats tree, refreshed at phase ends (at most every intervalMs). External monitors (e.g., zsimtop) map
+ * it read-only and take consistent snapshots without stopping the simulation.
+ *
+ * Layout: a LiveStatsHeader, then the names of all stats (NUL-terminated, in gather plan order, vectors expanded as
+ * name.element), then the uint64_t values in the same order, at header.valuesOffset. Values and the phase-related
+ * header fields are protected by a seqlock: the writer makes seq odd while updating them.
+ */
+
+#include <stdint.h>
+#include <string>
+#include "galloc.h"
+
+#define LIVE_STATS_MAGIC "ZSIMLIVE"
+#define LIVE_STATS_VERSION 1
+#define LIVE_STATS_PREFIX "zsim-live-"
+
+struct LiveStatsHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numStats;
+    uint64_t namesOffset;
+    uint64_t valuesOffset;
+    uint64_t totalBytes;
+    uint32_t phaseLength;
+    uint32_t freqMHz;
+    uint32_t numCores;
+    uint32_t pad;
+
+    // Seqlock-protected
+    volatile uint64_t seq;
+    volatile uint64_t phase;
+    volatile uint64_t updateNs; //CLOCK_REALTIME
+    volatile uint64_t finished;
+};
+
+/* Copies a consistent snapshot of the values (and phase/updateNs/finished) out of a mapped segment. Returns false
+ * if it could not get one after a few tries (e.g., the writer died mid-update).
+ */
+static inline bool LiveStatsSnapshot(const LiveStatsHeader* hdr, uint64_t* vals, uint64_t& phase, uint64_t& updateNs, bool& finished) {
+    const volatile uint64_t* src = (const volatile uint64_t*)(((const char*)hdr) + hdr->valuesOffset);
+    for (uint32_t tries = 0; tries < 1000; tries++) {
+        uint64_t s1 = hdr->seq;
+        if (s1 & 1) continue;
+        __sync_synchronize();
+        for (uint32_t i = 0; i < hdr->numStats; i++) vals[i] = src[i];
+        phase = hdr->phase;
+        updateNs = hdr->updateNs;
+        finished = hdr->finished;
+        __sync_synchronize();
+        if (hdr->seq == s1) return true;
+    }
+    return false;
+}
+
+class AggregateStat;
+class StatGatherPlan;
+
+class LiveStats : public GlobAlloc {
+    private:
+        char shmName[64];
+        StatGatherPlan* plan;
+        uint64_t segmentBytes;
+        uint64_t valuesOffset;
+        uint64_t intervalNs;
+        uint64_t lastUpdateNs;
+
+    public:
+        LiveStats(const char* name, AggregateStat* rootStat, uint32_t intervalMs);
+
+        // Called at phase ends; rate-limited to intervalMs unless forced
+        void update(uint64_t phase, bool force = false);
+
+        // Final update; also unlinks the segment (attached monitors keep their mapping)
+        void finish(uint64_t phase);
+
+    private:
+        LiveStatsHeader* getSegment();
+};
+
+#endif  // LIVE_STATS_H_
@@ -0,0 +1,134 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef LOCK_PROFILE
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+#include "galloc.h"
+#include "locks.h"
+#include "log.h"
+
+/* Lock names, in a hash table in the global heap so that every process can name the locks of the simulated system,
+ * which only one process builds. Names are registered at init, and only read when dumping.
+ */
+struct LockProfName {
+    volatile uintptr_t lock;
+    const char* name;  // in the global heap
+};
+
+#define LOCK_PROF_NAMES 16384  // must be a power of 2
+#define LOCK_PROF_NAME_PROBES 64
+
+static LockProfName* getNames() {
+    return static_cast<LockProfName*>(gm_get_lock_prof_ptr());
+}
+
+static inline uint32_t namePos(uintptr_t key) {
+    return ((key >> 2)*0x9E3779B97F4A7C15ul) >> 50;  // 14 bits
+}
+
+void futex_prof_name(volatile uint32_t* lock, const char* name) {
+    LockProfName* names = getNames();
+    if (!names) {  // first name, from gm_init
+        names = gm_calloc<LockProfName>(LOCK_PROF_NAMES, GM_TAG_STATS);
+        gm_set_lock_prof_ptr(names);
+    }
+    uintptr_t key = (uintptr_t)lock;
+    for (uint32_t i = 0; i < LOCK_PROF_NAME_PROBES; i++) {
+        LockProfName* n = &names[(namePos(key) + i) & (LOCK_PROF_NAMES - 1)];
+        if (n->lock == key || (n->lock == 0 && __sync_bool_compare_and_swap(&n->lock, 0, key))) {
+            n->name = gm_strdup(name);
+            return;
+        }
+    }
+    static bool warned = false;
+    if (!warned) warn("Lock profile name table is full, some locks will be unnamed (raise LOCK_PROF_NAMES)");
+    warned = true;
+}
+
+static const char* lookupName(uintptr_t key) {
+    LockProfName* names = getNames();
+    if (!names) return nullptr;
+    for (uint32_t i = 0; i < LOCK_PROF_NAME_PROBES; i++) {
+        const LockProfName* n = &names[(namePos(key) + i) & (LOCK_PROF_NAMES - 1)];
+        if (n->lock == key) return n->name;
+        if (n->lock == 0) return nullptr;
+    }
+    return nullptr;
+}
+
+static uint64_t waitCycles(const LockProfCounters& c) {
+    return c.spinCycles + c.sleepCycles;
+}
+
+static void printCounters(FILE* f, const LockProfCounters& c) {
+    fprintf(f, " %12ld %10ld %14ld %14ld %10ld\n", c.acquisitions, c.contended, c.spinCycles, c.sleepCycles, c.sleeps);
+}
+
+void futex_prof_dump(const char* filename) {
+    std::vector<const LockProfSite*> sites;
+    for (const LockProfSite* s = *futex_prof_sites(); s; s = s->next) sites.push_back(s);
+    std::sort(sites.begin(), sites.end(), [](const LockProfSite* a, const LockProfSite* b) { return waitCycles(a->c) > waitCycles(b->c); });
+
+    std::vector<const LockProfEntry*> locks;
+    const LockProfEntry* entries = futex_prof_entries();
+    for (uint32_t i = 0; i < LOCK_PROF_ENTRIES; i++) {
+        if (entries[i].lock && entries[i].c.contended) locks.push_back(&entries[i]);
+    }
+    std::sort(locks.begin(), locks.end(), [](const LockProfEntry* a, const LockProfEntry* b) { return waitCycles(a->c) > waitCycles(b->c); });
+
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        warn("Could not open lock profile file %s", filename);
+        return;
+    }
+
+    fprintf(f, "# Lock sites, by wait (spin + sleep) cycles\n");
+    fprintf(f, "# %-38s %12s %10s %14s %14s %10s\n", "site", "acquisitions", "contended", "spinCycles", "sleepCycles", "sleeps");
+    for (const LockProfSite* s : sites) {
+        char site[256];
+        snprintf(site, sizeof(site), "%s:%d", s->file, s->line);
+        fprintf(f, "%-40s", site);
+        printCounters(f, s->c);
+    }
+
+    // Shared-heap locks have the same address and name in all processes
+    fprintf(f, "\n# Contended locks, by wait cycles (acquisitions counts only contended ones)\n");
+    fprintf(f, "# %-38s %12s %10s %14s %14s %10s\n", "lock", "acquisitions", "contended", "spinCycles", "sleepCycles", "sleeps");
+    for (const LockProfEntry* e : locks) {
+        char lock[256];
+        const char* name = lookupName(e->lock);
+        if (name) snprintf(lock, sizeof(lock), "%s (%p)", name, (void*)e->lock);
+        else snprintf(lock, sizeof(lock), "%p", (void*)e->lock);
+        fprintf(f, "%-40s", lock);
+        printCounters(f, e->c);
+    }
+    fclose(f);
+    info("Wrote lock profile to %s (%ld sites, %ld contended locks)", filename, sites.size(), locks.size());
+}
+
+#endif  // LOCK_PROFILE
@@ -220,4 +220,142 @@ static inline bool futex_haswaiters(volatile uint32_t* lock) {
     return *lock == 2;
 }
 
+/* LOCK CONTENTION PROFILING: Build with --lockprof (defines LOCK_PROFILE) to make futex_lock() and
+ * futex_lock_nospin() record acquisitions, contended acquisitions, and cycles spent spinning and sleeping, both per
+ * call site and per contended lock (by address, named with futex_prof_name()). Counters are process-local and
+ * updated atomically, so this perturbs hot locks somewhat; it is meant to find which locks serialize a run. Each
+ * process writes its profile with futex_prof_dump() at the end of simulation.
+ *
+ * Per-lock entries are inserted into a hash table on a lock's first contended acquire, so uncontended locks take no
+ * space. Names live in a separate table in the global heap (see lock_prof.cpp), so all processes see the names
+ * registered by the one that built the simulated system.
+ */
+
+#ifdef LOCK_PROFILE
+#include "rdtsc.h"
+
+struct LockProfCounters {
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t spinCycles;
+    uint64_t sleepCycles;
+    uint64_t sleeps;
+};
+
+struct LockProfSite {
+    const char* file;
+    uint32_t line;
+    volatile uint32_t registered;
+    LockProfSite* next;
+    LockProfCounters c;
+};
+
+struct LockProfEntry {
+    volatile uintptr_t lock;
+    LockProfCounters c;
+};
+
+#define LOCK_PROF_ENTRIES 4096  // per process; must be a power of 2
+#define LOCK_PROF_MAX_PROBES 64
+
+// Not static, so that all translation units share these
+inline LockProfSite* volatile* futex_prof_sites() {
+    static LockProfSite* volatile head = nullptr;
+    return &head;
+}
+
+inline LockProfEntry* futex_prof_entries() {
+    static LockProfEntry entries[LOCK_PROF_ENTRIES];
+    return entries;
+}
+
+inline volatile uint32_t* futex_prof_overflowed() {
+    static volatile uint32_t overflowed = 0;
+    return &overflowed;
+}
+
+// Finds or inserts the entry for this lock; returns nullptr (and warns once) if its probe sequence is full
+inline LockProfEntry* futex_prof_entry(volatile uint32_t* lock) {
+    uintptr_t key = (uintptr_t)lock;
+    LockProfEntry* entries = futex_prof_entries();
+    uint32_t pos = ((key >> 2)*0x9E3779B97F4A7C15ul) >> 52;  // 12 bits
+    for (uint32_t i = 0; i < LOCK_PROF_MAX_PROBES; i++) {
+        LockProfEntry* e = &entries[(pos + i) & (LOCK_PROF_ENTRIES - 1)];
+        if (e->lock == key) return e;
+        if (e->lock == 0 && __sync_bool_compare_and_swap(&e->lock, 0, key)) return e;
+        if (e->lock == key) return e;  // lost the race to insert this same lock
+    }
+    if (__sync_bool_compare_and_swap(futex_prof_overflowed(), 0, 1)) {
+        warn("Lock profile table is full, some contended locks will not be profiled individually (raise LOCK_PROF_ENTRIES)");
+    }
+    return nullptr;
+}
+
+static inline void futex_prof_add(LockProfCounters& c, uint64_t spinCycles, uint64_t sleepCycles, uint64_t sleeps) {
+    __sync_fetch_and_add(&c.contended, 1);
+    __sync_fetch_and_add(&c.spinCycles, spinCycles);
+    __sync_fetch_and_add(&c.sleepCycles, sleepCycles);
+    __sync_fetch_and_add(&c.sleeps, sleeps);
+}
+
+static inline void futex_lock_prof(volatile uint32_t* lock, bool spin, LockProfSite* site) {
+    if (unlikely(!site->registered) && __sync_bool_compare_and_swap(&site->registered, 0, 1)) {
+        LockProfSite* volatile* head = futex_prof_sites();
+        do {
+            site->next = *head;
+        } while (!__sync_bool_compare_and_swap(head, site->next, site));
+    }
+    __sync_fetch_and_add(&site->c.acquisitions, 1);
+    if (*lock == 0 && __sync_bool_compare_and_swap(lock, 0, 1)) return;
+
+    // Contended; same protocol as futex_lock()/futex_lock_nospin()
+    uint64_t startCycle = rdtsc();
+    uint64_t sleepCycles = 0;
+    uint64_t sleeps = 0;
+    bool acquired = false;
+    uint32_t c;
+    do {
+        for (uint32_t i = 0; spin && i < 5; i++) {
+            if (*lock == 0 && __sync_bool_compare_and_swap(lock, 0, 1)) {
+                acquired = true;
+                break;
+            }
+            for (uint32_t j = 1; j < i+2; j++) _mm_pause();
+        }
+        if (acquired) break;
+
+        c = __sync_lock_test_and_set(lock, 2);
+        if (c == 0) break;
+        uint64_t sleepStart = rdtsc();
+        syscall(SYS_futex, lock, FUTEX_WAIT, 2, nullptr, nullptr, 0);
+        sleepCycles += rdtsc() - sleepStart;
+        sleeps++;
+        c = __sync_lock_test_and_set(lock, 2);
+    } while (c != 0);
+
+    uint64_t spinCycles = rdtsc() - startCycle - sleepCycles;
+    futex_prof_add(site->c, spinCycles, sleepCycles, sleeps);
+    LockProfEntry* e = futex_prof_entry(lock);
+    if (e) {
+        __sync_fetch_and_add(&e->c.acquisitions, 1);  // only contended ones are counted per lock
+        futex_prof_add(e->c, spinCycles, sleepCycles, sleeps);
+    }
+}
+
+// Names a lock for the profile; name is copied. Defined in lock_prof.cpp
+void futex_prof_name(volatile uint32_t* lock, const char* name);
+
+// Writes the profile of this process (sites and locks, sorted by wait time); defined in lock_prof.cpp
+void futex_prof_dump(const char* filename);
+
+#define LOCK_PROF_SITE ({ static LockProfSite __lockProfSite = {__FILE__, __LINE__, 0, nullptr, {0, 0, 0, 0, 0}}; &__lockProfSite; })
+#define futex_lock(lock) futex_lock_prof((lock), true, LOCK_PROF_SITE)
+#define futex_lock_nospin(lock) futex_lock_prof((lock), false, LOCK_PROF_SITE)
+
+#else  // LOCK_PROFILE
+
+#define futex_prof_name(lock, name)  // names are not stored (nor evaluated) without LOCK_PROFILE
+
+#endif  // LOCK_PROFILE
+
 #endif  // LOCKS_H_
@@ -0,0 +1,126 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmark for g_flat_map vs the node-based maps (g_unordered_map, std::unordered_map) on the access pattern
+ * of the trace driver's child stores: a working set of line addresses with lookups, and churn (erase one line,
+ * insert another) to model evictions and fills. Also cross-checks g_flat_map against std::unordered_map.
+ */
+
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+#include "g_std/g_flat_map.h"
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+#include "log.h"
+#include "profile_stats.h"
+
+// xorshift64*, deterministic and cheap enough not to dominate the measurement
+static inline uint64_t nextRand(uint64_t& s) {
+    s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+    return s * 2685821657736338717ULL;
+}
+
+template <typename M>
+void bench(const char* name, uint64_t entries, uint64_t ops) {
+    M m;
+    uint64_t seed = 0x5eed;
+    std::vector<uint64_t> lines(entries);
+    uint64_t startNs = getNs();
+    for (uint64_t i = 0; i < entries; i++) {
+        lines[i] = (nextRand(seed) >> 20) << 6; //spread-out line addresses
+        m[lines[i]] = 1;
+    }
+    uint64_t fillNs = getNs() - startNs;
+
+    startNs = getNs();
+    uint64_t hits = 0;
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t r = nextRand(seed);
+        uint64_t key = (r & 1)? lines[r % entries] : (r >> 20) << 6; //50% hits
+        hits += m.count(key);
+    }
+    uint64_t lookupNs = getNs() - startNs;
+
+    startNs = getNs();
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t idx = nextRand(seed) % entries;
+        m.erase(lines[idx]);
+        lines[idx] = (nextRand(seed) >> 20) << 6;
+        m[lines[idx]] = 2;
+    }
+    uint64_t churnNs = getNs() - startNs;
+
+    info("%-20s fill %6.1f ns/op, lookup %6.1f ns/op, churn %6.1f ns/op (%ld hits, %ld entries)", name,
+            ((double)fillNs)/entries, ((double)lookupNs)/ops, ((double)churnNs)/ops, hits, m.size());
+}
+
+void check(uint64_t ops) {
+    g_flat_map<uint64_t, uint64_t> fm;
+    std::unordered_map<uint64_t, uint64_t> um;
+    uint64_t seed = 0xc4ec;
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t r = nextRand(seed);
+        uint64_t key = (r >> 8) % 4096; //small key space to exercise clusters and erases
+        switch (r & 3) {
+            case 0: fm[key] = i; um[key] = i; break;
+            case 1: if (fm.erase(key) != um.erase(key)) panic("Erase mismatch on key %ld", key); break;
+            default: {
+                auto fit = fm.find(key);
+                auto uit = um.find(key);
+                if ((fit == fm.end()) != (uit == um.end()) || (fit != fm.end() && fit->second != uit->second)) {
+                    panic("Lookup mismatch on key %ld", key);
+                }
+            }
+        }
+    }
+    uint64_t n = 0;
+    for (auto& e : fm) {
+        if (um.find(e.first) == um.end() || um[e.first] != e.second) panic("Iteration mismatch on key %ld", e.first);
+        n++;
+    }
+    if (n != um.size() || fm.size() != um.size()) panic("Size mismatch, %ld vs %ld", n, um.size());
+    info("g_flat_map matches std::unordered_map after %ld ops (%ld entries)", ops, n);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog(""); //no log header
+    if (argc > 3) {
+        info("Usage: %s [<entries>] [<ops>]", argv[0]);
+        exit(1);
+    }
+    uint64_t entries = (argc > 1)? strtoul(argv[1], nullptr, 0) : 32768;
+    uint64_t ops = (argc > 2)? strtoul(argv[2], nullptr, 0) : 10*1000*1000;
+    if (entries == 0) panic("Need at least one entry");
+
+    gm_init(1024<<20 /*1 GB*/);
+    check(ops);
+    bench< g_flat_map<uint64_t, uint64_t> >("g_flat_map", entries, ops);
+    bench< g_unordered_map<uint64_t, uint64_t> >("g_unordered_map", entries, ops);
+    bench< g_flat_map<uint64_t, uint64_t, std::hash<uint64_t>, std::allocator<std::pair<uint64_t, uint64_t> > > >(
+            "g_flat_map (malloc)", entries, ops);
+    bench< std::unordered_map<uint64_t, uint64_t> >("std::unordered_map", entries, ops);
+    return 0;
+}
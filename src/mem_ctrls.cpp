@@ -64,6 +64,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
     : zeroLoadLatency(_zeroLoadLatency), name(_name)
 {
     lastPhase = 0;
+    detailedStats = false;
 
     double bytesPerCycle = ((double)megabytesPerSecond)/((double)megacyclesPerSecond);
     maxRequestsPerCycle = bytesPerCycle/requestSize;
@@ -121,6 +122,7 @@ uint64_t MD1Memory::access(MemReq& req) {
             //Dirty wback
             profWrites.atomicInc();
             profTotalWrLat.atomicInc(curLatency);
+            if (detailedStats) profWrLatHist.atomicInc(curLatency);
             __sync_fetch_and_add(&curPhaseAccesses, 1);
             //Note no break
         case PUTS:
@@ -130,12 +132,14 @@ uint64_t MD1Memory::access(MemReq& req) {
         case GETS:
             profReads.atomicInc();
             profTotalRdLat.atomicInc(curLatency);
+            if (detailedStats) profRdLatHist.atomicInc(curLatency);
             __sync_fetch_and_add(&curPhaseAccesses, 1);
             *req.state = req.is(MemReq::NOEXCL)? S : E;
             break;
         case GETX:
             profReads.atomicInc();
             profTotalRdLat.atomicInc(curLatency);
+            if (detailedStats) profRdLatHist.atomicInc(curLatency);
             __sync_fetch_and_add(&curPhaseAccesses, 1);
             *req.state = M;
             break;
@@ -66,6 +66,9 @@ class MD1Memory : public MemObject {
         Counter profLoad;
         Counter profUpdates;
         Counter profClampedLoads;
+        Histogram profRdLatHist;  // only if detailedStats
+        Histogram profWrLatHist;
+        bool detailedStats;
         uint32_t curPhaseAccesses;
 
         g_string name; //barely used
@@ -85,9 +88,15 @@ class MD1Memory : public MemObject {
             profLoad.init("load", "Sum of load factors (0-100) per update"); memStats->append(&profLoad);
             profUpdates.init("ups", "Number of latency updates"); memStats->append(&profUpdates);
             profClampedLoads.init("clampedLoads", "Number of updates where the load was clamped to 95%"); memStats->append(&profClampedLoads);
+            if (detailedStats) {
+                profRdLatHist.init("rdlatHist", "Latency distribution of read requests", 1 << 16); memStats->append(&profRdLatHist);
+                profWrLatHist.init("wrlatHist", "Latency distribution of write requests", 1 << 16); memStats->append(&profWrLatHist);
+            }
             parentStat->append(memStats);
         }
 
+        void setDetailedStats(bool enable) {detailedStats = enable;}  // before initStats()
+
         //uint32_t access(Address lineAddr, AccessType type, uint32_t childId, MESIState* state /*both input and output*/, MESIState initialState, lock_t* childLock);
         uint64_t access(MemReq& req);
 
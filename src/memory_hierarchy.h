@@ -102,6 +102,10 @@ struct MemReq {
 
     inline void set(Flag f) {flags |= f;}
     inline bool is (Flag f) const {return flags & f;}
+
+    //PC of the instruction that caused this request, 0 if unknown (e.g., writebacks, or requesters that do not track it)
+    //Propagates across levels like flags; optional, so aggregate initializers that omit it leave it at 0
+    Address pc;
 };
 
 /* Invalidation/downgrade request */
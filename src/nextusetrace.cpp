@@ -0,0 +1,107 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Builds the next-use index of a trace, used for OPT replacement in trace-driven simulation.
+ *
+ * Single forward pass: records that still wait for the next use of their line are chained through
+ * their own entries in the index (each points to the previous waiting record of the same line), so
+ * resolving them when the next GET arrives just walks and overwrites that chain. This needs 8 bytes
+ * per record in memory, but no reverse traversal of the (compressed, chunked) trace.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "access_tracing.h"
+#include "galloc.h"
+
+using namespace std;
+
+void printProgress(uint64_t read, uint64_t total) {
+    printf("Read %3ld%%\r", read*100/total);
+    fflush(stdout);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc != 2 && argc != 3) {
+        info("Builds the next-use index of an access trace");
+        info("Usage: %s <input_trace> [<output_index>] (default output: <input_trace>.nextuse)", argv[0]);
+        exit(1);
+    }
+
+    gm_init(32<<20 /*32 MB --- should be enough*/);
+
+    AccessTraceReader tr(argv[1]);
+    string outFile = (argc == 3)? argv[2] : string(argv[1]) + ".nextuse";
+    uint64_t totalRecords = tr.getNumRecords();
+    info("Indexing %ld records", totalRecords);
+
+    vector<uint64_t> nextUse(totalRecords);
+    unordered_map<Address, uint64_t> lastWaiting; //line -> last record waiting for its next use, head of the chain
+
+    for (uint64_t i = 0; i < totalRecords; i++) {
+        AccessRecord acc = tr.read();
+        auto it = lastWaiting.find(acc.lineAddr);
+        uint64_t prev = NEXT_USE_NEVER;
+        if (it != lastWaiting.end()) {
+            prev = it->second;
+            if (IsGet(acc.type)) {
+                // Resolve all waiting records of this line
+                while (prev != NEXT_USE_NEVER) {
+                    uint64_t p = nextUse[prev];
+                    nextUse[prev] = i;
+                    prev = p;
+                }
+            }
+            it->second = i;
+        } else {
+            lastWaiting[acc.lineAddr] = i;
+        }
+        nextUse[i] = prev; //chain to the earlier waiting records, if any
+        if ((i % (1024*1024)) == 0) printProgress(i, totalRecords);
+    }
+    assert(tr.empty());
+
+    // Whatever is still waiting is never used again
+    for (auto& lw : lastWaiting) {
+        uint64_t prev = lw.second;
+        while (prev != NEXT_USE_NEVER) {
+            uint64_t p = nextUse[prev];
+            nextUse[prev] = NEXT_USE_NEVER;
+            prev = p;
+        }
+    }
+    printProgress(totalRecords, totalRecords);
+    printf("\n");
+
+    NextUseWriter nw(outFile);
+    for (uint64_t i = 0; i < totalRecords; i++) nw.write(nextUse[i]);
+    nw.dump(false); //flushes it
+    info("Wrote next-use index to %s", outFile.c_str());
+    return 0;
+}
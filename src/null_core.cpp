@@ -62,10 +62,10 @@ InstrFuncPtrs NullCore::GetFuncPtrs() {
     return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};
 }
 
-void NullCore::LoadFunc(THREADID tid, ADDRINT addr) {}
-void NullCore::StoreFunc(THREADID tid, ADDRINT addr) {}
-void NullCore::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {}
-void NullCore::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {}
+void NullCore::LoadFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {}
+void NullCore::StoreFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {}
+void NullCore::PredLoadFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {}
+void NullCore::PredStoreFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {}
 
 void NullCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     NullCore* core = static_cast<NullCore*>(cores[tid]);
@@ -30,6 +30,8 @@
 #include "bithacks.h"
 #include "decoder.h"
 #include "filter_cache.h"
+#include "pc_profiler.h"
+#include "self_prof.h"
 #include "zsim.h"
 
 /* Uncomment to induce backpressure to the IW when the load/store buffers fill up. In theory, more detailed,
@@ -55,7 +57,10 @@
 #define ISSUES_PER_CYCLE 4
 #define RF_READS_PER_CYCLE 3
 
-OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name) {
+const char* cpiStackComponentNames[CPI_COMPONENTS] = {"retiring", "feFetch", "feMispred", "feDecode", "beCore",
+    "beL2", "beL3", "beL4", "beMem", "contention"};
+
+OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t domain, g_string& _name) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(domain, _name) {
     decodeCycle = DECODE_STAGE;  // allow subtracting from it
     curCycle = 0;
     phaseEndCycle = zinfo->phaseLength;
@@ -69,10 +74,21 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
     lastStoreAddrCommitCycle = 0;
     curCycleRFReads = 0;
     curCycleIssuedUops = 0;
+    curCycleSlots = 0;
     branchPc = 0;
 
     instrs = uops = bbls = approxInstrs = mispredBranches = 0;
 
+    missLevel = &zinfo->coreMissLevels[l1d->getSourceId()];
+    memStallCycle = 0;
+    memStallComp = CPI_BE_CORE;
+    feBubbleCycles = 0;
+    feBubbleComp = CPI_FE_FETCH;
+#ifdef OOO_CPI_CHECKS
+    haltedSlots = 0;
+    overIssuedSlots = 0;
+#endif
+
     for (uint32_t i = 0; i < FWD_ENTRIES; i++) fwdArray[i].set((Address)(-1L), 0);
 }
 
@@ -113,12 +129,56 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     profIssueStalls.init("issueStalls",  "Issue stalls");  coreStat->append(&profIssueStalls);
 #endif
 
+    profCPIStack.init("cpiStack", "Top-down CPI stack (issue slots; CPI = slots/(instrs*issue width))", CPI_COMPONENTS, cpiStackComponentNames);
+    coreStat->append(&profCPIStack);
+
     parentStat->append(coreStat);
 }
 
 uint64_t OOOCore::getInstrs() const {return instrs;}
 uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
 
+bool OOOCore::getCPIStack(uint64_t* slots) const {
+    for (uint32_t i = 0; i < CPI_COMPONENTS; i++) slots[i] = profCPIStack.count(i);
+    return true;
+}
+
+inline uint32_t OOOCore::closeCycleSlots() {
+    uint32_t slots = MIN(curCycleSlots, (uint32_t)ISSUES_PER_CYCLE);
+#ifdef OOO_CPI_CHECKS
+    overIssuedSlots += curCycleSlots - slots;
+#endif
+    curCycleSlots = 0;
+    return slots;
+}
+
+inline void OOOCore::chargeStall(uint32_t comp, uint64_t cycles) {
+    profCPIStack.inc(comp, ISSUES_PER_CYCLE*cycles - closeCycleSlots());
+}
+
+inline void OOOCore::chargeFrontendStall(uint64_t cycles) {
+    // The first stall cycles after a fetch/mispredict bubble are the bubble's; the rest are the decoder's
+    uint64_t lostSlots = ISSUES_PER_CYCLE*cycles - closeCycleSlots();
+    uint64_t bubbleCycles = MIN(cycles, feBubbleCycles);
+    uint64_t bubbleSlots = MIN(lostSlots, ISSUES_PER_CYCLE*bubbleCycles);
+    feBubbleCycles -= bubbleCycles;
+    if (bubbleSlots) profCPIStack.inc(feBubbleComp, bubbleSlots);
+    if (lostSlots > bubbleSlots) profCPIStack.inc(CPI_FE_DECODE, lostSlots - bubbleSlots);
+}
+
+// Every slot of every unhalted cycle, including the ones used so far in the current cycle, goes to one component,
+// except that uops issued beyond the issue width (see curCycleSlots) add slots of their own
+inline void OOOCore::checkCPIStack() const {
+#ifdef OOO_CPI_CHECKS
+    uint64_t slots = 0;
+    for (uint32_t i = 0; i < CPI_COMPONENTS; i++) slots += profCPIStack.count(i);
+    uint64_t expected = ISSUES_PER_CYCLE*curCycle + curCycleSlots + overIssuedSlots;
+    assert_msg(slots + haltedSlots == expected,
+            "[%s] CPI stack has %ld slots, %ld halted, expected %ld at cycle %ld (%d slots this cycle, %ld over-issued)",
+            name.c_str(), slots, haltedSlots, expected, curCycle, curCycleSlots, overIssuedSlots);
+#endif
+}
+
 void OOOCore::contextSwitch(int32_t gid) {
     if (gid == -1) {
         // Do not execute previous BBL, as we were context-switched
@@ -133,11 +193,13 @@ void OOOCore::contextSwitch(int32_t gid) {
 
 InstrFuncPtrs OOOCore::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
 
-inline void OOOCore::load(Address addr) {
+inline void OOOCore::load(Address addr, Address pc) {
+    loadPcs[loads] = pc;
     loadAddrs[loads++] = addr;
 }
 
-void OOOCore::store(Address addr) {
+void OOOCore::store(Address addr, Address pc) {
+    storePcs[stores] = pc;
     storeAddrs[stores++] = addr;
 }
 
@@ -156,9 +218,11 @@ void OOOCore::branch(Address pc, bool taken, Address takenNpc, Address notTakenN
 }
 
 inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
+    SelfProfScope sps(SPR_CORE);
     if (!prevBbl) {
         // This is the 1st BBL since scheduled, nothing to simulate
         prevBbl = bblInfo;
+        prevBblAddr = bblAddr;
         // Kill lingering ops from previous BBL
         loads = stores = 0;
         return;
@@ -169,6 +233,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
     uint32_t bblInstrs = prevBbl->instrs;
     DynBbl* bbl = &(prevBbl->oooBbl[0]);
     prevBbl = bblInfo;
+    if (unlikely(zinfo->pcProf != nullptr)) zinfo->pcProf->setPC(l1d->getSourceId(), prevBblAddr);
+    prevBblAddr = bblAddr;
 
     uint32_t loadIdx = 0;
     uint32_t storeIdx = 0;
@@ -189,6 +255,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 #ifdef OOO_STALL_STATS
             profDecodeStalls.inc(cdDiff);
 #endif
+            chargeFrontendStall(cdDiff);
             curCycleIssuedUops = 0;
             curCycleRFReads = 0;
             for (uint32_t i = 0; i < cdDiff; i++) insWindow.advancePos(curCycle);
@@ -202,11 +269,13 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
             profIssueStalls.inc();
 #endif
             // info("Advancing due to uop issue width");
+            closeCycleSlots();
             curCycleIssuedUops = 0;
             curCycleRFReads = 0;
             insWindow.advancePos(curCycle);
         }
         curCycleIssuedUops++;
+        curCycleSlots++;
 
         // Kill dependences on invalid register
         // Using curCycle saves us two unpredictable branches in the RF read stalls code
@@ -220,6 +289,10 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         curCycleRFReads += ((c0 < curCycle)? 1 : 0) + ((c1 < curCycle)? 1 : 0);
         if (curCycleRFReads > RF_READS_PER_CYCLE) {
             curCycleRFReads -= RF_READS_PER_CYCLE;
+            // This uop issues in the next cycle, so its slot is not one of this cycle's
+            curCycleSlots--;
+            chargeStall(CPI_BE_CORE, 1);
+            curCycleSlots = 1;
             curCycleIssuedUops = 0;  // or 1? that's probably a 2nd-order detail
             insWindow.advancePos(curCycle);
         }
@@ -238,6 +311,10 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 
         // If we have advanced, we need to reset the curCycle counters
         if (curCycle > c3) {
+            // The IW filled up; blame the outstanding miss if there is one. As above, this uop issues in the new cycle
+            curCycleSlots--;
+            chargeStall((c3 < memStallCycle)? memStallComp : CPI_BE_CORE, curCycle - c3);
+            curCycleSlots = 1;
             curCycleIssuedUops = 0;
             curCycleRFReads = 0;
         }
@@ -265,11 +342,18 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     // Wait for all previous store addresses to be resolved
                     dispatchCycle = MAX(lastStoreAddrCommitCycle+1, dispatchCycle);
 
+                    Address pc = loadPcs[loadIdx];
                     Address addr = loadAddrs[loadIdx++];
                     uint64_t reqSatisfiedCycle = dispatchCycle;
                     if (addr != ((Address)-1L)) {
-                        reqSatisfiedCycle = l1d->load(addr, dispatchCycle) + L1D_LAT;
+                        missLevel->level = 0;
+                        reqSatisfiedCycle = l1d->load(addr, dispatchCycle, pc) + L1D_LAT;
                         cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
+                        uint32_t servedLevel = missLevel->level;
+                        if (servedLevel && reqSatisfiedCycle > memStallCycle) {
+                            memStallCycle = reqSatisfiedCycle;
+                            memStallComp = (servedLevel >= zinfo->numCacheLevels)? CPI_BE_MEM : MIN(CPI_BE_L2 + servedLevel - 1, (uint32_t)CPI_BE_L4);
+                        }
                     }
 
                     // Enforce st-ld forwarding
@@ -304,8 +388,9 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     // Wait for all previous store addresses to be resolved (not just ours :))
                     dispatchCycle = MAX(lastStoreAddrCommitCycle+1, dispatchCycle);
 
+                    Address pc = storePcs[storeIdx];
                     Address addr = storeAddrs[storeIdx++];
-                    uint64_t reqSatisfiedCycle = l1d->store(addr, dispatchCycle) + L1D_LAT;
+                    uint64_t reqSatisfiedCycle = l1d->store(addr, dispatchCycle, pc) + L1D_LAT;
                     cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
 
                     // Fill the forwarding table
@@ -346,6 +431,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 
     instrs += bblInstrs;
     uops += bbl->uops;
+    profCPIStack.inc(CPI_RETIRING, bbl->uops);
+    checkCPIStack();
     bbls++;
     approxInstrs += bbl->approxInstrs;
 
@@ -374,7 +461,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
     uint32_t lineSize = 1 << lineBits;
 
     // Simulate branch prediction
-    if (branchPc && !branchPred.predict(branchPc, branchTaken)) {
+    bool mispred = branchPc && !branchPred.predict(branchPc, branchTaken);
+    if (mispred) {
         mispredBranches++;
 
         /* Simulate wrong-path fetches
@@ -404,7 +492,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         Address wrongPathAddr = branchTaken? branchNotTakenNpc : branchTakenNpc;
         uint64_t reqCycle = fetchCycle;
         for (uint32_t i = 0; i < 5*64/lineSize; i++) {
-            uint64_t fetchLat = l1i->load(wrongPathAddr + lineSize*i, curCycle) - curCycle;
+            uint64_t fetchLat = l1i->load(wrongPathAddr + lineSize*i, curCycle, wrongPathAddr) - curCycle;
             cRec.record(curCycle, curCycle, curCycle + fetchLat);
             uint64_t respCycle = reqCycle + fetchLat;
             if (respCycle > lastCommitCycle) {
@@ -418,6 +506,12 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
     }
     branchPc = 0;  // clear for next BBL
 
+    // Cycles so far belong to the previous bbl; ifetch misses to the current one
+    if (unlikely(zinfo->pcProf != nullptr)) {
+        zinfo->pcProf->tick(l1d->getSourceId(), curCycle);
+        zinfo->pcProf->setPC(l1d->getSourceId(), bblAddr);
+    }
+
     // Simulate current bbl ifetch
     Address endAddr = bblAddr + bblInfo->bytes;
     for (Address fetchAddr = bblAddr; fetchAddr < endAddr; fetchAddr += lineSize) {
@@ -425,7 +519,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         // Do not model fetch throughput limit here, decoder-generated stalls already include it
         // We always call fetches with curCycle to avoid upsetting the weave
         // models (but we could move to a fetch-centric recorder to avoid this)
-        uint64_t fetchLat = l1i->load(fetchAddr, curCycle) - curCycle;
+        uint64_t fetchLat = l1i->load(fetchAddr, curCycle, fetchAddr) - curCycle;
         cRec.record(curCycle, curCycle, curCycle + fetchLat);
         fetchCycle += fetchLat;
     }
@@ -438,6 +532,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 #ifdef OOO_STALL_STATS
         profFetchStalls.inc(decodeCycle - minFetchDecCycle);
 #endif
+        feBubbleCycles = minFetchDecCycle - decodeCycle;
+        feBubbleComp = mispred? CPI_FE_MISPRED : CPI_FE_FETCH;
         decodeCycle = minFetchDecCycle;
     }
 }
@@ -446,6 +542,9 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 void OOOCore::join() {
     DEBUG_MSG("[%s] Joining, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
     uint64_t targetCycle = cRec.notifyJoin(curCycle);
+#ifdef OOO_CPI_CHECKS
+    if (targetCycle > curCycle) haltedSlots += ISSUES_PER_CYCLE*(targetCycle - curCycle) - MIN(curCycleSlots, (uint32_t)ISSUES_PER_CYCLE);
+#endif
     if (targetCycle > curCycle) advance(targetCycle);
     phaseEndCycle = zinfo->globPhaseCycles + zinfo->phaseLength;
     // assert(targetCycle <= phaseEndCycle);
@@ -460,13 +559,20 @@ void OOOCore::leave() {
 void OOOCore::cSimStart() {
     uint64_t targetCycle = cRec.cSimStart(curCycle);
     assert(targetCycle >= curCycle);
-    if (targetCycle > curCycle) advance(targetCycle);
+    if (targetCycle > curCycle) {
+        chargeStall(CPI_CONTENTION, targetCycle - curCycle);
+        advance(targetCycle);
+    }
 }
 
 void OOOCore::cSimEnd() {
     uint64_t targetCycle = cRec.cSimEnd(curCycle);
     assert(targetCycle >= curCycle);
-    if (targetCycle > curCycle) advance(targetCycle);
+    if (targetCycle > curCycle) {
+        chargeStall(CPI_CONTENTION, targetCycle - curCycle);
+        advance(targetCycle);
+    }
+    if (unlikely(zinfo->pcProf != nullptr)) zinfo->pcProf->contentionTick(l1d->getSourceId(), curCycle);
 }
 
 void OOOCore::advance(uint64_t targetCycle) {
@@ -475,6 +581,7 @@ void OOOCore::advance(uint64_t targetCycle) {
     insWindow.longAdvance(curCycle, targetCycle);
     curCycleRFReads = 0;
     curCycleIssuedUops = 0;
+    closeCycleSlots();
     assert(targetCycle == curCycle);
     /* NOTE: Validation with weave mems shows that not advancing internal cycle
      * counters in e.g., the ROB does not change much; consider full-blown
@@ -484,18 +591,18 @@ void OOOCore::advance(uint64_t targetCycle) {
 
 // Pin interface code
 
-void OOOCore::LoadFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->load(addr);}
-void OOOCore::StoreFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->store(addr);}
+void OOOCore::LoadFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {static_cast<OOOCore*>(cores[tid])->load(addr, pc);}
+void OOOCore::StoreFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {static_cast<OOOCore*>(cores[tid])->store(addr, pc);}
 
-void OOOCore::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {
+void OOOCore::PredLoadFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
     OOOCore* core = static_cast<OOOCore*>(cores[tid]);
-    if (pred) core->load(addr);
+    if (pred) core->load(addr, pc);
     else core->predFalseMemOp();
 }
 
-void OOOCore::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {
+void OOOCore::PredStoreFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
     OOOCore* core = static_cast<OOOCore*>(cores[tid]);
-    if (pred) core->store(addr);
+    if (pred) core->store(addr, pc);
     else core->predFalseMemOp();
 }
 
@@ -38,7 +38,11 @@
 // Uncomment to enable stall stats
 // #define OOO_STALL_STATS
 
+// Uncomment to check that the CPI stack accounts for every issue slot (slow: checks on every bbl)
+// #define OOO_CPI_CHECKS
+
 class FilterCache;
+struct CoreMissLevel;
 
 /* 2-level branch predictor:
  *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
@@ -369,10 +373,13 @@ class OOOCore : public Core {
         uint64_t regScoreboard[MAX_REGISTERS]; //contains timestamp of next issue cycles where each reg can be sourced
 
         BblInfo* prevBbl;
+        Address prevBblAddr;
 
         //Record load and store addresses
         Address loadAddrs[256];
         Address storeAddrs[256];
+        Address loadPcs[256];
+        Address storePcs[256];
         uint32_t loads;
         uint32_t stores;
 
@@ -389,6 +396,11 @@ class OOOCore : public Core {
 
         uint32_t curCycleRFReads; //for RF read stalls
         uint32_t curCycleIssuedUops; //for uop issue limits
+        /* Issue slots used in the current cycle, for the CPI stack. A uop that stalls on RF reads or a full IW issues
+         * in the new cycle, so it takes one of its slots, but the issue limit does not count it (curCycleIssuedUops
+         * restarts at 0), so that cycle can issue one uop beyond the issue width. Those extra uops are only retiring.
+         */
+        uint32_t curCycleSlots;
 
         //This would be something like the Atom... (but careful, the iw probably does not allow 2-wide when configured with 1 slot)
         //WindowStructure<1024, 1 /*size*/, 2 /*width*/> insWindow; //this would be something like an Atom, except all the instruction pairing business...
@@ -419,6 +431,18 @@ class OOOCore : public Core {
         Counter profFetchStalls, profDecodeStalls, profIssueStalls;
 #endif
 
+        // CPI stack (see core.h)
+        VectorCounter profCPIStack;
+        CoreMissLevel* missLevel;  // set by caches to the level that served our last access
+        uint64_t memStallCycle;  // completion cycle of the latest-completing L1 miss; backend stalls before it are memory stalls
+        uint32_t memStallComp;  // ...and the component they go to (level that served it)
+        uint64_t feBubbleCycles;  // fetch/mispredict bubble at the end of the last bbl, charged to upcoming decode stalls
+        uint32_t feBubbleComp;
+#ifdef OOO_CPI_CHECKS
+        uint64_t haltedSlots;  // slots of the cycles skipped while halted, which the CPI stack does not cover
+        uint64_t overIssuedSlots;  // uops issued beyond the issue width
+#endif
+
         // Load-store forwarding
         // Just a direct-mapped array of last store cycles to 4B-wide blocks
         // (i.e., indexed by (addr >> 2) & (FWD_ENTRIES-1))
@@ -434,13 +458,14 @@ class OOOCore : public Core {
         OOOCoreRecorder cRec;
 
     public:
-        OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name);
+        OOOCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t domain, g_string& _name);
 
         void initStats(AggregateStat* parentStat);
 
         uint64_t getInstrs() const;
         uint64_t getPhaseCycles() const;
         uint64_t getCycles() const {return cRec.getUnhaltedCycles(curCycle);}
+        bool getCPIStack(uint64_t* slots) const;
 
         void contextSwitch(int32_t gid);
 
@@ -455,8 +480,14 @@ class OOOCore : public Core {
         void cSimEnd();
 
     private:
-        inline void load(Address addr);
-        inline void store(Address addr);
+        // Charges the issue slots lost by advancing curCycle by this many cycles, and starts a new cycle of slots
+        inline void chargeStall(uint32_t comp, uint64_t cycles);
+        inline void chargeFrontendStall(uint64_t cycles);
+        inline uint32_t closeCycleSlots();  // returns the used slots of the current cycle (at most the issue width) and resets them
+        inline void checkCPIStack() const;
+
+        inline void load(Address addr, Address pc);
+        inline void store(Address addr, Address pc);
 
         /* NOTE: Analysis routines cannot touch curCycle directly, must use
          * advance() for long jumps or insWindow.advancePos() for 1-cycle
@@ -476,10 +507,10 @@ class OOOCore : public Core {
 
         inline void bbl(Address bblAddr, BblInfo* bblInfo);
 
-        static void LoadFunc(THREADID tid, ADDRINT addr);
-        static void StoreFunc(THREADID tid, ADDRINT addr);
-        static void PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred);
-        static void PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred);
+        static void LoadFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
+        static void StoreFunc(THREADID tid, ADDRINT addr, ADDRINT pc);
+        static void PredLoadFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred);
+        static void PredStoreFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred);
         static void BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
         static void BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc);
 } ATTR_LINE_ALIGNED;  // Take up an int number of cache lines
@@ -0,0 +1,80 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPT_REPL_POLICY_H_
+#define OPT_REPL_POLICY_H_
+
+#include "repl_policies.h"
+#include "trace_driver.h"
+#include "zsim.h"
+
+/* Belady's OPT. Evicts the line that will be used furthest in the future (invalid and never-reused lines first).
+ * Only works in trace-driven simulation: next uses come from the trace's next-use index (see nextusetrace.cpp),
+ * which the trace driver exposes for the access each child has in flight. Gives an upper bound on hit rate.
+ */
+class OPTReplPolicy : public ReplPolicy {
+    protected:
+        uint64_t* array; //position in the trace of each line's next use
+        uint32_t numLines;
+
+    public:
+        explicit OPTReplPolicy(uint32_t _numLines) : numLines(_numLines) {
+            array = gm_calloc<uint64_t>(numLines);
+        }
+
+        ~OPTReplPolicy() {
+            gm_free(array);
+        }
+
+        void update(uint32_t id, const MemReq* req) {
+            array[id] = zinfo->traceDriver->getNextUse(req->srcId);
+        }
+
+        void replaced(uint32_t id) {
+            array[id] = 0;
+        }
+
+        template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
+            uint32_t bestCand = -1;
+            uint64_t bestScore = 0;
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                uint64_t s = score(*ci);
+                if (bestCand == (uint32_t)-1 || s > bestScore) {
+                    bestCand = *ci;
+                    bestScore = s;
+                }
+            }
+            return bestCand;
+        }
+
+        DECL_RANK_BINDINGS;
+
+    private:
+        inline uint64_t score(uint32_t id) { //higher is more evictable
+            return cc->isValid(id)? array[id] : NEXT_USE_NEVER;
+        }
+};
+
+#endif  // OPT_REPL_POLICY_H_
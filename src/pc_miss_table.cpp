@@ -0,0 +1,49 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pc_miss_table.h"
+
+PCMissTable::PCMissTable(uint32_t _numEntries) : numEntries(_numEntries), validEntries(0), untrackedMisses(0) {
+    assert(numEntries > 0);
+    entries = gm_calloc<Entry>(numEntries);
+}
+
+void PCMissTable::initStats(AggregateStat* parentStat) {
+    AggregateStat* tableStat = new AggregateStat();
+    tableStat->init("missPCs", "Top PCs by GET misses");
+    auto pcStat = makeLambdaVectorStat([this](uint32_t i) { return (i < validEntries)? entries[i].pc : 0; }, numEntries);
+    pcStat->init("pc", "PCs, by decreasing misses");
+    tableStat->append(pcStat);
+    auto missStat = makeLambdaVectorStat([this](uint32_t i) { return (i < validEntries)? entries[i].misses : 0; }, numEntries);
+    missStat->init("misses", "GET misses of each PC (upper bound)");
+    tableStat->append(missStat);
+    auto errStat = makeLambdaVectorStat([this](uint32_t i) { return (i < validEntries)? entries[i].err : 0; }, numEntries);
+    errStat->init("err", "Max overestimation of each PC's misses");
+    tableStat->append(errStat);
+    auto untrackedStat = makeLambdaStat([this]() { return untrackedMisses; });
+    untrackedStat->init("noPC", "GET misses without a PC");
+    tableStat->append(untrackedStat);
+    parentStat->append(tableStat);
+}
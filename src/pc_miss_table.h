@@ -0,0 +1,86 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PC_MISS_TABLE_H_
+#define PC_MISS_TABLE_H_
+
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Top-K table of the PCs that cause the most misses in a cache, in fixed memory (Space-Saving, Metwally et al.).
+ *
+ * The table tracks K PCs. A miss from an untracked PC replaces the PC with the fewest misses, and inherits its count
+ * as an error bound, so the counts of the true top PCs are overestimated by at most err. Entries are kept sorted by
+ * misses (an increment bubbles its entry up past those it overtakes), so the least-missing PC is always the last
+ * entry, and hot PCs are found early in the scan.
+ *
+ * PCs are virtual addresses, so PCs of different processes may alias. Accesses must be serialized by the caller
+ * (caches do it under their own locks).
+ */
+class PCMissTable : public GlobAlloc {
+    private:
+        struct Entry {
+            Address pc;
+            uint64_t misses;
+            uint64_t err;  // misses inherited from the evicted entry, i.e., max overestimation
+        };
+
+        Entry* entries;
+        uint32_t numEntries;
+        uint32_t validEntries;
+        uint64_t untrackedMisses;  // misses with no PC (e.g., requests from cores that do not track it)
+
+    public:
+        explicit PCMissTable(uint32_t _numEntries);
+
+        inline void miss(Address pc) {
+            if (!pc) {
+                untrackedMisses++;
+                return;
+            }
+            uint32_t i = 0;
+            while (i < validEntries && entries[i].pc != pc) i++;
+            if (i == validEntries) {
+                if (validEntries < numEntries) {
+                    entries[validEntries++] = {pc, 0, 0};
+                } else {
+                    i = numEntries - 1;  // least-missing entry
+                    entries[i] = {pc, entries[i].misses, entries[i].misses};
+                }
+            }
+            entries[i].misses++;
+            while (i > 0 && entries[i].misses > entries[i-1].misses) {
+                Entry tmp = entries[i-1];
+                entries[i-1] = entries[i];
+                entries[i] = tmp;
+                i--;
+            }
+        }
+
+        void initStats(AggregateStat* parentStat);
+};
+
+#endif  // PC_MISS_TABLE_H_
@@ -0,0 +1,300 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pc_profiler.h"
+#include <algorithm>
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "log.h"
+
+PCProfiler::PCProfiler(uint32_t _numCores, uint64_t _sampleInterval, uint32_t _topEntries)
+    : numCores(_numCores), sampleInterval(_sampleInterval), topEntries(_topEntries)
+{
+    assert(sampleInterval > 0);
+    cores = gm_memalign<CoreState>(CACHE_LINE_BYTES, numCores);
+    for (uint32_t c = 0; c < numCores; c++) {
+        new (&cores[c]) CoreState();
+        cores[c].curKey = 0;
+        cores[c].nextSampleCycle = sampleInterval;
+    }
+    for (uint32_t l = 0; l < PC_PROF_MAX_LEVELS; l++) levelNames.push_back(g_string(("L" + std::to_string(l + 1)).c_str()));
+}
+
+void PCProfiler::setLevelName(uint32_t level, const char* name) {
+    if (level < PC_PROF_MAX_LEVELS) levelNames[level] = name;
+}
+
+void PCProfiler::sample(CoreState& cs, uint64_t curCycle, bool contention) {
+    uint64_t samples = (curCycle - cs.nextSampleCycle)/sampleInterval + 1;
+    cs.nextSampleCycle += samples*sampleInterval;
+    if (!cs.curKey) return;
+    PCCounters& c = cs.pcs[cs.curKey];
+    c.samples += samples;
+    if (contention) c.contentionSamples += samples;
+}
+
+void PCProfiler::saveProcessMap(const char* outputDir) {
+    std::ifstream in("/proc/self/maps");
+    std::stringstream ss;
+    ss << outputDir << "/zsim-pcprof-maps." << procIdx;
+    std::ofstream out(ss.str().c_str());
+    out << in.rdbuf();
+}
+
+/* Symbolization */
+
+namespace {
+
+struct Mapping {
+    uint64_t start, end, offset;
+    std::string path;
+};
+
+struct Symbol {
+    uint64_t addr, size;
+    std::string name;
+    bool operator<(const Symbol& other) const { return addr < other.addr; }
+};
+
+// Function symbols and loadable segments of an ELF64 file, to translate file offsets to symbols
+class ElfSymbols {
+    private:
+        struct Segment { uint64_t offset, vaddr, size; };
+        std::vector<Segment> segments;
+        std::vector<Symbol> symbols;
+
+    public:
+        explicit ElfSymbols(const std::string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+                close(fd);
+                return;
+            }
+            size_t size = st.st_size;
+            const char* base = (const char*) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED) return;
+
+            const Elf64_Ehdr* eh = (const Elf64_Ehdr*) base;
+            bool valid = memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0 && eh->e_ident[EI_CLASS] == ELFCLASS64 &&
+                eh->e_phoff + eh->e_phnum*sizeof(Elf64_Phdr) <= size && eh->e_shoff + eh->e_shnum*sizeof(Elf64_Shdr) <= size;
+            if (valid) {
+                const Elf64_Phdr* ph = (const Elf64_Phdr*) (base + eh->e_phoff);
+                for (uint32_t i = 0; i < eh->e_phnum; i++) {
+                    if (ph[i].p_type == PT_LOAD) segments.push_back({ph[i].p_offset, ph[i].p_vaddr, ph[i].p_filesz});
+                }
+
+                // Prefer the full symtab; stripped binaries only have dynsym
+                const Elf64_Shdr* sh = (const Elf64_Shdr*) (base + eh->e_shoff);
+                for (uint32_t type : {SHT_SYMTAB, SHT_DYNSYM}) {
+                    for (uint32_t i = 0; i < eh->e_shnum; i++) {
+                        if (sh[i].sh_type != type || sh[i].sh_link >= eh->e_shnum) continue;
+                        const Elf64_Shdr& strSh = sh[sh[i].sh_link];
+                        if (sh[i].sh_offset + sh[i].sh_size > size || strSh.sh_offset + strSh.sh_size > size) continue;
+                        const Elf64_Sym* syms = (const Elf64_Sym*) (base + sh[i].sh_offset);
+                        const char* strs = base + strSh.sh_offset;
+                        for (uint64_t j = 0; j < sh[i].sh_size/sizeof(Elf64_Sym); j++) {
+                            if (ELF64_ST_TYPE(syms[j].st_info) != STT_FUNC || !syms[j].st_value) continue;
+                            if (syms[j].st_name >= strSh.sh_size) continue;
+                            symbols.push_back({syms[j].st_value, syms[j].st_size, demangle(strs + syms[j].st_name)});
+                        }
+                    }
+                    if (!symbols.empty()) break;
+                }
+                std::sort(symbols.begin(), symbols.end());
+            }
+            munmap((void*)base, size);
+        }
+
+        // Returns the function name and offset within it (or false if unknown)
+        bool lookup(uint64_t fileOffset, std::string& name, uint64_t& funcOffset) const {
+            uint64_t vaddr = 0;
+            bool found = false;
+            for (const Segment& s : segments) {
+                if (fileOffset >= s.offset && fileOffset < s.offset + s.size) {
+                    vaddr = s.vaddr + (fileOffset - s.offset);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found || symbols.empty()) return false;
+            auto it = std::upper_bound(symbols.begin(), symbols.end(), Symbol{vaddr, 0, ""});
+            if (it == symbols.begin()) return false;
+            --it;
+            // Symbols with a size must contain the address; sizeless ones (e.g., hand-written asm) match up to the next one
+            if (it->size && vaddr >= it->addr + it->size) return false;
+            name = it->name;
+            funcOffset = vaddr - it->addr;
+            return true;
+        }
+
+    private:
+        static std::string demangle(const char* sym) {
+            int status;
+            char* dm = abi::__cxa_demangle(sym, nullptr, nullptr, &status);
+            if (status != 0 || !dm) return sym;
+            std::string res(dm);
+            free(dm);
+            return res;
+        }
+};
+
+std::vector<Mapping> readMaps(const std::string& file) {
+    std::vector<Mapping> maps;
+    std::ifstream in(file.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+        Mapping m;
+        char perms[8], path[4096];
+        unsigned long start, end, offset;  // NOLINT(runtime/int)
+        path[0] = 0;
+        if (sscanf(line.c_str(), "%lx-%lx %7s %lx %*s %*s %4095s", &start, &end, perms, &offset, path) < 4) continue;
+        if (perms[2] != 'x' || path[0] != '/') continue;  // only executable, file-backed mappings have code
+        m.start = start;
+        m.end = end;
+        m.offset = offset;
+        m.path = path;
+        maps.push_back(m);
+    }
+    return maps;
+}
+
+struct FuncCounters {
+    std::string name;
+    PCProfiler::PCCounters c;
+};
+
+void addCounters(PCProfiler::PCCounters& dst, const PCProfiler::PCCounters& src) {
+    dst.samples += src.samples;
+    dst.contentionSamples += src.contentionSamples;
+    for (uint32_t l = 0; l < PC_PROF_MAX_LEVELS; l++) dst.misses[l] += src.misses[l];
+}
+
+std::string baseName(const std::string& path) {
+    size_t pos = path.rfind('/');
+    return (pos == std::string::npos)? path : path.substr(pos + 1);
+}
+
+}  // namespace
+
+void PCProfiler::writeReport(const char* outputDir) {
+    // Merge all cores
+    std::map<uint64_t, PCCounters> pcs;
+    uint64_t totalSamples = 0;
+    for (uint32_t c = 0; c < numCores; c++) {
+        for (const auto& kv : cores[c].pcs) {
+            addCounters(pcs[kv.first], kv.second);
+            totalSamples += kv.second.samples;
+        }
+    }
+
+    // Symbolize, aggregating by function
+    std::map<uint32_t, std::vector<Mapping>> procMaps;
+    std::map<std::string, ElfSymbols*> elfs;
+    std::map<std::string, FuncCounters> funcs;
+    std::vector<std::pair<std::string, PCCounters>> bbls;
+    for (const auto& kv : pcs) {
+        uint32_t proc = kv.first >> 48;
+        uint64_t pc = kv.first & ((1ul << 48) - 1);
+        if (!procMaps.count(proc)) {
+            std::stringstream ss;
+            ss << outputDir << "/zsim-pcprof-maps." << proc;
+            procMaps[proc] = readMaps(ss.str());
+        }
+
+        std::string func = "[unknown]";
+        std::stringstream loc;
+        loc << "p" << proc << " 0x" << std::hex << pc;
+        for (const Mapping& m : procMaps[proc]) {
+            if (pc < m.start || pc >= m.end) continue;
+            if (!elfs.count(m.path)) elfs[m.path] = new ElfSymbols(m.path);
+            std::string name;
+            uint64_t funcOffset;
+            if (elfs[m.path]->lookup(pc - m.start + m.offset, name, funcOffset)) {
+                func = name + " [" + baseName(m.path) + "]";
+                loc << " " << name << "+0x" << funcOffset;
+            } else {
+                func = "[" + baseName(m.path) + "]";
+            }
+            break;
+        }
+
+        FuncCounters& fc = funcs[func];
+        fc.name = func;
+        addCounters(fc.c, kv.second);
+        bbls.push_back(std::make_pair(loc.str(), kv.second));
+    }
+    for (auto& kv : elfs) delete kv.second;
+
+    std::vector<FuncCounters> sortedFuncs;
+    for (auto& kv : funcs) sortedFuncs.push_back(kv.second);
+    auto bySamples = [](const PCCounters& a, const PCCounters& b) { return a.samples > b.samples; };
+    std::sort(sortedFuncs.begin(), sortedFuncs.end(), [&](const FuncCounters& a, const FuncCounters& b) { return bySamples(a.c, b.c); });
+    std::sort(bbls.begin(), bbls.end(), [&](const std::pair<std::string, PCCounters>& a, const std::pair<std::string, PCCounters>& b) { return bySamples(a.second, b.second); });
+
+    std::stringstream ss;
+    ss << outputDir << "/zsim-pcprof.txt";
+    FILE* f = fopen(ss.str().c_str(), "w");
+    if (!f) {
+        warn("Could not write PC profile to %s", ss.str().c_str());
+        return;
+    }
+
+    auto header = [&](const char* what) {
+        fprintf(f, "%8s %12s %10s", "%samples", "samples", "contention");
+        for (uint32_t l = 0; l < PC_PROF_MAX_LEVELS; l++) fprintf(f, " %10s", (levelNames[l] + " miss").c_str());
+        fprintf(f, "  %s\n", what);
+    };
+    auto row = [&](const PCCounters& c, const std::string& what) {
+        fprintf(f, "%7.2f%% %12ld %10ld", 100.0*c.samples/std::max(totalSamples, 1ul), c.samples, c.contentionSamples);
+        for (uint32_t l = 0; l < PC_PROF_MAX_LEVELS; l++) fprintf(f, " %10ld", c.misses[l]);
+        fprintf(f, "  %s\n", what.c_str());
+    };
+
+    fprintf(f, "# zsim PC profile: %ld samples (1 every %ld cycles per core), %ld PCs, %ld functions\n",
+            totalSamples, sampleInterval, pcs.size(), funcs.size());
+    fprintf(f, "# Contention samples are cycles added by the weave phase, charged to the PC at the end of the phase\n\n");
+    fprintf(f, "# Functions\n");
+    header("function [object]");
+    for (uint32_t i = 0; i < std::min((size_t)topEntries, sortedFuncs.size()); i++) row(sortedFuncs[i].c, sortedFuncs[i].name);
+    fprintf(f, "\n# Basic blocks\n");
+    header("process, PC, function+offset");
+    for (uint32_t i = 0; i < std::min((size_t)topEntries, bbls.size()); i++) row(bbls[i].second, bbls[i].first);
+    fclose(f);
+    info("Wrote PC profile to %s (%ld samples, %ld functions)", ss.str().c_str(), totalSamples, funcs.size());
+}
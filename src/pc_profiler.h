@@ -0,0 +1,109 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PC_PROFILER_H_
+#define PC_PROFILER_H_
+
+/* Sampling profiler of the simulated code, like perf for the simulated system.
+ *
+ * Cores tell the profiler which basic block they are simulating (setPC) and how far their clock has advanced
+ * (tick); every sampleInterval simulated cycles, the current PC gets a sample. Cycles added by the weave phase
+ * (contention) are sampled too, as contention samples of the PC the core was at when the phase ended. Caches count
+ * their GET misses against the PC of the requesting core (MemReq::srcId), by level (0 for L1s, 1 for their
+ * parents, and so on).
+ *
+ * Each core has its own PC table, written only by the thread running on that core. PCs are tagged with the procIdx
+ * of that thread. At the end of the run, every process saves its memory map, and proc 0 symbolizes all PCs through
+ * the ELF symbol tables of the mapped binaries into a per-function hot list (zsim-pcprof.txt).
+ */
+
+#include <stdint.h>
+#include "g_std/g_flat_map.h"
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "zsim.h"
+
+#define PC_PROF_MAX_LEVELS 4
+
+class PCProfiler : public GlobAlloc {
+    public:
+        struct PCCounters {
+            uint64_t samples;
+            uint64_t contentionSamples;  // subset of samples
+            uint64_t misses[PC_PROF_MAX_LEVELS];
+        };
+
+    private:
+        struct CoreState {
+            uint64_t curKey;  // procIdx << 48 | PC of the basic block being simulated, 0 if none
+            uint64_t nextSampleCycle;
+            g_flat_map<uint64_t, PCCounters> pcs;
+            PAD();
+        };
+
+        CoreState* cores;
+        const uint32_t numCores;
+        const uint64_t sampleInterval;
+        const uint32_t topEntries;
+        g_vector<g_string> levelNames;
+
+    public:
+        PCProfiler(uint32_t _numCores, uint64_t _sampleInterval, uint32_t _topEntries);
+
+        void setLevelName(uint32_t level, const char* name);
+
+        inline void setPC(uint32_t cid, Address pc) {
+            if (cid < numCores) cores[cid].curKey = (((uint64_t)procIdx) << 48) | pc;
+        }
+
+        inline void tick(uint32_t cid, uint64_t curCycle) {
+            if (cid < numCores && curCycle >= cores[cid].nextSampleCycle) sample(cores[cid], curCycle, false);
+        }
+
+        // Cycles added by the contention model; sampled as contention
+        inline void contentionTick(uint32_t cid, uint64_t curCycle) {
+            if (cid < numCores && curCycle >= cores[cid].nextSampleCycle) sample(cores[cid], curCycle, true);
+        }
+
+        inline void miss(uint32_t cid, uint32_t level) {
+            if (cid >= numCores || level >= PC_PROF_MAX_LEVELS) return;  // e.g., accesses that do not come from cores
+            CoreState& cs = cores[cid];
+            if (cs.curKey) cs.pcs[cs.curKey].misses[level]++;
+        }
+
+        // Called by every process when it ends, so that proc 0 can symbolize its PCs
+        void saveProcessMap(const char* outputDir);
+
+        // Called by proc 0 once all other processes have ended
+        void writeReport(const char* outputDir);
+
+    private:
+        void sample(CoreState& cs, uint64_t curCycle, bool contention);
+};
+
+#endif  // PC_PROFILER_H_
@@ -148,8 +148,8 @@ ProcStats::ProcStats(AggregateStat* parentStat, AggregateStat* _coreStats) : cor
 
     // Initialize all the buffers
     bufSize = StatSize(coreStats);
-    buf = gm_calloc<uint64_t>(bufSize);
-    lastBuf = gm_calloc<uint64_t>(bufSize);
+    buf = gm_calloc<uint64_t>(bufSize, GM_TAG_STATS);
+    lastBuf = gm_calloc<uint64_t>(bufSize, GM_TAG_STATS);
 
     // Create the procStats
     procStats = new AggregateStat(true);
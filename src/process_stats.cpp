@@ -24,6 +24,7 @@
  */
 
 #include "process_stats.h"
+#include "core.h"
 #include "process_tree.h"
 #include "scheduler.h"
 #include "zsim.h"
@@ -34,6 +35,8 @@ ProcessStats::ProcessStats(AggregateStat* parentStat) {
     processInstrs.resize(maxProcs, 0);
     lastCoreCycles.resize(zinfo->numCores, 0);
     lastCoreInstrs.resize(zinfo->numCores, 0);
+    processCPIStacks.resize(maxProcs*CPI_COMPONENTS, 0);
+    lastCoreCPIStacks.resize(zinfo->numCores*CPI_COMPONENTS, 0);
     lastUpdatePhase = 0;
 
     auto procCyclesLambda = [this](uint32_t p) { return getProcessCycles(p); };
@@ -46,6 +49,17 @@ ProcessStats::ProcessStats(AggregateStat* parentStat) {
 
     parentStat->append(procCyclesStat);
     parentStat->append(procInstrsStat);
+
+    //Per-process CPI stacks, only meaningful for core models that keep them (OOO)
+    AggregateStat* cpiStat = new AggregateStat();
+    cpiStat->init("procCPIStack", "Per-process top-down CPI stacks (issue slots)");
+    for (uint32_t comp = 0; comp < CPI_COMPONENTS; comp++) {
+        auto compLambda = [this, comp](uint32_t p) { return getProcessCPIStack(p, comp); };
+        auto compStat = makeLambdaVectorStat(compLambda, maxProcs);
+        compStat->init(cpiStackComponentNames[comp], "Per-process issue slots");
+        cpiStat->append(compStat);
+    }
+    parentStat->append(cpiStat);
 }
 
 uint64_t ProcessStats::getProcessCycles(uint32_t p) {
@@ -60,6 +74,12 @@ uint64_t ProcessStats::getProcessInstrs(uint32_t p) {
     return processInstrs[p];
 }
 
+uint64_t ProcessStats::getProcessCPIStack(uint32_t p, uint32_t comp) {
+    if (unlikely(lastUpdatePhase != zinfo->numPhases)) update();
+    assert(p*CPI_COMPONENTS + comp < processCPIStacks.size());
+    return processCPIStacks[p*CPI_COMPONENTS + comp];
+}
+
 void ProcessStats::notifyDeschedule(uint32_t cid, uint32_t outgoingPid) {
     assert(cid < lastCoreCycles.size());
     assert(outgoingPid < processCycles.size());
@@ -80,6 +100,15 @@ void ProcessStats::updateCore(uint32_t cid, uint32_t p) {
 
     lastCoreCycles[cid] = cCycles;
     lastCoreInstrs[cid] = cInstrs;
+
+    uint64_t cpiStack[CPI_COMPONENTS];
+    if (zinfo->cores[cid]->getCPIStack(cpiStack)) {
+        for (uint32_t comp = 0; comp < CPI_COMPONENTS; comp++) {
+            uint64_t& last = lastCoreCPIStacks[cid*CPI_COMPONENTS + comp];
+            processCPIStacks[p*CPI_COMPONENTS + comp] += cpiStack[comp] - last;
+            last = cpiStack[comp];
+        }
+    }
 }
 
 void ProcessStats::update() {
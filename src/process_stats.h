@@ -37,6 +37,7 @@ class ProcessStats : public GlobAlloc {
     private:
         g_vector<uint64_t> processCycles, processInstrs;
         g_vector<uint64_t> lastCoreCycles, lastCoreInstrs;
+        g_vector<uint64_t> processCPIStacks, lastCoreCPIStacks; //CPI_COMPONENTS entries per process/core
         uint64_t lastUpdatePhase;
 
     public:
@@ -45,6 +46,7 @@ class ProcessStats : public GlobAlloc {
         // May trigger a global update, should call ONLY when quiesced
         uint64_t getProcessCycles(uint32_t p);
         uint64_t getProcessInstrs(uint32_t p);
+        uint64_t getProcessCPIStack(uint32_t p, uint32_t comp);
 
         // Must be called by scheduler when descheduling; core must be quiesced
         void notifyDeschedule(uint32_t cid, uint32_t outgoingPid);
@@ -272,7 +272,7 @@ void Scheduler::startWatchdogThread() {
 
 // Accurate join-leave implementation
 void Scheduler::syscallLeave(uint32_t pid, uint32_t tid, uint32_t cid, uint64_t pc, int syscallNumber, uint64_t arg0, uint64_t arg1) {
-    futex_lock(&schedLock);
+    SCHED_LOCK(SO_LEAVE);
     uint32_t gid = getGid(pid, tid);
     ThreadInfo* th = contexts[cid].curThread;
     assert(th->gid == gid);
@@ -300,8 +300,8 @@ void Scheduler::syscallLeave(uint32_t pid, uint32_t tid, uint32_t cid, uint64_t
 
 // External interface, must be non-blocking
 void Scheduler::notifyFutexWakeStart(uint32_t pid, uint32_t tid, uint32_t maxWakes) {
-    futex_lock(&schedLock);
-    ThreadInfo* th = gidMap[getGid(pid, tid)];
+    SCHED_LOCK(SO_FUTEX);
+    ThreadInfo* th = getThread(pid, tid);
     DEBUG_FUTEX("[%d/%d] wakeStart max %d", pid, tid, maxWakes);
     assert(th->futexJoin.action == FJA_NONE);
 
@@ -315,21 +315,19 @@ void Scheduler::notifyFutexWakeStart(uint32_t pid, uint32_t tid, uint32_t maxWak
     futex_unlock(&schedLock);
 }
 
+// These two only touch the caller's ThreadInfo, which its join() consumes with schedLock held, so they don't need the
+// lock. The watchdog peeks at futexJoin.action of fake-left threads, but that read was already a heuristic.
 void Scheduler::notifyFutexWakeEnd(uint32_t pid, uint32_t tid, uint32_t wokenUp) {
-    futex_lock(&schedLock);
-    ThreadInfo* th = gidMap[getGid(pid, tid)];
+    ThreadInfo* th = getThread(pid, tid);
     DEBUG_FUTEX("[%d/%d] wakeEnd woken %d", pid, tid, wokenUp);
-    th->futexJoin.action = FJA_WAKE;
     th->futexJoin.wokenUp = wokenUp;
-    futex_unlock(&schedLock);
+    th->futexJoin.action = FJA_WAKE;
 }
 
 void Scheduler::notifyFutexWaitWoken(uint32_t pid, uint32_t tid) {
-    futex_lock(&schedLock);
-    ThreadInfo* th = gidMap[getGid(pid, tid)];
+    ThreadInfo* th = getThread(pid, tid);
     DEBUG_FUTEX("[%d/%d] waitWoken", pid, tid);
     th->futexJoin = {FJA_WAIT, 0, 0};
-    futex_unlock(&schedLock);
 }
 
 // Internal, called with schedLock held
@@ -41,9 +41,18 @@
 #include "intrusive_list.h"
 #include "proc_stats.h"
 #include "process_stats.h"
+#include "profile_stats.h"
 #include "stats.h"
 #include "zsim.h"
 
+// Acquires schedLock and accounts the wait to op. A macro, not a function, so lock profiling keeps per-call-site info
+#define SCHED_LOCK(op) do { \
+    uint64_t lockStartNs = getNs(); \
+    futex_lock(&schedLock); \
+    lockOps.inc(op); \
+    lockWaitNs.inc(op, getNs() - lockStartNs); \
+} while (0)
+
 /**
  * TODO (dsm): This class is due for a heavy pass or rewrite. Some things are more complex than they should:
  * - The OUT state is unnecessary. It is done as a weak link between a thread that left and its context to preserve affinity, but
@@ -103,6 +112,10 @@ class Scheduler : public GlobAlloc, public Callee {
 
             bool markedForSleep; //if true, we will go to sleep on the next leave()
             uint64_t wakeupPhase; //if SLEEPING, when do we have to wake up?
+            uint64_t sleepSeq; //if SLEEPING, breaks wakeupPhase ties in sleepQueue (FIFO)
+            uint32_t sleepIdx; //if SLEEPING, position in sleepQueue
+
+            uint64_t queuedNs; //if QUEUED, when we entered the runQueue
 
             g_vector<bool> mask;
 
@@ -119,6 +132,9 @@ class Scheduler : public GlobAlloc, public Callee {
                 futexWord = 0;
                 markedForSleep = false;
                 wakeupPhase = 0;
+                sleepSeq = 0;
+                sleepIdx = -1;
+                queuedNs = 0;
                 assert(mask.size() == zinfo->numCores);
                 uint32_t count = 0;
                 for (auto b : mask) if (b) count++;
@@ -128,6 +144,77 @@ class Scheduler : public GlobAlloc, public Callee {
             }
         };
 
+        /* Min-heap of SLEEPING threads, ordered by wakeup phase and FIFO among threads with the same wakeup phase.
+         * Threads track their position, so early sleep terminations remove them in O(log n) too.
+         */
+        class SleepQueue {
+            private:
+                g_vector<ThreadInfo*> heap;
+                uint64_t nextSeq;
+
+                static bool before(const ThreadInfo* a, const ThreadInfo* b) {
+                    return (a->wakeupPhase < b->wakeupPhase) || (a->wakeupPhase == b->wakeupPhase && a->sleepSeq < b->sleepSeq);
+                }
+
+                inline void place(uint32_t idx, ThreadInfo* th) {
+                    heap[idx] = th;
+                    th->sleepIdx = idx;
+                }
+
+                void siftUp(uint32_t idx) {
+                    ThreadInfo* th = heap[idx];
+                    while (idx > 0) {
+                        uint32_t parent = (idx - 1)/2;
+                        if (!before(th, heap[parent])) break;
+                        place(idx, heap[parent]);
+                        idx = parent;
+                    }
+                    place(idx, th);
+                }
+
+                void siftDown(uint32_t idx) {
+                    ThreadInfo* th = heap[idx];
+                    uint32_t size = heap.size();
+                    while (true) {
+                        uint32_t child = 2*idx + 1;
+                        if (child >= size) break;
+                        if (child + 1 < size && before(heap[child+1], heap[child])) child++;
+                        if (!before(heap[child], th)) break;
+                        place(idx, heap[child]);
+                        idx = child;
+                    }
+                    place(idx, th);
+                }
+
+            public:
+                SleepQueue() : nextSeq(0) {}
+
+                bool empty() const { return heap.empty(); }
+                size_t size() const { return heap.size(); }
+                ThreadInfo* front() const { return heap.empty()? nullptr : heap[0]; }
+
+                void push(ThreadInfo* th) {
+                    th->sleepSeq = nextSeq++;
+                    heap.push_back(th);
+                    siftUp(heap.size() - 1);
+                }
+
+                void remove(ThreadInfo* th) {
+                    uint32_t idx = th->sleepIdx;
+                    assert(idx < heap.size() && heap[idx] == th);
+                    ThreadInfo* last = heap.back();
+                    heap.pop_back();
+                    th->sleepIdx = -1;
+                    if (idx < heap.size()) {
+                        place(idx, last);
+                        siftUp(idx);
+                        siftDown(last->sleepIdx);
+                    }
+                }
+
+                void pop_front() { remove(heap[0]); }
+        };
+
         struct ContextInfo : InListNode<ContextInfo> {
             uint32_t cid;
             ContextState state;
@@ -141,7 +228,14 @@ class Scheduler : public GlobAlloc, public Callee {
 
         InList<ThreadInfo> runQueue;
         InList<ThreadInfo> outQueue;
-        InList<ThreadInfo> sleepQueue; //contains all the sleeping threads, it is ORDERED by wakeup time
+        SleepQueue sleepQueue; //contains all the sleeping threads, ordered by wakeup time
+
+        /* Per-process shards of gidMap, indexed by tid. Shards are allocated when the process starts its first thread
+         * and never freed, and entries are only written in start() and finish(), with schedLock held. Thus, a thread can
+         * look up its own ThreadInfo without schedLock; this keeps the per-thread sleep and futex notifications, which
+         * only touch the caller's ThreadInfo, off schedLock.
+         */
+        ThreadInfo* volatile** procThreads;
 
         PAD();
         lock_t schedLock;
@@ -162,11 +256,22 @@ class Scheduler : public GlobAlloc, public Callee {
         VectorCounter occHist, runQueueHist;
         uint32_t scheduledThreads;
 
+        //Scheduler latency stats, by the operation that takes schedLock
+        enum SchedOp {SO_JOIN, SO_LEAVE, SO_SYNC, SO_SLEEP, SO_FUTEX, SO_NUM};
+        VectorCounter lockOps, lockWaitNs;
+        Counter queuedNs; //time threads spend in the runQueue waiting for a context
+
         // gid <-> (pid, tid) xlat functions
         inline uint32_t getGid(uint32_t pid, uint32_t tid) const {return (pid << 16) | tid;}
         inline uint32_t getPid(uint32_t gid) const {return gid >> 16;}
         inline uint32_t getTid(uint32_t gid) const {return gid & 0x0FFFF;}
 
+        //Lock-free lookup; only safe for the thread's own gid (or with schedLock held)
+        inline ThreadInfo* getThread(uint32_t pid, uint32_t tid) const {
+            assert(pid < MAX_THREADS && tid < MAX_THREADS && procThreads[pid]);
+            return procThreads[pid][tid];
+        }
+
     public:
         Scheduler(void (*_atSyncFunc)(void), uint32_t _parallelThreads, uint32_t _numCores, uint32_t _schedQuantum) :
             atSyncFunc(_atSyncFunc), bar(_parallelThreads, this), numCores(_numCores), schedQuantum(_schedQuantum), rnd(0x5C73D9134)
@@ -179,6 +284,7 @@ class Scheduler : public GlobAlloc, public Callee {
                 freeList.push_back(&contexts[i]);
             }
             schedLock = 0;
+            futex_prof_name(&schedLock, "schedLock");
             //nextVictim = 0; //only used when freeList is empty.
             curPhase = 0;
             scheduledThreads = 0;
@@ -187,6 +293,7 @@ class Scheduler : public GlobAlloc, public Callee {
             unmatchedFutexWakeups = 0;
 
             blockingSyscalls.resize(MAX_THREADS /* TODO: max # procs */);
+            procThreads = gm_calloc<ThreadInfo* volatile*>(MAX_THREADS /* TODO: max # procs */);
 
             info("Started RR scheduler, quantum=%d phases", schedQuantum);
             terminateWatchdogThread = false;
@@ -209,6 +316,10 @@ class Scheduler : public GlobAlloc, public Callee {
             occHist.init("occHist", "Occupancy histogram", numCores+1); schedStats->append(&occHist);
             uint32_t runQueueHistSize = ((numCores > 16)? numCores : 16) + 1;
             runQueueHist.init("rqSzHist", "Run queue size histogram", runQueueHistSize); schedStats->append(&runQueueHist);
+            lockOps.init("lockOps", "schedLock acquisitions by operation (join, leave, sync, sleep, futex)", SO_NUM); schedStats->append(&lockOps);
+            lockWaitNs.init("lockWaitNs", "Time (ns) waiting for schedLock by operation (join, leave, sync, sleep, futex)", SO_NUM); schedStats->append(&lockWaitNs);
+            queuedNs.init("queuedNs", "Time (ns) threads spend in the run queue waiting for a context"); schedStats->append(&queuedNs);
+            bar.initStats(schedStats);
             parentStat->append(schedStats);
         }
 
@@ -222,7 +333,11 @@ class Scheduler : public GlobAlloc, public Callee {
             // - SYS_getpid because after a fork (where zsim calls ThreadStart),
             //   getpid() returns the parent's pid (getpid() caches, and I'm
             //   guessing it hasn't flushed its cached pid at this point)
-            gidMap[gid] = new ThreadInfo(gid, syscall(SYS_getpid), syscall(SYS_gettid), mask);
+            ThreadInfo* th = new ThreadInfo(gid, syscall(SYS_getpid), syscall(SYS_gettid), mask);
+            gidMap[gid] = th;
+            assert(pid < MAX_THREADS && tid < MAX_THREADS);
+            if (!procThreads[pid]) procThreads[pid] = gm_calloc<ThreadInfo*>(MAX_THREADS);
+            procThreads[pid][tid] = th;
             threadsCreated.inc();
             futex_unlock(&schedLock);
         }
@@ -234,6 +349,7 @@ class Scheduler : public GlobAlloc, public Callee {
             assert((gidMap.find(gid) != gidMap.end()));
             ThreadInfo* th = gidMap[gid];
             gidMap.erase(gid);
+            procThreads[pid][tid] = nullptr;
 
             // Check for suppressed syscall leave(), execute it
             if (th->fakeLeave) {
@@ -272,7 +388,7 @@ class Scheduler : public GlobAlloc, public Callee {
         }
 
         uint32_t join(uint32_t pid, uint32_t tid) {
-            futex_lock(&schedLock);
+            SCHED_LOCK(SO_JOIN);
             //If leave was in this phase, call bar.join()
             //Otherwise, try to grab a free context; if all are taken, queue up
             uint32_t gid = getGid(pid, tid);
@@ -319,6 +435,7 @@ class Scheduler : public GlobAlloc, public Callee {
                     bar.join(th->cid, &schedLock); //releases lock
                 } else {
                     th->state = QUEUED;
+                    th->queuedNs = getNs();
                     runQueue.push_back(th);
                     waitForContext(th); //releases lock, might join
                 }
@@ -328,13 +445,14 @@ class Scheduler : public GlobAlloc, public Callee {
         }
 
         void leave(uint32_t pid, uint32_t tid, uint32_t cid) {
-            futex_lock(&schedLock);
+            SCHED_LOCK(SO_LEAVE);
             //Just call bar.leave
             uint32_t gid = getGid(pid, tid);
             ThreadInfo* th = contexts[cid].curThread;
             assert(th->gid == gid);
             assert(th->state == RUNNING);
             zinfo->cores[cid]->leave();
+            bar.wakeChildren(cid); //no-op unless we were released but died before waking our part of the batch
 
             if (th->markedForSleep) { //transition to SLEEPING, eagerly deschedule
                 trace(Sched, "Sched: %d going to SLEEP, wakeup on phase %ld", gid, th->wakeupPhase);
@@ -342,17 +460,8 @@ class Scheduler : public GlobAlloc, public Callee {
                 ContextInfo* ctx = &contexts[cid];
                 deschedule(th, ctx, SLEEPING);
 
-                //Ordered insert into sleepQueue
-                if (sleepQueue.empty() || sleepQueue.front()->wakeupPhase > th->wakeupPhase) {
-                    sleepQueue.push_front(th);
-                } else {
-                    ThreadInfo* cur = sleepQueue.front();
-                    while (cur->next && cur->next->wakeupPhase <= th->wakeupPhase) {
-                        cur = cur->next;
-                    }
-                    trace(Sched, "Put %d in sleepQueue (deadline %ld), after %d (deadline %ld)", gid, th->wakeupPhase, cur->gid, cur->wakeupPhase);
-                    sleepQueue.insertAfter(cur, th);
-                }
+                sleepQueue.push(th);
+                trace(Sched, "Put %d in sleepQueue (deadline %ld), %ld sleeping", gid, th->wakeupPhase, sleepQueue.size());
                 sleepEvents.inc();
 
                 ThreadInfo* inTh = schedContext(ctx);
@@ -387,7 +496,7 @@ class Scheduler : public GlobAlloc, public Callee {
         }
 
         uint32_t sync(uint32_t pid, uint32_t tid, uint32_t cid) {
-            futex_lock(&schedLock);
+            SCHED_LOCK(SO_SYNC);
             ThreadInfo* th = contexts[cid].curThread;
             assert(!th->markedForSleep);
             bar.sync(cid, &schedLock); //releases lock, may trigger end of phase, may block us
@@ -464,30 +573,35 @@ class Scheduler : public GlobAlloc, public Callee {
             }
         }
 
+        //Lock-free: only touches the caller's ThreadInfo, which the caller's leave() reads with schedLock held
         volatile uint32_t* markForSleep(uint32_t pid, uint32_t tid, uint64_t wakeupPhase) {
-            futex_lock(&schedLock);
-            uint32_t gid = getGid(pid, tid);
-            trace(Sched, "%d marking for sleep", gid);
-            ThreadInfo* th = gidMap[gid];
+            trace(Sched, "%d marking for sleep", getGid(pid, tid));
+            ThreadInfo* th = getThread(pid, tid);
             assert(!th->markedForSleep);
             th->markedForSleep = true;
             th->wakeupPhase = wakeupPhase;
             th->futexWord = 1; //to avoid races, this must be set here.
-            futex_unlock(&schedLock);
             return &(th->futexWord);
         }
 
+        //Lock-free: a snapshot of our state, which may change as soon as we return anyway. Only for the caller's own
+        //thread; use isSleepingLocked() for others
         bool isSleeping(uint32_t pid, uint32_t tid) {
+            ThreadInfo* th = getThread(pid, tid);
+            return th->state == SLEEPING;
+        }
+
+        //Locked variant, for threads other than the caller's (e.g., the watchdog cleaning up a dead process)
+        bool isSleepingLocked(uint32_t pid, uint32_t tid) {
             futex_lock(&schedLock);
-            uint32_t gid = getGid(pid, tid);
-            ThreadInfo* th = gidMap[gid];
+            ThreadInfo* th = getThread(pid, tid);
             bool res = th->state == SLEEPING;
             futex_unlock(&schedLock);
             return res;
         }
 
         void notifySleepEnd(uint32_t pid, uint32_t tid) {
-            futex_lock(&schedLock);
+            SCHED_LOCK(SO_SLEEP);
             uint32_t gid = getGid(pid, tid);
             ThreadInfo* th = gidMap[gid];
             assert(th->markedForSleep == false);
@@ -503,11 +617,7 @@ class Scheduler : public GlobAlloc, public Callee {
         }
 
         void printThreadState(uint32_t pid, uint32_t tid) {
-            futex_lock(&schedLock);
-            uint32_t gid = getGid(pid, tid);
-            ThreadInfo* th = gidMap[gid];
-            info("[%d] is in scheduling state %d", tid, th->state);
-            futex_unlock(&schedLock);
+            info("[%d] is in scheduling state %d", tid, getThread(pid, tid)->state);
         }
 
         void notifyTermination() {
@@ -536,7 +646,7 @@ class Scheduler : public GlobAlloc, public Callee {
 
             if (doomedTids.size()) {
                 for (uint32_t tid : doomedTids) {
-                    if (isSleeping(pid, tid)) {
+                    if (isSleepingLocked(pid, tid)) {
                         notifySleepEnd(pid, tid);
                     }
                     finish(pid, tid);
@@ -604,6 +714,7 @@ class Scheduler : public GlobAlloc, public Callee {
             assert(th->state == STARTED || th->state == BLOCKED || th->state == QUEUED);
             assert(ctx->state == IDLE);
             assert(ctx->curThread == nullptr);
+            if (th->state == QUEUED) queuedNs.inc(getNs() - th->queuedNs);
             th->state = RUNNING;
             th->cid = ctx->cid;
             ctx->state = USED;
@@ -622,6 +733,7 @@ class Scheduler : public GlobAlloc, public Callee {
             assert(targetState == BLOCKED || targetState == QUEUED || targetState == SLEEPING);
             if (zinfo->procStats) zinfo->procStats->notifyDeschedule();  // FIXME: Interface
             th->state = targetState;
+            if (targetState == QUEUED) th->queuedNs = getNs();
             ctx->state = IDLE;
             ctx->curThread = nullptr;
             scheduledThreads--;
@@ -0,0 +1,116 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "self_prof.h"
+#include <algorithm>
+#include "pin.H"
+#include "rdtsc.h"
+#include "stats.h"
+
+static const char* regionNames[] = {"cache", "core", "weave", "barrier", "stats"};
+static_assert(sizeof(regionNames)/sizeof(regionNames[0]) == SPR_NUM_REGIONS, "Missing region names");
+
+/* Static, so each process has its own map from Pin thread id (internal threads have one too) to thread state. Pin
+ * tools cannot use native TLS, and PIN_ThreadId() is cheaper than Pin's TLS API.
+ */
+SelfProfiler::ThreadState* SelfProfiler::localStates[MAX_THREADS];
+
+SelfProfiler::SelfProfiler() {
+    futex_init(&threadsLock);
+}
+
+void SelfProfiler::initStats(AggregateStat* parentStat) {
+    AggregateStat* profStat = new AggregateStat();
+    profStat->init("selfProf", "Simulator host time breakdown by component (rdtsc cycles, exclusive of nested regions)");
+    for (uint32_t r = 0; r < SPR_NUM_REGIONS; r++) {
+        AggregateStat* regionStat = new AggregateStat();
+        regionStat->init(regionNames[r], "Region stats");
+        auto cyclesStat = makeLambdaStat([this, r]() { return sumThreads(&ThreadState::cycles, r); });
+        cyclesStat->init("cycles", "Host cycles spent in region, summed over host threads");
+        regionStat->append(cyclesStat);
+        auto callsStat = makeLambdaStat([this, r]() { return sumThreads(&ThreadState::calls, r); });
+        callsStat->init("calls", "Times the region was entered");
+        regionStat->append(callsStat);
+        profStat->append(regionStat);
+    }
+    auto threadsStat = makeLambdaStat([this]() {
+        futex_lock(&threadsLock);
+        uint64_t n = threads.size();
+        futex_unlock(&threadsLock);
+        return n;
+    });
+    threadsStat->init("threads", "Host threads that entered a profiled region");
+    profStat->append(threadsStat);
+    parentStat->append(profStat);
+}
+
+// Threads may register (and reallocate threads) while stats are dumped, so walk it under threadsLock
+uint64_t SelfProfiler::sumThreads(uint64_t (ThreadState::*counts)[SPR_NUM_REGIONS], uint32_t region) {
+    uint64_t sum = 0;
+    futex_lock(&threadsLock);
+    for (ThreadState* ts : threads) sum += (ts->*counts)[region];
+    futex_unlock(&threadsLock);
+    return sum;
+}
+
+SelfProfiler::ThreadState* SelfProfiler::getThreadState() {
+    THREADID tid = PIN_ThreadId();
+    if (unlikely(tid >= MAX_THREADS)) return nullptr;  // includes INVALID_THREADID
+    ThreadState* ts = localStates[tid];
+    if (unlikely(!ts)) {
+        ts = gm_calloc<ThreadState>();
+        futex_lock(&threadsLock);
+        threads.push_back(ts);
+        futex_unlock(&threadsLock);
+        localStates[tid] = ts;
+    }
+    return ts;
+}
+
+void SelfProfiler::enter(SelfProfRegion region) {
+    ThreadState* ts = getThreadState();
+    if (!ts) return;
+    uint64_t curTsc = rdtsc();
+    if (ts->depth) ts->cycles[ts->stack[std::min(ts->depth, (uint32_t)SELF_PROF_MAX_DEPTH) - 1]] += curTsc - ts->lastTsc;
+    if (ts->depth < SELF_PROF_MAX_DEPTH) ts->stack[ts->depth] = region;
+    ts->depth++;
+    ts->calls[region]++;
+    ts->lastTsc = curTsc;
+}
+
+void SelfProfiler::leave(SelfProfRegion region) {
+    ThreadState* ts = getThreadState();
+    if (!ts || !ts->depth) return;  // e.g., a thread that was profiled before forking
+    uint64_t curTsc = rdtsc();
+    uint32_t top = std::min(ts->depth, (uint32_t)SELF_PROF_MAX_DEPTH) - 1;
+    assert(ts->depth > SELF_PROF_MAX_DEPTH || ts->stack[top] == region);
+    ts->cycles[ts->stack[top]] += curTsc - ts->lastTsc;
+    ts->depth--;
+    ts->lastTsc = curTsc;
+}
+
+void SelfProfiler::forkReset() {
+    for (uint32_t i = 0; i < MAX_THREADS; i++) localStates[i] = nullptr;
+}
@@ -0,0 +1,102 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SELF_PROF_H_
+#define SELF_PROF_H_
+
+/* Host-time self-profiler, to find which simulator component makes a run slow without rebuilding for perf.
+ *
+ * Regions of interest are wrapped in SelfProfScope objects. When enabled (sim.selfProfile), each host thread charges
+ * the rdtsc cycles it spends to the innermost region it is in, so nested regions (e.g., an L1 access that calls the
+ * L2, or a stats dump triggered at the barrier) are not double-counted. Each host thread has its own counters, so
+ * there is no sharing; stats (root.selfProf) sum them at dump time. When disabled, a scope costs a load and a branch.
+ */
+
+#include <stdint.h>
+#include "constants.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "log.h"
+#include "zsim.h"
+
+enum SelfProfRegion {
+    SPR_CACHE,      // Cache and TimingCache accesses (bound phase)
+    SPR_CORE,       // OOOCore::bbl, excluding the cache accesses it issues
+    SPR_WEAVE,      // ContentionSim::simulatePhaseThread
+    SPR_BARRIER,    // waiting at the phase barrier, plus end-of-phase work not in other regions
+    SPR_STATS,      // stats dumps
+    SPR_NUM_REGIONS
+};
+
+#define SELF_PROF_MAX_DEPTH 16
+
+class AggregateStat;
+
+class SelfProfiler : public GlobAlloc {
+    private:
+        struct ThreadState {
+            uint64_t cycles[SPR_NUM_REGIONS];  // exclusive
+            uint64_t calls[SPR_NUM_REGIONS];
+            uint64_t lastTsc;
+            uint32_t depth;
+            uint8_t stack[SELF_PROF_MAX_DEPTH];  // deeper regions are charged to the deepest tracked one
+        };
+
+        g_vector<ThreadState*> threads;  // from all processes, for stats
+        static ThreadState* localStates[MAX_THREADS];  // process-local, indexed by Pin thread id
+        lock_t threadsLock;
+
+    public:
+        SelfProfiler();
+        void initStats(AggregateStat* parentStat);
+
+        void enter(SelfProfRegion region);
+        void leave(SelfProfRegion region);
+
+        // Called in forked children, which must not share their parent's thread states
+        void forkReset();
+
+    private:
+        ThreadState* getThreadState();
+        uint64_t sumThreads(uint64_t (ThreadState::*counts)[SPR_NUM_REGIONS], uint32_t region);
+};
+
+class SelfProfScope {
+    private:
+        SelfProfiler* const prof;
+        const SelfProfRegion region;
+
+    public:
+        explicit SelfProfScope(SelfProfRegion r) : prof(zinfo->selfProf), region(r) {
+            if (unlikely(prof != nullptr)) prof->enter(region);
+        }
+
+        ~SelfProfScope() {
+            if (unlikely(prof != nullptr)) prof->leave(region);
+        }
+};
+
+#endif  // SELF_PROF_H_
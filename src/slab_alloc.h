@@ -126,7 +126,7 @@ class SlabAlloc {
                 assert(curSlab);
             } else {
                 assert(sizeof(Slab) == SLAB_SIZE);
-                curSlab = gm_memalign<Slab>(sizeof(Slab));
+                curSlab = gm_memalign<Slab>(sizeof(Slab), 1, GM_TAG_EVENTS);
                 assert((((uintptr_t)curSlab) & SLAB_MASK) == (uintptr_t)curSlab);
                 curSlab->init(this);  // NOTE: Slab is POD
             }
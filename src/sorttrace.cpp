@@ -23,95 +23,300 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Simple program to sort a trace. It reads in the trace sequntially until it
- * has seen at least one access from every thread, then dumps the sorted trace
- * out. This may consume large amounts of memory if traces are largely
- * imbalanced. A simple way to fix this would be to dump N separate traces,
- * then join them together --- that's more I/O though.
+/* Program to sort a trace by request cycle, using a parallel external merge
+ * sort so that memory use is bounded regardless of trace size or imbalance:
+ *  1. The trace is read in fixed-size runs. Batches of runs are sorted in
+ *     parallel (one thread per run), and each sorted run is spilled to a
+ *     temporary file.
+ *  2. Runs are merged with a loser tree (k-way tournament), which needs a
+ *     single comparison per tree level for each record written. To stay
+ *     within the open file limit, at most MAX_FAN_IN runs are merged at a
+ *     time; if there are more, consecutive groups are merged into longer
+ *     runs first, in as many passes as needed.
+ * The sort is stable: accesses with the same cycle keep their trace order.
+ * Temporary files are removed on exit, including on panics.
  */
 
-#include <deque>
-#include <queue>
+#include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "access_tracing.h"
+#include "bithacks.h"
 #include "galloc.h"
 
 using namespace std;
 
-void printProgress(uint64_t read, uint64_t written, uint64_t total) {
-    printf("Read %3ld%% / Written %3ld%%\r", read*100/total, written*100/total);
+#define MAX_FAN_IN 256
+
+// Temporary run files that exist; removed on exit. Only the main thread changes this
+static vector<string> tmpFiles;
+
+static void removeTmpFiles() {
+    for (const string& f : tmpFiles) unlink(f.c_str());
+}
+
+static string createTmpFile(const string& tmpDir) {
+    string path = tmpDir + "/sorttrace.XXXXXX";
+    vector<char> tmpl(path.begin(), path.end());
+    tmpl.push_back(0);
+    int fd = mkstemp(tmpl.data());
+    if (fd == -1) panic("Could not create temporary run file in %s", tmpDir.c_str());
+    close(fd);
+    tmpFiles.push_back(tmpl.data());
+    return tmpl.data();
+}
+
+static void removeTmpFile(const string& fname) {
+    unlink(fname.c_str());
+    tmpFiles.erase(find(tmpFiles.begin(), tmpFiles.end(), fname));
+}
+
+void printProgress(const char* phase, uint64_t done, uint64_t total) {
+    printf("%s %3ld%%\r", phase, total? done*100/total : 100);
     fflush(stdout);
 }
 
-int main(int argc, const char* argv[]) {
+/* Tournament tree of losers over k leaves (leaf i at node k+i). Each internal node holds the loser of the match
+ * played there, and node 0 holds the overall winner. After the winner's leaf changes, replay() fixes the path up
+ * to the root, which only compares against the stored losers.
+ */
+template <typename Less>
+class LoserTree {
+    private:
+        vector<uint32_t> tree;
+        uint32_t k;
+        Less less;
+
+        uint32_t build(uint32_t node) {
+            if (node >= k) return node - k;
+            uint32_t a = build(2*node);
+            uint32_t b = build(2*node + 1);
+            if (less(b, a)) {
+                tree[node] = a;
+                return b;
+            } else {
+                tree[node] = b;
+                return a;
+            }
+        }
+
+    public:
+        LoserTree(uint32_t _k, Less _less) : tree(_k), k(_k), less(_less) {
+            assert(k > 0);
+            tree[0] = (k > 1)? build(1) : 0;
+        }
+
+        inline uint32_t top() const {return tree[0];}
+
+        inline void replay(uint32_t leaf) {
+            uint32_t winner = leaf;
+            for (uint32_t n = (leaf + k)/2; n > 0; n /= 2) {
+                if (less(tree[n], winner)) swap(tree[n], winner);
+            }
+            tree[0] = winner;
+        }
+};
+
+class RunReader {
+    private:
+        FILE* f;
+        vector<PackedAccessRecord> buf;
+        uint64_t cur;
+        uint64_t max;
+
+    public:
+        RunReader(const string& fname, uint64_t bufRecords) : buf(bufRecords), cur(0), max(0) {
+            f = fopen(fname.c_str(), "r");
+            if (!f) panic("Could not open run file %s", fname.c_str());
+            fill();
+        }
+
+        ~RunReader() {
+            fclose(f);
+        }
+
+        inline bool empty() const {return cur == max;}
+        inline const PackedAccessRecord& head() const {return buf[cur];}
+
+        inline void pop() {
+            cur++;
+            if (cur == max) fill();
+        }
+
+    private:
+        void fill() {
+            cur = 0;
+            max = fread(&buf[0], sizeof(PackedAccessRecord), buf.size(), f);
+        }
+};
+
+// stable_sort allocates a temporary buffer as large as the run, which the memory budget accounts for
+static void sortAndSpill(vector<PackedAccessRecord>* run, const string& fname) {
+    stable_sort(run->begin(), run->end(), [](const PackedAccessRecord& a, const PackedAccessRecord& b) {
+        return a.reqCycle < b.reqCycle;
+    });
+    FILE* f = fopen(fname.c_str(), "w");
+    if (!f) panic("Could not create run file %s", fname.c_str());
+    size_t written = fwrite(&(*run)[0], sizeof(PackedAccessRecord), run->size(), f);
+    if (written != run->size()) panic("Could not write run file %s (disk full?)", fname.c_str());
+    fclose(f);
+}
+
+/* Merges runs, calling emit(record) in order. Exhausted runs sort last, and ties go to the earlier run, which keeps
+ * the sort stable as long as runs are passed in trace order.
+ */
+template <typename Emit>
+static void mergeRuns(const vector<string>& runFiles, uint64_t bufRecords, Emit emit) {
+    uint32_t numRuns = runFiles.size();
+    assert(numRuns && numRuns <= MAX_FAN_IN);
+    vector<RunReader*> readers;
+    for (const string& f : runFiles) readers.push_back(new RunReader(f, bufRecords));
+
+    auto less = [&readers](uint32_t a, uint32_t b) {
+        if (readers[a]->empty()) return false;
+        if (readers[b]->empty()) return true;
+        uint64_t ca = readers[a]->head().reqCycle;
+        uint64_t cb = readers[b]->head().reqCycle;
+        return (ca < cb) || (ca == cb && a < b);
+    };
+    LoserTree<decltype(less)> lt(numRuns, less);
+
+    while (true) {
+        uint32_t r = lt.top();
+        if (readers[r]->empty()) break; //the winner is only exhausted if all runs are
+        emit(readers[r]->head());
+        readers[r]->pop();
+        lt.replay(r);
+    }
+    for (RunReader* rr : readers) delete rr;
+}
+
+int main(int argc, char* argv[]) {
     InitLog(""); //no log header
-    if (argc != 3) {
+
+    uint32_t numThreads = MAX(1u, thread::hardware_concurrency());
+    uint64_t memMB = 1024;
+    string tmpDir = "";
+    int c;
+    while ((c = getopt(argc, argv, "j:m:t:")) != -1) {
+        switch (c) {
+            case 'j': numThreads = strtoul(optarg, nullptr, 0); break;
+            case 'm': memMB = strtoul(optarg, nullptr, 0); break;
+            case 't': tmpDir = optarg; break;
+            default: argc = 0; //print usage
+        }
+    }
+
+    if (argc - optind != 2 || numThreads == 0 || memMB == 0) {
         info("Sorts an access trace");
-        info("Usage: %s <input_trace> <output_trace>", argv[0]);
+        info("Usage: %s [-j <threads>] [-m <memory MB>] [-t <tmp dir>] <input_trace> <output_trace>", argv[0]);
+        info("  -j: sorting threads (default: all cores)");
+        info("  -m: memory budget for runs and merge buffers (default: 1024 MB)");
+        info("  -t: directory for temporary run files (default: the output trace's)");
         exit(1);
     }
+    const char* inFile = argv[optind];
+    const char* outFile = argv[optind+1];
+    if (tmpDir == "") {
+        string out = outFile;
+        size_t slash = out.rfind('/');
+        tmpDir = (slash == string::npos)? "." : out.substr(0, slash);
+    }
 
-    gm_init(32<<20 /*32 MB --- should be enough*/);
+    if (atexit(removeTmpFiles)) panic("Could not register exit handler");
+    gm_init(32<<20 /*32 MB --- should be enough, run buffers are not in the global heap*/);
 
-    AccessTraceReader* tr = new AccessTraceReader(argv[1]);
+    AccessTraceReader* tr = new AccessTraceReader(inFile);
     uint32_t numChildren = tr->getNumChildren();
-    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren);
-
-    deque<AccessRecord>* accs[numChildren];  // null if the child has no accesses
-    for (uint32_t i = 0; i < numChildren; i++) accs[i] = nullptr;
-    priority_queue< pair<int64_t, uint32_t> > heads; //(negative cycle, child); we use negative cycles because priority_queue sorts from largest to smallest
-    uint64_t readRecords  = 0;
-    uint64_t writtenRecords  = 0;
-    uint64_t totalRecords  = tr->getNumRecords();
-    info("Sorting %ld records", totalRecords);
-
-    while (!tr->empty() || heads.size() > 0) {
-        if (!tr->empty() && heads.size() < numChildren) { //Read trace until all heads are filled
-            for (uint32_t i = 0; i < 1024; i++) { //For performance, read at least a few accesses
+    uint64_t totalRecords = tr->getNumRecords();
+    // Each thread holds a run and stable_sort's equally large buffer
+    uint64_t runRecords = MAX((uint64_t)1024, (memMB << 20)/(2*numThreads*sizeof(PackedAccessRecord)));
+    info("Sorting %ld records, %d threads, %ld records/run", totalRecords, numThreads, runRecords);
+
+    // Phase 1: read, sort and spill runs, numThreads at a time
+    vector<string> runFiles;
+    vector< vector<PackedAccessRecord> > runs(numThreads);
+    uint64_t readRecords = 0;
+    while (!tr->empty()) {
+        uint32_t batchRuns = 0;
+        while (batchRuns < numThreads && !tr->empty()) {
+            vector<PackedAccessRecord>& run = runs[batchRuns++];
+            run.clear();
+            run.reserve(MIN(runRecords, totalRecords - readRecords)); //growing by doubling would overshoot the budget
+            while (run.size() < runRecords && !tr->empty()) {
                 AccessRecord acc = tr->read();
-                readRecords++;
-                if ((readRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-                if (!accs[acc.childId]) {
-                    accs[acc.childId] = new deque<AccessRecord>();
-                    heads.push(make_pair(-acc.reqCycle, acc.childId));
-                }
-                accs[acc.childId]->push_back(acc);
-                if (tr->empty()) break;
+                run.push_back({acc.lineAddr, acc.reqCycle, acc.latency, (uint16_t) acc.childId, (uint16_t) acc.type});
+                if ((++readRecords % (1024*1024)) == 0) printProgress("Sorting runs", readRecords, totalRecords);
             }
         }
 
-        assert(heads.size() <= numChildren);
-
-        while (heads.size() == numChildren || (tr->empty() && heads.size() > 0)) {
-            pair<int64_t, uint32_t> next = heads.top();
-            //info("pre %ld %d %ld", heads.size(), next.second, next.first);
-            heads.pop();
-            //info("post %ld %d %ld", heads.size(), heads.top().second, heads.top().first);
-            uint32_t child = next.second;
-            assert(!accs[child]->empty());
-            AccessRecord acc = accs[child]->front();
-            accs[child]->pop_front();
-            tw->write(acc);
-            writtenRecords++;
-            if ((writtenRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-            if (accs[child]->empty()) {
-                delete accs[child];
-                accs[child] = nullptr;
-            } else {
-                AccessRecord acc = accs[child]->front();
-                heads.push(make_pair(-acc.reqCycle, acc.childId));
-            }
-        }
+        vector<thread> sorters;
+        for (uint32_t i = 0; i < batchRuns; i++) runFiles.push_back(createTmpFile(tmpDir));
+        for (uint32_t i = 0; i < batchRuns; i++) sorters.push_back(thread(sortAndSpill, &runs[i], runFiles[runFiles.size() - batchRuns + i]));
+        for (thread& t : sorters) t.join();
     }
-    printProgress(readRecords, writtenRecords, totalRecords);
+    printProgress("Sorting runs", readRecords, totalRecords);
     printf("\n");
-    assert(readRecords == writtenRecords);
     assert(readRecords == totalRecords);
-
     delete tr;
+    runs.clear();
+    runs.shrink_to_fit();
+
+    // Phase 2: merge groups of up to MAX_FAN_IN consecutive runs until few enough remain, then merge those into the
+    // output; split the memory budget across run buffers
+    uint64_t mergeBufs = MIN((uint64_t)runFiles.size(), (uint64_t)MAX_FAN_IN) + 1; //+1 for intermediate passes' output
+    uint64_t bufRecords = MAX((uint64_t)4096, (memMB << 20)/(mergeBufs*sizeof(PackedAccessRecord)));
+    vector<PackedAccessRecord> outBuf;
+    outBuf.reserve(bufRecords);
+    for (uint32_t pass = 1; runFiles.size() > MAX_FAN_IN; pass++) {
+        info("Merge pass %d: %ld runs", pass, runFiles.size());
+        vector<string> mergedFiles;
+        for (uint32_t first = 0; first < runFiles.size(); first += MAX_FAN_IN) {
+            uint32_t last = MIN(first + MAX_FAN_IN, (uint32_t)runFiles.size());
+            vector<string> group(runFiles.begin() + first, runFiles.begin() + last);
+            mergedFiles.push_back(createTmpFile(tmpDir));
+            const string& fname = mergedFiles.back();
+            FILE* f = fopen(fname.c_str(), "w");
+            if (!f) panic("Could not create run file %s", fname.c_str());
+            auto flush = [&]() {
+                size_t written = fwrite(outBuf.data(), sizeof(PackedAccessRecord), outBuf.size(), f);
+                if (written != outBuf.size()) panic("Could not write run file %s (disk full?)", fname.c_str());
+                outBuf.clear();
+            };
+            mergeRuns(group, bufRecords, [&](const PackedAccessRecord& pr) {
+                outBuf.push_back(pr);
+                if (outBuf.size() == bufRecords) flush();
+            });
+            flush();
+            fclose(f);
+            for (const string& g : group) removeTmpFile(g);
+        }
+        runFiles.swap(mergedFiles);
+    }
+
+    uint32_t numRuns = runFiles.size();
+    info("Merging %d runs", numRuns);
+    AccessTraceWriter* tw = new AccessTraceWriter(outFile, numChildren);
+    if (numRuns) {
+        uint64_t writtenRecords = 0;
+        mergeRuns(runFiles, bufRecords, [&](const PackedAccessRecord& pr) {
+            AccessRecord acc = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type};
+            tw->write(acc);
+            if ((++writtenRecords % (1024*1024)) == 0) printProgress("Merging", writtenRecords, totalRecords);
+        });
+        printProgress("Merging", writtenRecords, totalRecords);
+        printf("\n");
+        assert(writtenRecords == totalRecords);
+        removeTmpFiles();
+        tmpFiles.clear();
+    }
+
     tw->dump(false); //flushes it
     delete tw;
     return 0;
 }
-
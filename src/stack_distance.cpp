@@ -0,0 +1,174 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stack_distance.h"
+#include <sstream>
+#include "bithacks.h"
+
+#define SD_MIN_CAPACITY (1 << 16)
+#define SD_DEAD_LINE ((Address)-1L)
+
+StackDistance::StackDistance(uint32_t _maxDist) : curTime(0), maxDist(_maxDist), farAccesses(0), coldAccesses(0), accesses(0) {
+    assert(maxDist > 0);
+    hist = gm_calloc<uint64_t>(maxDist);
+    tree.resize(SD_MIN_CAPACITY + 1, 0);
+    timeLines.resize(SD_MIN_CAPACITY, SD_DEAD_LINE);
+}
+
+uint64_t StackDistance::access(Address lineAddr) {
+    if (unlikely(curTime == timeLines.size())) compact();
+    accesses++;
+
+    uint64_t dist;
+    g_unordered_map<Address, uint64_t>::iterator it = lastAccess.find(lineAddr);
+    if (it != lastAccess.end()) {
+        uint64_t last = it->second;
+        //Distinct lines accessed in (last, curTime); curTime is not marked yet
+        dist = treeSum(curTime - 1) - treeSum(last);
+        treeAdd(last, -1);
+        timeLines[last] = SD_DEAD_LINE;
+        it->second = curTime;
+        if (dist < maxDist) hist[dist]++;
+        else farAccesses++;
+    } else {
+        dist = -1L;
+        lastAccess[lineAddr] = curTime;
+        coldAccesses++;
+    }
+
+    treeAdd(curTime, 1);
+    timeLines[curTime] = lineAddr;
+    curTime++;
+    return dist;
+}
+
+void StackDistance::compact() {
+    //Renumber live marks in time order; keep at least half of the tree free so compactions are amortized
+    uint64_t live = lastAccess.size();
+    uint64_t capacity = MAX((uint64_t)SD_MIN_CAPACITY, 2*live);
+    g_vector<Address> newTimeLines(capacity, SD_DEAD_LINE);
+    uint64_t newTime = 0;
+    for (uint64_t t = 0; t < curTime; t++) {
+        Address lineAddr = timeLines[t];
+        if (lineAddr == SD_DEAD_LINE) continue;
+        lastAccess[lineAddr] = newTime;
+        newTimeLines[newTime++] = lineAddr;
+    }
+    assert(newTime == live);
+
+    //Linear-time Fenwick tree build
+    tree.assign(capacity + 1, 0);
+    for (uint64_t i = 1; i <= live; i++) tree[i] = 1;
+    for (uint64_t i = 1; i <= capacity; i++) {
+        uint64_t j = i + (i & -i);
+        if (j <= capacity) tree[j] += tree[i];
+    }
+
+    timeLines.swap(newTimeLines);
+    curTime = newTime;
+}
+
+uint64_t StackDistance::getMisses(uint32_t lines) const {
+    assert(lines <= maxDist);
+    uint64_t misses = coldAccesses + farAccesses;
+    for (uint32_t d = lines; d < maxDist; d++) misses += hist[d];
+    return misses;
+}
+
+void StackDistance::getMissCurve(uint64_t* misses) const {
+    misses[maxDist] = coldAccesses + farAccesses;
+    for (int64_t s = maxDist - 1; s >= 0; s--) misses[s] = misses[s+1] + hist[s];
+}
+
+void StackDistance::dumpMissCurve(FILE* f, uint32_t step) const {
+    assert(step > 0);
+    uint64_t* misses = gm_calloc<uint64_t>(maxDist + 1);
+    getMissCurve(misses);
+    for (uint32_t s = step; s <= maxDist; s += step) {
+        fprintf(f, "%10d %.6f\n", s, accesses? ((double)misses[s])/accesses : 0.0);
+    }
+    gm_free(misses);
+}
+
+void StackDistance::initStats(AggregateStat* parentStat, uint32_t numBuckets) {
+    assert(numBuckets > 0 && numBuckets <= maxDist);
+    auto accStat = makeLambdaStat([this]() { return accesses; });
+    accStat->init("acc", "Profiled accesses");
+    parentStat->append(accStat);
+    auto coldStat = makeLambdaStat([this]() { return coldAccesses; });
+    coldStat->init("cold", "First accesses to a line (infinite stack distance)");
+    parentStat->append(coldStat);
+    auto farStat = makeLambdaStat([this]() { return farAccesses; });
+    farStat->init("far", "Accesses with stack distance beyond the profiled range");
+    parentStat->append(farStat);
+
+    //Bucket b covers distances [b*maxDist/numBuckets, (b+1)*maxDist/numBuckets)
+    auto histStat = makeLambdaVectorStat([this, numBuckets](uint32_t b) {
+        uint64_t sum = 0;
+        uint32_t first = ((uint64_t)b)*maxDist/numBuckets;
+        uint32_t sup = ((uint64_t)b + 1)*maxDist/numBuckets;
+        for (uint32_t d = first; d < sup; d++) sum += hist[d];
+        return sum;
+    }, numBuckets);
+    histStat->init("hist", "Stack distance histogram (LRU hits of each size increment, in lines)");
+    parentStat->append(histStat);
+}
+
+
+StackDistanceProfiler::StackDistanceProfiler(uint32_t _maxDist, uint32_t _numBuckets, bool _profileChildren)
+    : global(_maxDist), maxDist(_maxDist), numBuckets(_numBuckets), profileChildren(_profileChildren), statsInit(false) {
+    futex_init(&profLock);
+}
+
+void StackDistanceProfiler::setNumChildren(uint32_t numChildren) {
+    if (!profileChildren) return;
+    if (!perChild.empty()) {
+        assert_msg(perChild.size() == numChildren, "Banks sharing a stack distance profiler have different children (%d vs %d)", (uint32_t)perChild.size(), numChildren);
+        return;
+    }
+    for (uint32_t c = 0; c < numChildren; c++) perChild.push_back(new StackDistance(maxDist));
+}
+
+void StackDistanceProfiler::initStats(AggregateStat* parentStat) {
+    if (statsInit) return;
+    statsInit = true;
+    AggregateStat* sdStat = new AggregateStat();
+    sdStat->init("stackDist", "LRU stack distance profile");
+    global.initStats(sdStat, numBuckets);
+    if (perChild.size()) {
+        AggregateStat* childrenStat = new AggregateStat(true);
+        childrenStat->init("child", "Per-child stack distance profiles");
+        for (uint32_t c = 0; c < perChild.size(); c++) {
+            std::stringstream ss;
+            ss << "child-" << c;
+            AggregateStat* cStat = new AggregateStat();
+            cStat->init(gm_strdup(ss.str().c_str()), "Child stack distance profile");
+            perChild[c]->initStats(cStat, numBuckets);
+            childrenStat->append(cStat);
+        }
+        sdStat->append(childrenStat);
+    }
+    parentStat->append(sdStat);
+}
@@ -0,0 +1,131 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STACK_DISTANCE_H_
+#define STACK_DISTANCE_H_
+
+#include <stdio.h>
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Exact LRU stack-distance profiling (Mattson et al.), which gives the miss ratio of fully-associative LRU caches of
+ * every size in a single pass. Unlike UMon, this is not sampled and does not need the sizes up front.
+ *
+ * Each line's last access time is marked in a Fenwick tree indexed by access time, so the stack distance of an
+ * access (distinct lines touched since the previous access to the same line) is a range count, O(log n). When the
+ * tree fills up, it is compacted by renumbering the live marks, so its size stays proportional to the footprint.
+ *
+ * Distances are recorded exactly up to maxDist lines; longer ones are lumped together, so miss ratios are exact
+ * for all sizes up to maxDist lines.
+ */
+class StackDistance : public GlobAlloc {
+    private:
+        g_unordered_map<Address, uint64_t> lastAccess; //line -> time of its last access
+        g_vector<uint32_t> tree; //Fenwick tree over access times, 1 at the last access of each line (1-based)
+        g_vector<Address> timeLines; //line accessed at each time, or -1 if it has been accessed again since; used to compact
+        uint64_t curTime;
+
+        uint64_t* hist; //hist[d] = accesses with stack distance d, for d < maxDist
+        uint32_t maxDist;
+        uint64_t farAccesses; //stack distance >= maxDist
+        uint64_t coldAccesses; //first access to the line
+        uint64_t accesses;
+
+    public:
+        explicit StackDistance(uint32_t _maxDist);
+
+        //Returns the stack distance of this access, or -1 if it is the first access to the line
+        uint64_t access(Address lineAddr);
+
+        uint64_t getAccesses() const {return accesses;}
+        uint32_t getMaxDist() const {return maxDist;}
+
+        //Misses of a fully-associative LRU cache of this many lines (<= maxDist)
+        uint64_t getMisses(uint32_t lines) const;
+
+        //Cumulative misses at every size, misses[s] = misses with s lines, for s in [0, maxDist]. Single O(maxDist) pass
+        void getMissCurve(uint64_t* misses) const;
+
+        //Prints "lines missRatio" for sizes step, 2*step, ... up to maxDist lines
+        void dumpMissCurve(FILE* f, uint32_t step) const;
+
+        //Histogram in numBuckets buckets of maxDist/numBuckets distances each, plus cold and far accesses
+        void initStats(AggregateStat* parentStat, uint32_t numBuckets);
+
+    private:
+        inline void treeAdd(uint64_t pos, int32_t val) {
+            for (uint64_t i = pos + 1; i < tree.size(); i += i & -i) tree[i] += val;
+        }
+
+        inline uint64_t treeSum(uint64_t pos) const { //sum over [0, pos]
+            uint64_t s = 0;
+            for (uint64_t i = pos + 1; i > 0; i -= i & -i) s += tree[i];
+            return s;
+        }
+
+        void compact();
+};
+
+/* Stack-distance tap for a cache: profiles GETs globally and, optionally, per child. A single profiler is shared by
+ * all the banks of a cache, which access it concurrently, so accesses are serialized with an internal lock.
+ */
+class StackDistanceProfiler : public GlobAlloc {
+    private:
+        StackDistance global;
+        g_vector<StackDistance*> perChild;
+        uint32_t maxDist;
+        uint32_t numBuckets;
+        bool profileChildren;
+        bool statsInit;
+        lock_t profLock;
+
+    public:
+        StackDistanceProfiler(uint32_t _maxDist, uint32_t _numBuckets, bool _profileChildren);
+
+        //Must be called before initStats if profiling per child. Every bank calls it with the same children
+        void setNumChildren(uint32_t numChildren);
+
+        inline void access(Address lineAddr, uint32_t childId) {
+            futex_lock(&profLock);
+            global.access(lineAddr);
+            if (profileChildren) {
+                assert(childId < perChild.size());
+                perChild[childId]->access(lineAddr);
+            }
+            futex_unlock(&profLock);
+        }
+
+        const StackDistance& getGlobal() const {return global;}
+        const StackDistance& getChild(uint32_t childId) const {return *perChild[childId];}
+
+        //Only the first bank to call this registers the stats, so a banked cache reports a single profile
+        void initStats(AggregateStat* parentStat);
+};
+
+#endif  // STACK_DISTANCE_H_
@@ -0,0 +1,79 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Computes exact LRU stack distances of a trace, and prints the miss ratio curve of fully-associative LRU caches
+ * of all sizes (up to a maximum), globally and for each child, in a single pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "access_tracing.h"
+#include "galloc.h"
+#include "stack_distance.h"
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc < 2 || argc > 4) {
+        info("Prints LRU miss ratio curves of an access trace (GETs only), for every cache size up to maxLines");
+        info("Usage: %s <trace> [<maxLines> (default 262144)] [<step> (default maxLines/64)]", argv[0]);
+        exit(1);
+    }
+
+    uint32_t maxLines = (argc >= 3)? strtoul(argv[2], nullptr, 0) : (1 << 18);
+    uint32_t step = (argc >= 4)? strtoul(argv[3], nullptr, 0) : (maxLines/64);
+    if (!maxLines || !step) panic("maxLines and step must be > 0");
+
+    // Each profile (global and per child) keeps a maxLines-entry histogram plus state proportional to its footprint;
+    // the heap grows on demand, so start small
+    gm_init(32<<20 /*32 MB*/);
+
+    AccessTraceReader tr(argv[1]);
+    uint32_t numChildren = tr.getNumChildren();
+    uint64_t totalRecords = tr.getNumRecords();
+
+    StackDistanceProfiler prof(maxLines, 1, true);
+    prof.setNumChildren(numChildren);
+
+    uint64_t read = 0;
+    while (!tr.empty()) {
+        AccessRecord acc = tr.read();
+        if (IsGet(acc.type)) prof.access(acc.lineAddr, acc.childId);
+        if ((++read % (1024*1024)) == 0) {
+            fprintf(stderr, "Read %3ld%%\r", read*100/totalRecords);
+            fflush(stderr);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    printf("# Miss ratio curves, %ld records, sizes in lines\n", totalRecords);
+    printf("# global: %ld accesses\n", prof.getGlobal().getAccesses());
+    prof.getGlobal().dumpMissCurve(stdout, step);
+    for (uint32_t c = 0; c < numChildren; c++) {
+        printf("# child-%d: %ld accesses\n", c, prof.getChild(c).getAccesses());
+        prof.getChild(c).dumpMissCurve(stdout, step);
+    }
+    return 0;
+}
@@ -31,12 +31,11 @@
  * - Counter: A plain single counter.
  * - VectorCounter: A fixed-size vector of logically related counters. Each
  *   vector element may be unnamed or named (useful when enum-indexed vectors).
- * - Histogram: A GEMS-style histogram, intended to profile a distribution.
- *   It has a fixed amount of buckets, and buckets are resized as samples
- *   are added, making profiling increasingly coarser but keeping storage
- *   space constant. Unlike GEMS-style stats, though, at some configurable
- *   point part of the array starts growing logarithmically, to capture
- *   outliers without hurting accuracy of most samples.
+ * - Histogram: A log-bucketed (HDR-style) histogram, intended to profile a
+ *   distribution (e.g., latencies). It has a fixed amount of buckets whose
+ *   width grows with their value, so relative accuracy is constant and
+ *   storage is small and fixed. It is a vector stat (samples, total, and
+ *   bucket counts), so every backend supports it.
  * - ProxyStat takes a function pointer uint64_t(*)(void) at initialization,
  *   and calls it to get its value. It is used for cases where a stat can't
  *   be stored as a counter (e.g. aggregates, RDTSC, performance counters,...)
@@ -89,6 +88,12 @@ class Stat : public GlobAlloc {
 
         virtual ~Stat() {}
 
+        //Account stats separately in the global heap
+        inline void* operator new (size_t sz) {
+            return gm_malloc(sz, GM_TAG_STATS);
+        }
+        using GlobAlloc::operator new;
+
         const char* name() const {
             assert(_name);
             return _name;
@@ -215,6 +220,7 @@ class VectorStat : public Stat {
 class Counter : public ScalarStat {
     private:
         uint64_t _count;
+        friend class StatGatherPlan;
 
     public:
         Counter() : ScalarStat(), _count(0) {}
@@ -252,6 +258,7 @@ class Counter : public ScalarStat {
 class VectorCounter : public VectorStat {
     private:
         g_vector<uint64_t> _counters;
+        friend class StatGatherPlan;
 
     public:
         VectorCounter() : VectorStat() {}
@@ -297,15 +304,98 @@ class VectorCounter : public VectorStat {
         }
 };
 
-/*
-class Histogram : public Stat {
-    //TBD
+/* Values below 2^subBucketBits get one bucket each; above that, each power-of-two range is split in 2^subBucketBits
+ * equal buckets, so a bucket is at most 1/2^subBucketBits as wide as its lower bound (25% with the default 2 bits).
+ * Values above maxValue go to the last bucket. The vector is [samples, total, bucket 0, bucket 1, ...], with buckets
+ * named by their lower bound. Updates are allocation-free and take a few instructions, so it can replace a Counter
+ * that sums latencies (total has the same value).
+ */
+class Histogram : public VectorStat {
+    private:
+        g_vector<uint64_t> _counters;
+        uint32_t _subBits;
+        uint32_t _numBuckets;
+        friend class StatGatherPlan;
+
+    public:
+        Histogram() : VectorStat(), _subBits(0), _numBuckets(0) {}
+
+        void init(const char* name, const char* desc, uint64_t maxValue, uint32_t subBucketBits = 2) {
+            initStat(name, desc);
+            assert(subBucketBits < 16 && maxValue >= (1ul << subBucketBits));
+            _subBits = subBucketBits;
+            _numBuckets = (uint32_t)-1;  // so that bucket() does not clamp
+            _numBuckets = bucket(maxValue) + 1;
+            _counters.resize(_numBuckets + 2);
+            for (uint32_t i = 0; i < _counters.size(); i++) _counters[i] = 0;
+
+            _counterNames = gm_calloc<const char*>(_counters.size());
+            _counterNames[0] = "samples";
+            _counterNames[1] = "total";
+            for (uint32_t b = 0; b < _numBuckets; b++) {
+                _counterNames[b + 2] = gm_strdup(std::to_string(bucketLowerBound(b)).c_str());
+            }
+        }
+
+        inline uint32_t bucket(uint64_t value) const {
+            if (value < (1ul << _subBits)) return value;
+            uint32_t shift = 63 - __builtin_clzl(value) - _subBits;
+            uint32_t b = ((shift + 1) << _subBits) + ((value >> shift) & ((1 << _subBits) - 1));
+            return (b < _numBuckets)? b : _numBuckets - 1;
+        }
+
+        inline uint64_t bucketLowerBound(uint32_t b) const {
+            uint32_t subBuckets = 1 << _subBits;
+            if (b < subBuckets) return b;
+            uint32_t shift = b/subBuckets - 1;
+            return ((uint64_t)(subBuckets + b % subBuckets)) << shift;
+        }
+
+        inline void inc(uint64_t value) {
+            _counters[0]++;
+            _counters[1] += value;
+            _counters[2 + bucket(value)]++;
+        }
+
+        inline void atomicInc(uint64_t value) {
+            __sync_fetch_and_add(&_counters[0], 1);
+            __sync_fetch_and_add(&_counters[1], value);
+            __sync_fetch_and_add(&_counters[2 + bucket(value)], 1);
+        }
+
+        inline uint64_t count(uint32_t idx) const {
+            return _counters[idx];
+        }
+
+        inline uint32_t size() const {
+            return _counters.size();
+        }
+
+        inline uint32_t numBuckets() const {
+            return _numBuckets;
+        }
+
+        /* Lower bound of the bucket that holds the given percentile (0-100) of vals, which is this histogram's vector
+         * (e.g., from a stats dump, or the difference of two dumps). Returns 0 if there are no samples.
+         */
+        uint64_t percentile(const uint64_t* vals, double pct) const {
+            uint64_t samples = vals[0];
+            if (!samples) return 0;
+            uint64_t target = (uint64_t)(pct*samples/100.0 + 0.999999);
+            if (target == 0) target = 1;
+            uint64_t cum = 0;
+            for (uint32_t b = 0; b < _numBuckets; b++) {
+                cum += vals[b + 2];
+                if (cum >= target) return bucketLowerBound(b);
+            }
+            return bucketLowerBound(_numBuckets - 1);
+        }
 };
-*/
 
 class ProxyStat : public ScalarStat {
     private:
         uint64_t* _statPtr;
+        friend class StatGatherPlan;
 
     public:
         ProxyStat() : ScalarStat(), _statPtr(nullptr) {}
@@ -412,6 +502,21 @@ class HDF5Backend : public StatsBackend {
     public:
         HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates);
         virtual void dump(bool buffered);
+
+        // Backends created after this call write through a background thread that keeps files open (see hdf5_stats.cpp)
+        static void startWriterThread(uint32_t flushIntervalSecs);
+};
+
+class DeltaBackendImpl;
+
+// Periodic stats in delta-compressed format; see delta_stats.h
+class DeltaBackend : public StatsBackend {
+    private:
+        DeltaBackendImpl* backend;
+
+    public:
+        DeltaBackend(const char* filename, AggregateStat* rootStat, uint32_t keyframeInterval, bool skipVectors, bool sumRegularAggregates);
+        virtual void dump(bool buffered);
 };
 
 #endif  // STATS_H_
@@ -0,0 +1,111 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats_gather.h"
+#include <typeinfo>
+#include "log.h"
+
+StatGatherPlan::StatGatherPlan(Stat* root, bool skipVectors, bool sumRegularAggregates) {
+    recordWords = compile(root, 0, false, skipVectors, sumRegularAggregates);
+}
+
+// Appends the ops for s, writing at dst; returns the number of words s takes in the record
+uint32_t StatGatherPlan::compile(Stat* s, uint32_t dst, bool accumulate, bool skipVectors, bool sumRegularAggregates) {
+    if (skipVectors && dynamic_cast<VectorStat*>(s)) return 0;
+
+    GatherOp op;
+    op.accumulate = accumulate;
+    op.dst = dst;
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        uint32_t words = 0;
+        if (as->isRegular() && sumRegularAggregates) {
+            //All children are summed into the first child's slot
+            for (uint32_t i = 0; i < as->size(); i++) {
+                uint32_t childWords = compile(as->get(i), dst, accumulate || i > 0, skipVectors, sumRegularAggregates);
+                assert_msg(i == 0 || childWords == words, "Regular aggregate %s has children of different sizes", as->name());
+                words = childWords;
+            }
+        } else {
+            for (uint32_t i = 0; i < as->size(); i++) {
+                words += compile(as->get(i), dst + words, accumulate, skipVectors, sumRegularAggregates);
+            }
+        }
+        return words;
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        op.size = 1;
+        // Only read through pointers if the exact type is known; subclasses may override get()
+        if (typeid(*ss) == typeid(Counter)) {
+            op.type = OP_READ;
+            op.ptr = &static_cast<Counter*>(ss)->_count;
+        } else if (typeid(*ss) == typeid(ProxyStat)) {
+            op.type = OP_READ;
+            op.ptr = static_cast<ProxyStat*>(ss)->_statPtr;
+            assert(op.ptr);
+        } else {
+            op.type = OP_SCALAR;
+            op.ss = ss;
+        }
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        op.size = vs->size();
+        if (op.size == 0) return 0; //nothing to gather, and no storage to point to
+        if (typeid(*vs) == typeid(VectorCounter)) {
+            op.type = OP_READ;
+            op.ptr = static_cast<VectorCounter*>(vs)->_counters.data();
+        } else if (typeid(*vs) == typeid(Histogram)) {
+            op.type = OP_READ;
+            op.ptr = static_cast<Histogram*>(vs)->_counters.data();
+        } else {
+            op.type = OP_VECTOR;
+            op.vs = vs;
+        }
+    } else {
+        panic("Unrecognized stat type");
+    }
+    ops.push_back(op);
+    return op.size;
+}
+
+static void GetNames(Stat* s, const std::string& path, bool skipVectors, bool sumRegularAggregates, std::vector<std::string>& names) {
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        if (as->isRegular() && sumRegularAggregates) {
+            if (as->size()) GetNames(as->get(0), path, skipVectors, sumRegularAggregates, names);
+        } else {
+            for (uint32_t i = 0; i < as->size(); i++) {
+                GetNames(as->get(i), path + "." + as->get(i)->name(), skipVectors, sumRegularAggregates, names);
+            }
+        }
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        if (skipVectors) return;
+        for (uint32_t i = 0; i < vs->size(); i++) {
+            names.push_back(path + "." + (vs->hasCounterNames()? std::string(vs->counterName(i)) : std::to_string(i)));
+        }
+    } else {
+        names.push_back(path);
+    }
+}
+
+void GetGatherPlanNames(Stat* root, bool skipVectors, bool sumRegularAggregates, std::vector<std::string>& names) {
+    GetNames(root, root->name(), skipVectors, sumRegularAggregates, names);
+}
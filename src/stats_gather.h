@@ -0,0 +1,107 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_GATHER_H_
+#define STATS_GATHER_H_
+
+#include <string>
+#include <vector>
+#include "g_std/g_vector.h"
+#include "stats.h"
+
+/* Flat, precompiled version of a stats tree walk. Backends used to walk the tree on every dump, doing a chain of
+ * dynamic_casts per stat; with hundreds of thousands of counters, that dominated dump time. A StatGatherPlan walks
+ * the (immutable) tree once, and records one op per base stat, in the same inorder as the walk:
+ *  - Plain Counters, VectorCounters, Histograms and ProxyStats are read directly through pointers to their storage.
+ *  - Other stats (lambdas, subclasses that override get()/count()) are read through their virtual methods.
+ *  - With sumRegularAggregates, children 1..N of a regular aggregate are compiled to ops that accumulate onto the
+ *    values of child 0, so no rewinding or re-summing is needed at dump time.
+ * gather() then fills a record of size() words with a single pass over the ops.
+ */
+class StatGatherPlan : public GlobAlloc {
+    private:
+        enum OpType {
+            OP_READ,    // copy size words from ptr
+            OP_SCALAR,  // ScalarStat::get()
+            OP_VECTOR,  // VectorStat::count(0..size-1)
+        };
+
+        struct GatherOp {
+            uint8_t type;
+            bool accumulate; //add to dst instead of overwriting it
+            uint32_t size; //in words
+            uint32_t dst; //word offset in the record
+            union {
+                const uint64_t* ptr;
+                const ScalarStat* ss;
+                const VectorStat* vs;
+            };
+        };
+
+        g_vector<GatherOp> ops;
+        uint32_t recordWords;
+
+    public:
+        StatGatherPlan(Stat* root, bool skipVectors, bool sumRegularAggregates);
+
+        // Record size, in 64-bit words
+        uint32_t size() const {return recordWords;}
+
+        void gather(uint64_t* record) const {
+            for (const GatherOp& op : ops) {
+                uint64_t* dst = record + op.dst;
+                switch (op.type) {
+                    case OP_READ:
+                        if (op.accumulate) {
+                            for (uint32_t i = 0; i < op.size; i++) dst[i] += op.ptr[i];
+                        } else {
+                            for (uint32_t i = 0; i < op.size; i++) dst[i] = op.ptr[i];
+                        }
+                        break;
+                    case OP_SCALAR:
+                        if (op.accumulate) dst[0] += op.ss->get();
+                        else dst[0] = op.ss->get();
+                        break;
+                    case OP_VECTOR:
+                        if (op.accumulate) {
+                            for (uint32_t i = 0; i < op.size; i++) dst[i] += op.vs->count(i);
+                        } else {
+                            for (uint32_t i = 0; i < op.size; i++) dst[i] = op.vs->count(i);
+                        }
+                        break;
+                }
+            }
+        }
+
+    private:
+        uint32_t compile(Stat* s, uint32_t dst, bool accumulate, bool skipVectors, bool sumRegularAggregates);
+};
+
+/* Names of the words of a StatGatherPlan with the same arguments, as dot-separated paths from the root. Vector
+ * elements are named by counter name or index, and summed regular aggregates omit the name of their children.
+ */
+void GetGatherPlanNames(Stat* root, bool skipVectors, bool sumRegularAggregates, std::vector<std::string>& names);
+
+#endif  // STATS_GATHER_H_
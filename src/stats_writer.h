@@ -0,0 +1,93 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_WRITER_H_
+#define STATS_WRITER_H_
+
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "profile_stats.h"
+
+/* Stats writer thread. Stats backends that register with it (HDF5 tables in hdf5_stats.cpp, delta-compressed files in
+ * delta_stats.cpp) publish what they dump to rings in the global heap, and the writer does the file I/O, so the thread
+ * that dumps stats (and everyone waiting on it at the phase barrier) does not pay for it. It runs in the process that
+ * initializes the simulation (proc 0), which outlives all others, and serves dumps from all processes.
+ * HDF5Backend::startWriterThread() creates it; this is header-only so that standalone tools can link the backends.
+ */
+class StatsWriterClient {
+    public:
+        virtual ~StatsWriterClient() {}
+        // Called by the writer thread: writes everything published so far, and flushes or closes files as needed
+        virtual void write(uint64_t curNs, uint64_t flushIntervalNs) = 0;
+};
+
+class StatsWriter : public GlobAlloc {
+    private:
+        g_vector<StatsWriterClient*> clients;
+        lock_t clientsLock;
+        lock_t wakeLock; //the writer sleeps on it between writes
+        uint64_t flushIntervalNs;
+
+    public:
+        explicit StatsWriter(uint32_t flushIntervalSecs) : flushIntervalNs(flushIntervalSecs*1000L*1000L*1000L) {
+            futex_init(&clientsLock);
+            futex_init(&wakeLock);
+            futex_lock(&wakeLock); //starts locked, so the writer blocks until woken up
+        }
+
+        // The writer of this process, or nullptr if it has none (backends then write synchronously)
+        static StatsWriter*& instance() {
+            static StatsWriter* writer = nullptr;
+            return writer;
+        }
+
+        void registerClient(StatsWriterClient* client) {
+            futex_lock(&clientsLock);
+            clients.push_back(client);
+            futex_unlock(&clientsLock);
+        }
+
+        void wake() {
+            futex_unlock(&wakeLock);
+        }
+
+        void run() {
+            while (true) {
+                //Wake up when something is published, or when it's time to flush
+                futex_trylock_nospin_timeout(&wakeLock, flushIntervalNs);
+                uint64_t curNs = getNs();
+                futex_lock(&clientsLock);
+                for (StatsWriterClient* client : clients) client->write(curNs, flushIntervalNs);
+                futex_unlock(&clientsLock);
+            }
+        }
+
+        static void WriterThread(void* arg) {
+            static_cast<StatsWriter*>(arg)->run();
+        }
+};
+
+#endif  // STATS_WRITER_H_
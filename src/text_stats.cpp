@@ -25,37 +25,70 @@
 
 #include <fstream>
 #include <iostream>
+#include <string>
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
 #include "galloc.h"
 #include "log.h"
 #include "stats.h"
+#include "stats_gather.h"
 #include "zsim.h"
 
 using std::endl;
 
+/* The text output is compiled at initialization: the stats tree is walked once to produce a list of pieces (text
+ * followed by a stat value, in gather plan order), so dumps just gather values and stream out the pieces.
+ */
 class TextBackendImpl : public GlobAlloc {
     private:
         const char* filename;
         AggregateStat* rootStat;
+        StatGatherPlan* plan;
+        uint64_t* record;
+
+        struct Piece {
+            g_string text;
+            int32_t valueIdx; //index in record to print after text, or -1
+            const Histogram* hist; //if set, print the percentiles of hist, whose vector starts at valueIdx, instead
+        };
+        g_vector<Piece> pieces;
+        uint32_t numValues;
 
-        void dumpStat(Stat* s, uint32_t level, std::ofstream* out) {
-            for (uint32_t i = 0; i < level; i++) *out << " ";
-            *out << s->name() << ": ";
+        void addPiece(const std::string& text, int32_t valueIdx, const Histogram* hist = nullptr) {
+            pieces.push_back(Piece());
+            pieces.back().text = text.c_str();
+            pieces.back().valueIdx = valueIdx;
+            pieces.back().hist = hist;
+        }
+
+        // Same format as the old per-dump walk; pending holds text not yet assigned to a piece
+        void compileStat(Stat* s, uint32_t level, std::string& pending) {
+            std::string indent(level, ' ');
+            pending += indent + s->name() + ": ";
             if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                *out << "# " << as->desc() << endl;
+                pending += std::string("# ") + as->desc() + "\n";
                 for (uint32_t i = 0; i < as->size(); i++) {
-                    dumpStat(as->get(i), level+1, out);
+                    compileStat(as->get(i), level+1, pending);
                 }
             } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *out << ss->get() << " # " << ss->desc() << endl;
+                addPiece(pending, numValues++);
+                pending = std::string(" # ") + ss->desc() + "\n";
             } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                *out << "# " << vs->desc() << endl;
+                pending += std::string("# ") + vs->desc() + "\n";
+                uint32_t firstValue = numValues;
                 for (uint32_t i = 0; i < vs->size(); i++) {
-                    for (uint32_t j = 0; j < level+1; j++) *out << " ";
+                    pending += indent + " ";
                     if (vs->hasCounterNames()) {
-                        *out << vs->counterName(i) << ": " << vs->count(i) << endl;
+                        pending += std::string(vs->counterName(i)) + ": ";
                     } else {
-                        *out << i << ": " << vs->count(i) << endl;
+                        pending += std::to_string(i) + ": ";
                     }
+                    addPiece(pending, numValues++);
+                    pending = "\n";
+                }
+                if (Histogram* h = dynamic_cast<Histogram*>(vs)) {
+                    addPiece(pending + indent + " percentiles: ", firstValue, h);
+                    pending = " # p50 p90 p99 p99.9, bucket lower bounds\n";
                 }
             } else {
                 panic("Unrecognized stat type");
@@ -66,15 +99,34 @@ class TextBackendImpl : public GlobAlloc {
         TextBackendImpl(const char* _filename, AggregateStat* _rootStat) :
             filename(_filename), rootStat(_rootStat)
         {
+            plan = new StatGatherPlan(rootStat, false /*skipVectors*/, false /*sumRegularAggregates*/);
+            record = gm_calloc<uint64_t>(plan->size());
+
+            numValues = 0;
+            std::string pending;
+            compileStat(rootStat, 0, pending);
+            addPiece(pending + "===\n", -1);
+            assert(numValues == plan->size());
+
             std::ofstream out(filename, std::ios_base::out);
             out << "# zsim stats" << endl;
             out << "===" << endl;
         }
 
         void dump(bool buffered) {
+            plan->gather(record);
             std::ofstream out(filename, std::ios_base::app);
-            dumpStat(rootStat, 0, &out);
-            out << "===" << endl;
+            for (const Piece& p : pieces) {
+                out << p.text;
+                if (p.hist) {
+                    const uint64_t* vals = &record[p.valueIdx];
+                    out << p.hist->percentile(vals, 50.0) << " " << p.hist->percentile(vals, 90.0) << " "
+                        << p.hist->percentile(vals, 99.0) << " " << p.hist->percentile(vals, 99.9);
+                } else if (p.valueIdx >= 0) {
+                    out << record[p.valueIdx];
+                }
+            }
+            out.flush();
         }
 };
 
@@ -25,6 +25,7 @@
 
 #include "timing_cache.h"
 #include "event_recorder.h"
+#include "self_prof.h"
 #include "timing_event.h"
 #include "zsim.h"
 
@@ -87,6 +88,18 @@ TimingCache::TimingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPo
     assert(numMSHRs > 0);
     activeMisses = 0;
     domain = _domain;
+    detailedStats = false;
+
+    analyticalLoad = 0.0;
+    analytical = false;
+    lastModePhase = 0;
+    modeStartPhase = 0;
+    phaseLookups = 0;
+    smoothedLoad = 0.0;
+    analyticalWait = 0.0;
+    pendingWait = 0.0;
+    eventPhases = 0;
+    analyticalPhases = 0;
     info("%s: mshrs %d domain %d", name.c_str(), numMSHRs, domain);
 }
 
@@ -96,7 +109,7 @@ void TimingCache::initStats(AggregateStat* parentStat) {
     initCacheStats(cacheStat);
 
     //Stats specific to timing cache
-    profOccHist.init("occHist", "Occupancy MSHR cycle histogram", numMSHRs+1);
+    profOccHist.init("occHist", "Occupancy MSHR cycle histogram (event-mode phases only, see anMshrCycles)", numMSHRs+1);
     cacheStat->append(&profOccHist);
 
     profHitLat.init("latHit", "Cumulative latency accesses that hit (demand and non-demand)");
@@ -107,11 +120,43 @@ void TimingCache::initStats(AggregateStat* parentStat) {
     cacheStat->append(&profMissRespLat);
     cacheStat->append(&profMissLat);
 
+    if (detailedStats) {
+        profHitLatHist.init("latHitHist", "Latency distribution of accesses that hit", 1 << 16);
+        profMissRespLatHist.init("latMissRespHist", "Latency distribution for miss start to response", 1 << 16);
+        profMissLatHist.init("latMissHist", "Latency distribution for miss start to finish", 1 << 16);
+
+        cacheStat->append(&profHitLatHist);
+        cacheStat->append(&profMissRespLatHist);
+        cacheStat->append(&profMissLatHist);
+    }
+
+    if (analyticalLoad > 0.0) initHybridStats(cacheStat);
+
     parentStat->append(cacheStat);
 }
 
+void TimingCache::initHybridStats(AggregateStat* cacheStat) {
+    auto evPhases = [this]() { return eventPhases + (analytical? 0 : zinfo->numPhases - modeStartPhase); };
+    auto anPhases = [this]() { return analyticalPhases + (analytical? zinfo->numPhases - modeStartPhase : 0); };
+    auto evPhasesStat = makeLambdaStat(evPhases);
+    auto anPhasesStat = makeLambdaStat(anPhases);
+    evPhasesStat->init("evPhases", "Phases simulating contention with weave events");
+    anPhasesStat->init("anPhases", "Phases estimating contention analytically");
+    profModeSwitches.init("modeSwitches", "Switches between event and analytical contention modes");
+    profAnalyticalAccs.init("anAccs", "Accesses charged an analytical delay instead of recording events");
+    profAnalyticalDelay.init("anDelay", "Cumulative analytical delay charged (cycles)");
+    profAnalyticalMshrCycles.init("anMshrCycles", "MSHR cycles of misses served analytically (occHist only covers event-mode phases)");
+    cacheStat->append(evPhasesStat);
+    cacheStat->append(anPhasesStat);
+    cacheStat->append(&profModeSwitches);
+    cacheStat->append(&profAnalyticalAccs);
+    cacheStat->append(&profAnalyticalDelay);
+    cacheStat->append(&profAnalyticalMshrCycles);
+}
+
 // TODO(dsm): This is copied verbatim from Cache. We should split Cache into different methods, then call those.
 uint64_t TimingCache::access(MemReq& req) {
+    SelfProfScope sps(SPR_CACHE);
     EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
     assert_msg(evRec, "TimingCache is not connected to TimingCore");
 
@@ -123,8 +168,11 @@ uint64_t TimingCache::access(MemReq& req) {
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
     if (likely(!skipAccess)) {
+        if (analyticalLoad > 0.0 && zinfo->numPhases > lastModePhase) updateMode();
+        if (unlikely(sdProf != nullptr)) profileStackDistance(req);
         bool updateReplacement = (req.type == GETS) || (req.type == GETX);
         int32_t lineId = array->lookup(req.lineAddr, &req, updateReplacement);
+        if (lineId == -1 && IsGet(req.type)) profileMiss(req);
         respCycle += accLat;
 
         if (lineId == -1 /*&& cc->shouldAllocate(req)*/) {
@@ -149,10 +197,40 @@ uint64_t TimingCache::access(MemReq& req) {
 
         if (evRec->hasRecord()) accessRecord = evRec->popRecord();
 
+        bool hit = getDoneCycle - req.cycle == accLat;
+        uint32_t replLookups = (evDoneCycle && cands > ways)? (cands + (ways-1))/ways - 1 : 0; // e.g., with 4 ways, 5-8 -> 1, 9-12 -> 2, etc.
+        phaseLookups += hit? 1 : 2 /*start + writeback*/ + (replLookups? replLookups + 2 /*swap rd + wr*/ : 0);
+
         // At this point we have all the info we need to hammer out the timing record
         TimingRecord tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr}; //note the end event is the response, not the wback
 
-        if (getDoneCycle - req.cycle == accLat) {
+        if (analytical && !writebackRecord.isValid() && !accessRecord.isValid()) {
+            // Lightly loaded, and nothing above us needs to be simulated: charge the expected queuing delay
+            pendingWait += analyticalWait;
+            uint64_t delay = (uint64_t)pendingWait;
+            pendingWait -= delay;
+            respCycle += delay;
+            profAnalyticalAccs.inc();
+            profAnalyticalDelay.inc(delay);
+
+            // Same latency stats as the events would record (see simulateHit/MissResponse/MissWriteback), with the
+            // delay as the queuing time in the array. MSHR occupancy is a cycle breakdown that only the weave phase
+            // can track, so analytical misses add their MSHR cycles to a separate counter instead of occHist
+            if (hit) {
+                profHitLat.inc(delay);
+                if (detailedStats) profHitLatHist.inc(delay);
+            } else {
+                uint64_t missRespLat = getDoneCycle + delay - req.cycle;
+                uint64_t missLat = MAX(evDoneCycle, getDoneCycle) + delay - req.cycle;
+                profMissRespLat.inc(missRespLat);
+                profMissLat.inc(missLat);
+                profAnalyticalMshrCycles.inc(missLat);
+                if (detailedStats) {
+                    profMissRespLatHist.inc(missRespLat);
+                    profMissLatHist.inc(missLat);
+                }
+            }
+        } else if (hit) {
             // Hit
             assert(!writebackRecord.isValid());
             assert(!accessRecord.isValid());
@@ -220,10 +298,7 @@ uint64_t TimingCache::access(MemReq& req) {
             }
 
             // Replacement path
-            if (evDoneCycle && cands > ways) {
-                uint32_t replLookups = (cands + (ways-1))/ways - 1; // e.g., with 4 ways, 5-8 -> 1, 9-12 -> 2, etc.
-                assert(replLookups);
-
+            if (replLookups) {
                 uint32_t fringeAccs = ways - 1;
                 uint32_t accsSoFar = 0;
 
@@ -256,7 +331,7 @@ uint64_t TimingCache::access(MemReq& req) {
             tr.startEvent = mse;
             tr.endEvent = mre; // note the end event is the response, not the wback
         }
-        evRec->pushRecord(tr);
+        if (tr.startEvent) evRec->pushRecord(tr);
     }
 
     cc->endAccess(req);
@@ -267,6 +342,32 @@ uint64_t TimingCache::access(MemReq& req) {
 }
 
 
+/* Called on the first access of each phase (with the bank locked) to pick the contention mode for the coming phases.
+ * The load is the fraction of cycles the tag array is busy with lookups, smoothed across updates. Below
+ * analyticalLoad, MSHRs are almost never exhausted, so the only contention left is waiting for the single-ported
+ * array, modeled as an M/D/1 queue with a 1-cycle service time (see MD1Memory).
+ */
+void TimingCache::updateMode() {
+    uint64_t cycles = (zinfo->numPhases - lastModePhase)*zinfo->phaseLength;
+    double load = ((double)phaseLookups)/cycles;
+    smoothedLoad = 0.5*load + 0.5*smoothedLoad;
+    phaseLookups = 0;
+    lastModePhase = zinfo->numPhases;
+
+    bool nextAnalytical = smoothedLoad < analyticalLoad;
+    if (nextAnalytical != analytical) {
+        uint64_t phases = zinfo->numPhases - modeStartPhase;
+        if (analytical) analyticalPhases += phases;
+        else eventPhases += phases;
+        modeStartPhase = zinfo->numPhases;
+        analytical = nextAnalytical;
+        profModeSwitches.inc();
+    }
+
+    double rho = MIN(smoothedLoad, 0.95);
+    analyticalWait = 0.5*rho/(1.0 - rho); //Pollaczek-Khinchine, M/D/1, unit service time
+}
+
 uint64_t TimingCache::highPrioAccess(uint64_t cycle) {
     assert(cycle >= lastFreeCycle);
     uint64_t lookupCycle = MAX(cycle, lastAccCycle+1);
@@ -299,6 +400,7 @@ void TimingCache::simulateHit(HitEvent* ev, uint64_t cycle) {
     if (activeMisses < numMSHRs) {
         uint64_t lookupCycle = highPrioAccess(cycle);
         profHitLat.inc(lookupCycle-cycle);
+        if (detailedStats) profHitLatHist.inc(lookupCycle-cycle);
         ev->done(lookupCycle);  // postDelay includes accLat + invalLat
     } else {
         // queue
@@ -324,6 +426,7 @@ void TimingCache::simulateMissStart(MissStartEvent* ev, uint64_t cycle) {
 
 void TimingCache::simulateMissResponse(MissResponseEvent* ev, uint64_t cycle, MissStartEvent* mse) {
     profMissRespLat.inc(cycle - mse->startCycle);
+    if (detailedStats) profMissRespLatHist.inc(cycle - mse->startCycle);
     ev->done(cycle);
 }
 
@@ -332,6 +435,7 @@ void TimingCache::simulateMissWriteback(MissWritebackEvent* ev, uint64_t cycle,
     if (lookupCycle) { //success, release MSHR
         assert(activeMisses);
         profMissLat.inc(cycle - mse->startCycle);
+        if (detailedStats) profMissLatHist.inc(cycle - mse->startCycle);
         activeMisses--;
         profOccHist.transition(activeMisses, lookupCycle);
         if (!pendingQueue.empty()) {
@@ -45,9 +45,27 @@ class TimingCache : public Cache {
         // Stats
         CycleBreakdownStat profOccHist;
         Counter profHitLat, profMissRespLat, profMissLat;
+        Histogram profHitLatHist, profMissRespLatHist, profMissLatHist;  // only if detailedStats
+        bool detailedStats;
 
         uint32_t domain;
 
+        // Hybrid mode: while the smoothed lookup load of the previous phases is below analyticalLoad, accesses that
+        // no other component recorded events for are charged an analytical (M/D/1) queuing delay in the bound phase,
+        // instead of being simulated in the weave phase. Mode state is only touched with the bank locked (in access).
+        // Analytical accesses update the same latency stats as simulated ones, but not occHist (see anMshrCycles).
+        double analyticalLoad;  // lookups/cycle, 0 disables
+        bool analytical;
+        uint64_t lastModePhase;  // phase of the last load update
+        uint64_t modeStartPhase;
+        uint64_t phaseLookups;
+        double smoothedLoad;
+        double analyticalWait;  // cycles per access
+        double pendingWait;  // fraction of a cycle not charged yet
+        uint64_t eventPhases, analyticalPhases;  // up to modeStartPhase
+        Counter profAnalyticalAccs, profAnalyticalDelay, profModeSwitches;  // only registered if analyticalLoad > 0
+        Counter profAnalyticalMshrCycles;  // MSHR occupancy of analytical misses; occHist only covers event-mode phases
+
         // For zcache replacement simulation (pessimistic, assumes we walk the whole tree)
         uint32_t tagLat, ways, cands;
 
@@ -60,6 +78,9 @@ class TimingCache : public Cache {
                 uint32_t tagLat, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name);
         void initStats(AggregateStat* parentStat);
 
+        void setAnalyticalLoad(double load) {analyticalLoad = load;}  // before initStats()
+        void setDetailedStats(bool enable) {detailedStats = enable;}  // before initStats()
+
         uint64_t access(MemReq& req);
 
         void simulateHit(HitEvent* ev, uint64_t cycle);
@@ -71,6 +92,8 @@ class TimingCache : public Cache {
     private:
         uint64_t highPrioAccess(uint64_t cycle);
         uint64_t tryLowPrioAccess(uint64_t cycle);
+        void updateMode();
+        void initHybridStats(AggregateStat* cacheStat);
 };
 
 #endif  // TIMING_CACHE_H_
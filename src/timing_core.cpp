@@ -25,6 +25,7 @@
 
 #include "timing_core.h"
 #include "filter_cache.h"
+#include "pc_profiler.h"
 #include "zsim.h"
 
 #define DEBUG_MSG(args...)
@@ -77,26 +78,35 @@ void TimingCore::leave() {
     cRec.notifyLeave(curCycle);
 }
 
-void TimingCore::loadAndRecord(Address addr) {
+void TimingCore::cSimEnd() {
+    curCycle = cRec.cSimEnd(curCycle);
+    if (unlikely(zinfo->pcProf != nullptr)) zinfo->pcProf->contentionTick(l1d->getSourceId(), curCycle);
+}
+
+void TimingCore::loadAndRecord(Address addr, Address pc) {
     uint64_t startCycle = curCycle;
-    curCycle = l1d->load(addr, curCycle);
+    curCycle = l1d->load(addr, curCycle, pc);
     cRec.record(startCycle);
 }
 
-void TimingCore::storeAndRecord(Address addr) {
+void TimingCore::storeAndRecord(Address addr, Address pc) {
     uint64_t startCycle = curCycle;
-    curCycle = l1d->store(addr, curCycle);
+    curCycle = l1d->store(addr, curCycle, pc);
     cRec.record(startCycle);
 }
 
 void TimingCore::bblAndRecord(Address bblAddr, BblInfo* bblInfo) {
+    if (unlikely(zinfo->pcProf != nullptr)) {
+        zinfo->pcProf->tick(l1d->getSourceId(), curCycle);
+        zinfo->pcProf->setPC(l1d->getSourceId(), bblAddr);
+    }
     instrs += bblInfo->instrs;
     curCycle += bblInfo->instrs;
 
     Address endBblAddr = bblAddr + bblInfo->bytes;
     for (Address fetchAddr = bblAddr; fetchAddr < endBblAddr; fetchAddr+=(1 << lineBits)) {
         uint64_t startCycle = curCycle;
-        curCycle = l1i->load(fetchAddr, curCycle);
+        curCycle = l1i->load(fetchAddr, curCycle, fetchAddr);
         cRec.record(startCycle);
     }
 }
@@ -106,12 +116,12 @@ InstrFuncPtrs TimingCore::GetFuncPtrs() {
     return {LoadAndRecordFunc, StoreAndRecordFunc, BblAndRecordFunc, BranchFunc, PredLoadAndRecordFunc, PredStoreAndRecordFunc, FPTR_ANALYSIS, {0}};
 }
 
-void TimingCore::LoadAndRecordFunc(THREADID tid, ADDRINT addr) {
-    static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr);
+void TimingCore::LoadAndRecordFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr, pc);
 }
 
-void TimingCore::StoreAndRecordFunc(THREADID tid, ADDRINT addr) {
-    static_cast<TimingCore*>(cores[tid])->storeAndRecord(addr);
+void TimingCore::StoreAndRecordFunc(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    static_cast<TimingCore*>(cores[tid])->storeAndRecord(addr, pc);
 }
 
 void TimingCore::BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
@@ -126,11 +136,11 @@ void TimingCore::BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInf
     }
 }
 
-void TimingCore::PredLoadAndRecordFunc(THREADID tid, ADDRINT addr, BOOL pred) {
-    if (pred) static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr);
+void TimingCore::PredLoadAndRecordFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
+    if (pred) static_cast<TimingCore*>(cores[tid])->loadAndRecord(addr, pc);
 }
 
-void TimingCore::PredStoreAndRecordFunc(THREADID tid, ADDRINT addr, BOOL pred) {
-    if (pred) static_cast<TimingCore*>(cores[tid])->storeAndRecord(addr);
+void TimingCore::PredStoreAndRecordFunc(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
+    if (pred) static_cast<TimingCore*>(cores[tid])->storeAndRecord(addr, pc);
 }
 
@@ -23,18 +23,38 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <sstream>
 #include "trace_driver.h"
+#include "bithacks.h"
 #include "zsim.h"
 
-TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets)
+void* TraceDriver::WorkerThread(void* arg) {
+    TraceDriver* drv = static_cast<TraceDriver*>(arg);
+    uint32_t wid = __sync_add_and_fetch(&drv->workerTicket, 1); //worker 0 is the caller of executePhase()
+    drv->workerLoop(wid);
+    return nullptr;
+}
+
+TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads, std::string nextUseFilename)
     : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
 {
     assert(numChildren > 0);
     assert(!useSkews || numChildren == 1);
     if (tr.getNumChildren() != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, tr.getNumChildren());
+    if (nextUseFilename != "") {
+        nur = new NextUseReader(nextUseFilename);
+        if (nur->getNumRecords() != tr.getNumRecords()) panic("Next-use index %s has %ld records, trace has %ld; was it built from this trace?", nextUseFilename.c_str(), nur->getNumRecords(), tr.getNumRecords());
+    } else {
+        nur = nullptr;
+    }
+    childNextUse = new uint64_t[numChildren];
     children = new ChildInfo[numChildren];
-    futex_init(&lock);
+    for (uint32_t i = 0; i < numChildren; i++) {
+        childNextUse[i] = NEXT_USE_NEVER;
+        futex_init(&children[i].lock);
+        children[i].inFlightAddr = -1L;
+    }
     lastAcc.childId = -1;
     parent = proxies[0]->getParent();
     for (uint32_t i = 0; i < numChildren; i++) proxies[i]->setDriver(this);
@@ -46,6 +66,27 @@ TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std:
     } else {
         atw = nullptr;
     }
+
+    //More workers than children would just idle
+    assert(_numThreads > 0);
+    numWorkers = MIN(_numThreads, numChildren);
+    workers = new WorkerInfo[numWorkers];
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        futex_init(&workers[i].wakeLock);
+        futex_lock(&workers[i].wakeLock); //starts locked, so first actual call to lock blocks
+    }
+    futex_init(&waitLock);
+    futex_lock(&waitLock); //wait lock must also start locked
+    workersDone = 0;
+
+    workerTicket = 0;
+    __sync_synchronize();
+    for (uint32_t i = 1; i < numWorkers; i++) {
+        pthread_t th;
+        if (pthread_create(&th, nullptr, WorkerThread, this)) panic("Could not start trace driver worker thread %d", i);
+        pthread_detach(th);
+    }
+    if (numWorkers > 1) info("Trace driver: replaying %d children with %d threads", numChildren, numWorkers);
 }
 
 void TraceDriver::initStats(AggregateStat* parentStat) {
@@ -70,27 +111,44 @@ void TraceDriver::initStats(AggregateStat* parentStat) {
     parentStat->append(drvStat);
 }
 
+void TraceDriver::eraseDeadLines(ChildInfo& child) {
+    for (Address lineAddr : child.deadLines) {
+        g_flat_map<Address, MESIState>::iterator it = child.cStore.find(lineAddr);
+        if (it != child.cStore.end() && it->second == I) child.cStore.erase(it);
+    }
+    child.deadLines.clear();
+}
+
 void TraceDriver::setParent(MemObject* _parent) {
     parent = _parent;
 }
 
 uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId) {
     assert(childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
-    std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
-    assert((it != cStore.end()));
+    ChildInfo& child = children[childId];
+    futex_lock(&child.lock);
+    g_flat_map<Address, MESIState>& cStore = child.cStore;
+    g_flat_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
+    assert((it != cStore.end()) && it->second != I);
     *reqWriteback = (it->second == M);
     if (type == INVX) {
         it->second = S;
-        children[childId].profInvx.inc();
+        child.profInvx.inc();
     } else {
-        cStore.erase(it);
+        if (child.inFlightAddr != (Address)-1L) {
+            it->second = I; //can't move entries now, see ChildInfo
+            //The in-flight line's own request sees the race and removes the entry itself
+            if (lineAddr != child.inFlightAddr) child.deadLines.push_back(lineAddr);
+        } else {
+            cStore.erase(it);
+        }
         if (srcId == childId) {
-            children[childId].profSelfInv.inc();
+            child.profSelfInv.inc();
         } else {
-            children[childId].profCrossInv.inc();
+            child.profCrossInv.inc();
         }
     }
+    futex_unlock(&child.lock);
     return 0;
 }
 
@@ -100,83 +158,168 @@ bool TraceDriver::executePhase() {
 
     //Load valid access
     AccessRecord acc;
+    uint64_t nextUse;
     if (lastAcc.childId == (uint32_t)-1) {
         if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        acc = readAccess(nextUse);
     } else {
         acc = lastAcc;
+        nextUse = lastNextUse;
         lastAcc.childId = (uint32_t)-1;
     }
 
-    //Run until we reach the cycle limit or run out of phases
+    if (numWorkers == 1) {
+        //Run until we reach the cycle limit or run out of phases
+        while (acc.reqCycle < limit) {
+            executeAccess(acc, nextUse);
+            if (tr.empty()) return false;
+            acc = readAccess(nextUse);
+        }
+
+        lastAcc = acc; //save this access for the next phase
+        lastNextUse = nextUse;
+        return true;
+    }
+
+    //Split the phase's accesses across workers. No skews here (useSkews needs a single child), so cycles are final
+    assert(!useSkews);
+    bool done = false;
+    uint32_t pos = 0;
     while (acc.reqCycle < limit) {
-        executeAccess(acc);
-        if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        workers[acc.childId % numWorkers].accs.push_back({acc, nextUse, pos++});
+        if (tr.empty()) {
+            done = true;
+            break;
+        }
+        acc = readAccess(nextUse);
+    }
+    if (!done) { //save this access for the next phase
+        lastAcc = acc;
+        lastNextUse = nextUse;
+    }
+
+    if (atw) {
+        AccessRecord skipped;
+        skipped.childId = -1;
+        phaseRetrace.assign(pos, skipped);
+    }
+
+    __sync_synchronize();
+    for (uint32_t i = 1; i < numWorkers; i++) futex_unlock(&workers[i].wakeLock);
+    replayAccesses(0);
+    futex_lock_nospin(&waitLock); //sleep until all other workers are done
+
+    //Workers finish in arbitrary order, so write the retrace here to keep it in trace order
+    if (atw) {
+        for (AccessRecord& rec : phaseRetrace) {
+            if (rec.childId != (uint32_t)-1) atw->write(rec);
+        }
     }
+    return !done;
+}
+
+void TraceDriver::replayAccesses(uint32_t wid) {
+    std::vector<PhaseAccess>& accs = workers[wid].accs;
+    for (PhaseAccess& a : accs) executeAccess(a.acc, a.nextUse, atw? &phaseRetrace[a.pos] : nullptr);
+    accs.clear();
+}
+
+void TraceDriver::workerLoop(uint32_t wid) {
+    info("Started trace driver worker thread %d", wid);
+    while (true) {
+        futex_lock_nospin(&workers[wid].wakeLock);
+        replayAccesses(wid);
+
+        uint32_t val = __sync_add_and_fetch(&workersDone, 1);
+        if (val == numWorkers - 1) {
+            workersDone = 0;
+            futex_unlock(&waitLock); //unblock caller
+        }
+    }
+}
 
-    lastAcc = acc; //save this access for the next phase
-    return true;
+AccessRecord TraceDriver::readAccess(uint64_t& nextUse) {
+    AccessRecord acc = tr.read();
+    nextUse = nur? nur->read() : NEXT_USE_NEVER;
+    if (useSkews) acc.reqCycle += children[acc.childId].skew;
+    return acc;
 }
 
-void TraceDriver::executeAccess(AccessRecord acc) {
+//With multiple workers, the retraced record goes to retraceRec instead of the writer
+void TraceDriver::executeAccess(AccessRecord acc, uint64_t nextUse, AccessRecord* retraceRec) {
     assert(acc.childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[acc.childId].cStore;
+    ChildInfo& child = children[acc.childId];
+    g_flat_map<Address, MESIState>& cStore = child.cStore;
 
+    //Requests point to their entry in cStore and hand the child lock over to the parent, so concurrent invalidations
+    //update the state the parent sees and races are caught by the parent's CC. Nothing is inserted or erased while a
+    //request is in flight, so the pointer stays valid (see ChildInfo)
+    futex_lock(&child.lock);
     int64_t lat = 0;
     switch (acc.type) {
         case PUTS:
         case PUTX:
             {
-                if (!playPuts) return;
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                if (it == cStore.end()) return; //we don't currently have this line, skip
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                g_flat_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
+                if (!playPuts || it == cStore.end()) { //we don't currently have this line, skip
+                    futex_unlock(&child.lock);
+                    return;
+                }
+                MESIState* state = &it->second;
+                child.inFlightAddr = acc.lineAddr;
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, state, acc.reqCycle, &child.lock, *state, acc.childId};
                 lat = parent->access(req) - acc.reqCycle; //note that PUT latency does not affect driver latency
-                assert(it->second == I);
-                cStore.erase(it);
+                assert(*state == I);
+                child.inFlightAddr = -1L;
+                cStore.erase(acc.lineAddr);
+                eraseDeadLines(child);
             }
             break;
         case GETS:
         case GETX:
             {
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                MESIState state = I;
+                g_flat_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
+                MESIState* state;
+                child.inFlightAddr = acc.lineAddr;
                 if (it != cStore.end()) {
-                    if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
-                        if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                    state = &it->second;
+                    if (!((*state == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
+                        if (playAllGets) { //issue a PUT; we keep the (now I) entry for the GET
+                            MemReq req = {acc.lineAddr, (*state == M)? PUTX : PUTS, acc.childId, state, acc.reqCycle, &child.lock, *state, acc.childId};
                             parent->access(req);
-                            assert(it->second == I);
+                            assert(*state == I);
                         } else {
+                            child.inFlightAddr = -1L;
+                            futex_unlock(&child.lock);
                             return; //skip
                         }
-                    } else {
-                        state = it->second;
                     }
+                } else {
+                    state = &cStore[acc.lineAddr]; //value-initialized to I
                 }
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId};
+                childNextUse[acc.childId] = nextUse;
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, state, acc.reqCycle, &child.lock, *state, acc.childId};
                 uint64_t respCycle = parent->access(req);
                 lat = respCycle - acc.reqCycle;
-                children[acc.childId].profLat.inc(lat);
-                children[acc.childId].skew += ((int64_t)lat - acc.latency);
-                assert(state != I);
-                cStore[acc.lineAddr] = state;
+                child.profLat.inc(lat);
+                child.skew += ((int64_t)lat - acc.latency);
+                assert(*state != I);
+                child.inFlightAddr = -1L;
+                eraseDeadLines(child);
             }
             break;
         default:
             panic("Unknown access type %d, trace is probably corrupted", acc.type);
     }
 
-    children[acc.childId].lastReqCycle = acc.reqCycle;
+    child.lastReqCycle = acc.reqCycle;
     if (atw) {
         AccessRecord wAcc = acc;
         // We always want the outout trace to be skewed regardless... otherwise it does not make sense to produce an output trace
-        if (!useSkews) wAcc.reqCycle += children[acc.childId].skew;
+        if (!useSkews) wAcc.reqCycle += child.skew;
         wAcc.latency = lat;
-        atw->write(wAcc);
+        if (retraceRec) *retraceRec = wAcc;
+        else atw->write(wAcc);
     }
+    futex_unlock(&child.lock);
 }
-
@@ -26,9 +26,9 @@
 #ifndef __TRACE_DRIVER_H__
 #define __TRACE_DRIVER_H__
 
-#include <unordered_map>
 #include <vector>
 #include "access_tracing.h"
+#include "g_std/g_flat_map.h"
 #include "g_std/g_string.h"
 #include "stats.h"
 
@@ -38,8 +38,15 @@ class TraceDriverProxyCache;
 
 class TraceDriver {
     private:
+        /* While a child has a request in flight, the parent holds a pointer to the line's state in cStore. Erasing
+         * from a flat map moves other entries, so invalidations during that window only mark lines I and queue them
+         * in deadLines; the child erases them once its request completes.
+         */
         struct ChildInfo {
-            std::unordered_map<Address, MESIState> cStore; //holds current sets of lines for each child. Needs to support an arbitrary set, hence the hash table
+            g_flat_map<Address, MESIState> cStore; //holds current sets of lines for each child. Needs to support an arbitrary set, hence the hash table
+            lock_t lock; //protects cStore and stats from invalidations by other threads; handed over to the parent on accesses, like FilterCache's filterLock
+            Address inFlightAddr; //line of the request this child has outstanding in the parent, or -1
+            std::vector<Address> deadLines; //lines invalidated while a request was in flight, erased when it finishes
             int64_t skew;
             uint64_t lastReqCycle;
             //Counter bypassedGETS;
@@ -50,10 +57,34 @@ class TraceDriver {
             Counter profInvx;
         };
 
+        /* With multiple worker threads, each phase's accesses are split by child (child i goes to worker i % numWorkers),
+         * and workers replay their share concurrently up to the phase limit, as cores do in the bound phase. Worker 0 is
+         * the thread that calls executePhase(). Workers are native threads: trace-driven runs never start the
+         * application, and Pin internal threads only run once it starts.
+         */
+        struct PhaseAccess {
+            AccessRecord acc;
+            uint64_t nextUse;
+            uint32_t pos; //position in the phase, indexes phaseRetrace
+        };
+
+        struct WorkerInfo {
+            lock_t wakeLock; //used to sleep/wake up the worker thread
+            std::vector<PhaseAccess> accs; //accesses to replay this phase, in trace order
+        };
+
         ChildInfo* children;
-        lock_t lock; //NOTE: not needed for now
+        std::vector<AccessRecord> phaseRetrace; //with multiple workers, retraced records of the phase, written in trace order when it ends (childId == -1 if skipped)
         AccessTraceReader tr;
+        NextUseReader* nur; //next-use index, read in lockstep with the trace; null if not used (only OPT needs it)
+        uint64_t* childNextUse; //next use of the request each child has in flight
         uint32_t numChildren;
+
+        WorkerInfo* workers;
+        uint32_t numWorkers;
+        lock_t waitLock; //caller sleeps here until all workers are done with the phase
+        volatile uint32_t workersDone;
+        volatile uint32_t workerTicket; //used only at init
         bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child.
         bool playPuts; //If true, issues PUTS/PUTX requests as they appear in the trace. If false, it just issues the GETS/X requests, leaving it up to the parent to decide when to evict something (NOTE: if the parent is running OPT, it knows better!)
         bool playAllGets; //If true, if we have a get to an address that we already have, issue a put immediately before.
@@ -63,9 +94,10 @@ class TraceDriver {
 
         //Last access, childId == -1 if invalid, acts as 1-elem buffer
         AccessRecord lastAcc;
+        uint64_t lastNextUse;
 
     public:
-        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets);
+        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads, std::string nextUseFilename);
         void initStats(AggregateStat* parentStat);
         void setParent(MemObject* _parent);
 
@@ -74,8 +106,20 @@ class TraceDriver {
         //Returns false if done, true otherwise
         bool executePhase();
 
+        //Position in the trace of the next GET to the line requested by this child's current access (NEXT_USE_NEVER if none)
+        inline uint64_t getNextUse(uint32_t childId) const {
+            assert(childId < numChildren);
+            return childNextUse[childId];
+        }
+
     private:
-        inline void executeAccess(AccessRecord acc);
+        inline AccessRecord readAccess(uint64_t& nextUse);
+        inline void executeAccess(AccessRecord acc, uint64_t nextUse, AccessRecord* retraceRec = nullptr);
+        void eraseDeadLines(ChildInfo& child);
+        void replayAccesses(uint32_t wid);
+
+        void workerLoop(uint32_t wid);
+        static void* WorkerThread(void* arg);
 };
 
 
@@ -28,14 +28,14 @@
 
 /* Simple class to keep tabs on virtualized ports */
 
-#include "g_std/g_unordered_map.h"
+#include "g_std/g_flat_map.h"
 #include "galloc.h"
 #include "locks.h"
 
 class PortVirtualizer : public GlobAlloc {
     private:
-        g_unordered_map<int, int> realToVirt;
-        g_unordered_map<int, int> virtToReal;
+        g_flat_map<int, int> realToVirt;
+        g_flat_map<int, int> virtToReal;
 
         lock_t pvLock;
 
@@ -59,13 +59,13 @@ class PortVirtualizer : public GlobAlloc {
 
         //Returns -1 if not in map. For connect() and bind()
         int lookupReal(int virt) {
-            g_unordered_map<int, int>::iterator it = virtToReal.find(virt);
+            g_flat_map<int, int>::iterator it = virtToReal.find(virt);
             return (it == virtToReal.end())? -1 : it->second;
         }
 
         //Returns -1 if not in map. For getsockname(), where the OS returns real and we need virt
         int lookupVirt(int real) {
-            g_unordered_map<int, int>::iterator it = realToVirt.find(real);
+            g_flat_map<int, int>::iterator it = realToVirt.find(real);
             return (it == realToVirt.end())? -1 : it->second;
         }
 };
@@ -49,15 +49,20 @@
 #include "cpuenum.h"
 #include "cpuid.h"
 #include "debug_zsim.h"
+#include "domain_profiler.h"
 #include "event_queue.h"
 #include "galloc.h"
+#include "host_placement.h"
 #include "init.h"
+#include "live_stats.h"
+#include "pc_profiler.h"
 #include "log.h"
 #include "pin.H"
 #include "pin_cmd.h"
 #include "process_tree.h"
 #include "profile_stats.h"
 #include "scheduler.h"
+#include "self_prof.h"
 #include "stats.h"
 #include "trace_driver.h"
 #include "virt/virt.h"
@@ -110,6 +115,7 @@ static ProcessTreeNode* procTreeNode;
 #define UNINITIALIZED_CID ((uint32_t)-2) //Value set at initialization
 
 static uint32_t cids[MAX_THREADS];
+static uint32_t pinnedCids[MAX_THREADS]; //cid each thread was last pinned for, with host placement
 
 // Per TID core pointers (TODO: phase out cid/tid state --- this is enough)
 Core* cores[MAX_THREADS];
@@ -127,6 +133,10 @@ static inline void setCid(uint32_t tid, uint32_t cid) {
     assert(cid < zinfo->numCores);
     cids[tid] = cid;
     cores[tid] = zinfo->cores[cid];
+    if (unlikely(zinfo->hostPlacement != nullptr) && pinnedCids[tid] != cid) {
+        zinfo->hostPlacement->pinThread(cid);
+        pinnedCids[tid] = cid;
+    }
 }
 
 uint32_t getCid(uint32_t tid) {
@@ -167,12 +177,12 @@ VOID FFThread(VOID* arg);
 
 InstrFuncPtrs fPtrs[MAX_THREADS] ATTR_LINE_ALIGNED; //minimize false sharing
 
-VOID PIN_FAST_ANALYSIS_CALL IndirectLoadSingle(THREADID tid, ADDRINT addr) {
-    fPtrs[tid].loadPtr(tid, addr);
+VOID PIN_FAST_ANALYSIS_CALL IndirectLoadSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    fPtrs[tid].loadPtr(tid, addr, pc);
 }
 
-VOID PIN_FAST_ANALYSIS_CALL IndirectStoreSingle(THREADID tid, ADDRINT addr) {
-    fPtrs[tid].storePtr(tid, addr);
+VOID PIN_FAST_ANALYSIS_CALL IndirectStoreSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
+    fPtrs[tid].storePtr(tid, addr, pc);
 }
 
 VOID PIN_FAST_ANALYSIS_CALL IndirectBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
@@ -183,12 +193,12 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectRecordBranch(THREADID tid, ADDRINT branchPc,
     fPtrs[tid].branchPtr(tid, branchPc, taken, takenNpc, notTakenNpc);
 }
 
-VOID PIN_FAST_ANALYSIS_CALL IndirectPredLoadSingle(THREADID tid, ADDRINT addr, BOOL pred) {
-    fPtrs[tid].predLoadPtr(tid, addr, pred);
+VOID PIN_FAST_ANALYSIS_CALL IndirectPredLoadSingle(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
+    fPtrs[tid].predLoadPtr(tid, addr, pc, pred);
 }
 
-VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {
-    fPtrs[tid].predStorePtr(tid, addr, pred);
+VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
+    fPtrs[tid].predStorePtr(tid, addr, pc, pred);
 }
 
 
@@ -209,14 +219,14 @@ void Join(uint32_t tid) {
     fPtrs[tid] = cores[tid]->GetFuncPtrs(); //back to normal pointers
 }
 
-VOID JoinAndLoadSingle(THREADID tid, ADDRINT addr) {
+VOID JoinAndLoadSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
     Join(tid);
-    fPtrs[tid].loadPtr(tid, addr);
+    fPtrs[tid].loadPtr(tid, addr, pc);
 }
 
-VOID JoinAndStoreSingle(THREADID tid, ADDRINT addr) {
+VOID JoinAndStoreSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {
     Join(tid);
-    fPtrs[tid].storePtr(tid, addr);
+    fPtrs[tid].storePtr(tid, addr, pc);
 }
 
 VOID JoinAndBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
@@ -229,21 +239,21 @@ VOID JoinAndRecordBranch(THREADID tid, ADDRINT branchPc, BOOL taken, ADDRINT tak
     fPtrs[tid].branchPtr(tid, branchPc, taken, takenNpc, notTakenNpc);
 }
 
-VOID JoinAndPredLoadSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+VOID JoinAndPredLoadSingle(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
     Join(tid);
-    fPtrs[tid].predLoadPtr(tid, addr, pred);
+    fPtrs[tid].predLoadPtr(tid, addr, pc, pred);
 }
 
-VOID JoinAndPredStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+VOID JoinAndPredStoreSingle(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {
     Join(tid);
-    fPtrs[tid].predStorePtr(tid, addr, pred);
+    fPtrs[tid].predStorePtr(tid, addr, pc, pred);
 }
 
 // NOP variants: Do nothing
-VOID NOPLoadStoreSingle(THREADID tid, ADDRINT addr) {}
+VOID NOPLoadStoreSingle(THREADID tid, ADDRINT addr, ADDRINT pc) {}
 VOID NOPBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {}
 VOID NOPRecordBranch(THREADID tid, ADDRINT addr, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {}
-VOID NOPPredLoadStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {}
+VOID NOPPredLoadStoreSingle(THREADID tid, ADDRINT addr, ADDRINT pc, BOOL pred) {}
 
 // FF is basically NOP except for basic blocks
 VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
@@ -492,12 +502,21 @@ VOID EndOfPhaseActions() {
     CheckForTermination();
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
     zinfo->eventQueue->tick();
+    // Phases can end in any process; whichever ends this one refreshes the live stats segment (mapped lazily)
+    if (zinfo->liveStats) {
+        SelfProfScope sps(SPR_STATS);
+        zinfo->liveStats->update(zinfo->numPhases);
+    }
     zinfo->profSimTime->transition(PROF_BOUND);
 }
 
 
 uint32_t TakeBarrier(uint32_t tid, uint32_t cid) {
-    uint32_t newCid = zinfo->sched->sync(procIdx, tid, cid);
+    uint32_t newCid;
+    {
+        SelfProfScope sps(SPR_BARRIER);
+        newCid = zinfo->sched->sync(procIdx, tid, cid);
+    }
     clearCid(tid); //this is after the sync for a hack needed to make EndOfPhase reliable
     setCid(tid, newCid);
 
@@ -543,25 +562,25 @@ VOID Instruction(INS ins) {
 
         if (INS_IsMemoryRead(ins)) {
             if (!INS_IsPredicated(ins)) {
-                INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_END);
+                INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_INST_PTR, IARG_END);
             } else {
-                INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_EXECUTING, IARG_END);
+                INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_INST_PTR, IARG_EXECUTING, IARG_END);
             }
         }
 
         if (INS_HasMemoryRead2(ins)) {
             if (!INS_IsPredicated(ins)) {
-                INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_END);
+                INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_INST_PTR, IARG_END);
             } else {
-                INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_EXECUTING, IARG_END);
+                INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_INST_PTR, IARG_EXECUTING, IARG_END);
             }
         }
 
         if (INS_IsMemoryWrite(ins)) {
             if (!INS_IsPredicated(ins)) {
-                INS_InsertCall(ins, IPOINT_BEFORE,  StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_END);
+                INS_InsertCall(ins, IPOINT_BEFORE,  StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_INST_PTR, IARG_END);
             } else {
-                INS_InsertCall(ins, IPOINT_BEFORE,  PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_EXECUTING, IARG_END);
+                INS_InsertCall(ins, IPOINT_BEFORE,  PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_INST_PTR, IARG_EXECUTING, IARG_END);
             }
         }
 
@@ -1064,10 +1083,12 @@ VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
     for (uint32_t i = 0; i < MAX_THREADS; i++) {
         fPtrs[i] = joinPtrs;
         cids[i] = UNINITIALIZED_CID;
+        pinnedCids[i] = INVALID_CID;
         activeThreads[i] = false;
         inSyscall[i] = false;
         cores[i] = nullptr;
     }
+    if (zinfo->selfProf) zinfo->selfProf->forkReset();
 
     //We need to launch another copy of the FF control thread
     PIN_SpawnInternalThread(FFThread, nullptr, 64*1024, nullptr);
@@ -1099,6 +1120,7 @@ VOID SimEnd() {
 #ifdef BBL_PROFILING
     Decoder::dumpBblProfile();
 #endif
+    if (zinfo->pcProf) zinfo->pcProf->saveProcessMap(zinfo->outputDir);
 
     //global
     bool lastToFinish = procTreeNode->notifyEnd();
@@ -1116,10 +1138,20 @@ VOID SimEnd() {
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        if (zinfo->liveStats) zinfo->liveStats->finish(zinfo->numPhases);
+        if (zinfo->pcProf) zinfo->pcProf->writeReport(zinfo->outputDir);
+        if (zinfo->domainProfiler) zinfo->domainProfiler->writeReport(zinfo->outputDir);
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
     }
 
+#ifdef LOCK_PROFILE
+    //per-process, after proc 0 has waited for everyone else
+    std::stringstream lockProfFile;
+    lockProfFile << zinfo->outputDir << "/zsim-locks." << procIdx << ".txt";
+    futex_prof_dump(lockProfFile.str().c_str());
+#endif
+
     //Uncomment when debugging termination races, which can be rare because they are triggered by threads of a dying process
     //sleep(5);
 
@@ -1373,6 +1405,10 @@ VOID FFThread(VOID* arg) {
 
 //Use unlocked output, who knows where this happens.
 static EXCEPT_HANDLING_RESULT InternalExceptionHandler(THREADID tid, EXCEPTION_INFO *pExceptInfo, PHYSICAL_CONTEXT *pPhysCtxt, VOID *) {
+    //Touching a global heap segment another process just added is not an error; map it and retry
+    ADDRINT heapAddr;
+    if (PIN_GetFaultyAccessAddress(pExceptInfo, &heapAddr) && gm_handle_fault((const void*)heapAddr)) return EXCEPT_HANDLED;
+
     fprintf(stderr, "%s[%d] Internal exception detected:\n", logHeader, tid);
     fprintf(stderr, "%s[%d]  Code: %d\n", logHeader, tid, PIN_GetExceptionCode(pExceptInfo));
     fprintf(stderr, "%s[%d]  Address: 0x%lx\n", logHeader, tid, PIN_GetExceptionAddress(pExceptInfo));
@@ -1509,6 +1545,7 @@ int main(int argc, char *argv[]) {
     for (uint32_t i = 0; i < MAX_THREADS; i++) {
         fPtrs[i] = joinPtrs;
         cids[i] = UNINITIALIZED_CID;
+        pinnedCids[i] = INVALID_CID;
     }
 
     info("Started process, PID %d", getpid()); //NOTE: external scripts expect this line, please do not change without checking first
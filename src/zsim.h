@@ -37,11 +37,17 @@ class Core;
 class Scheduler;
 class AggregateStat;
 class StatsBackend;
+class LiveStats;
+class SelfProfiler;
+class PCProfiler;
+struct CoreMissLevel;
 class ProcessTreeNode;
 class ProcessStats;
 class ProcStats;
 class EventQueue;
 class ContentionSim;
+class HostPlacement;
+class DomainProfiler;
 class EventRecorder;
 class PinCmd;
 class PortVirtualizer;
@@ -75,6 +81,8 @@ enum ProcExitStatus {
 struct GlobSimInfo {
     //System configuration values, all read-only, set at initialization
     uint32_t numCores;
+    uint32_t numCacheLevels; // levels from the L1s to the LLC, inclusive
+    CoreMissLevel* coreMissLevels; // per core, see cache.h
     uint32_t lineSize;
 
     //Cores
@@ -90,6 +98,9 @@ struct GlobSimInfo {
     ContentionSim* contentionSim;
     EventRecorder** eventRecorders; //CID->EventRecorder* array
 
+    HostPlacement* hostPlacement; //nullptr if simulation threads are not pinned
+    DomainProfiler* domainProfiler; //nullptr unless this run profiles weave domains
+
     PAD();
 
     //World-readable
@@ -137,12 +148,18 @@ struct GlobSimInfo {
     g_vector<StatsBackend*>* statsBackends; // used for termination dumps
     StatsBackend* periodicStatsBackend;
     StatsBackend* eventualStatsBackend;
+    LiveStats* liveStats; // shared-memory endpoint for external monitors (zsimtop), nullptr if disabled
+    SelfProfiler* selfProf; // host-time profiling of simulator components, nullptr if disabled
+    PCProfiler* pcProf; // sampling profiler of the simulated code, nullptr if disabled
     ProcessStats* processStats;
     ProcStats* procStats;
 
     TimeBreakdownStat* profSimTime;
     VectorCounter* profHeartbeats; //global b/c number of processes cannot be inferred at init time; we just size to max
 
+    uint64_t initNs; //wall-clock time of SimInit
+    uint64_t initSystemNs; //of which, building the memory hierarchy and cores
+
     uint64_t trigger; //code with what triggered the current stats dump
 
     ProcessTreeNode* procTree;
@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <pthread.h>
 #include <signal.h>
 #include <sstream>
 #include <stdlib.h>
@@ -229,6 +230,12 @@ static void printHeartbeat(GlobSimInfo* zinfo) {
     lastCycles = cycles;
 }
 
+// Maps heap segments as soon as other processes add them, so they survive their creators (see galloc.cpp)
+static void* SegmentMapperThread(void*) {
+    while (true) gm_wait_new_segments(1000);
+    return nullptr;
+}
+
 
 void LaunchProcess(uint32_t procIdx) {
     int cpid = fork();
@@ -356,10 +363,39 @@ int main(int argc, char *argv[]) {
     }
     if (removedLogfiles) info("Removed %d old logfiles", removedLogfiles);
 
+    // The heap starts with gmMBytes and grows in gmMBytes or larger segments as needed, up to gmMaxMBytes
+    // (0 = 64GB). Every process reserves that much address space, so it is capped to half of ulimit -v
     uint32_t gmSize = conf.get<uint32_t>("sim.gmMBytes", (1<<10) /*default 1024MB*/);
+    uint32_t gmMaxSize = conf.get<uint32_t>("sim.gmMaxMBytes", 0);
     info("Creating global segment, %d MBs", gmSize);
-    int shmid = gm_init(((size_t)gmSize) << 20 /*MB to Bytes*/);
+
+    // Huge pages cut TLB misses on the heap, which holds most simulator state; NUMA interleave spreads it across
+    // sockets so no single memory controller serves all simulation threads
+    std::string gmPagesStr = conf.get<const char*>("sim.gmPages", "default");
+    gm_page_mode gmPages;
+    if (gmPagesStr == "default") gmPages = GM_PAGES_DEFAULT;
+    else if (gmPagesStr == "hugetlb") gmPages = GM_PAGES_HUGETLB;
+    else if (gmPagesStr == "thp") gmPages = GM_PAGES_THP;
+    else panic("Invalid sim.gmPages %s, valid values are default, hugetlb, thp", gmPagesStr.c_str());
+
+    std::string gmNumaStr = conf.get<const char*>("sim.gmNuma", "none");
+    gm_numa_mode gmNuma;
+    if (gmNumaStr == "none") gmNuma = GM_NUMA_DEFAULT;
+    else if (gmNumaStr == "interleave") gmNuma = GM_NUMA_INTERLEAVE;
+    else if (gmNumaStr == "bind") gmNuma = GM_NUMA_BIND;
+    else panic("Invalid sim.gmNuma %s, valid values are none, interleave, bind", gmNumaStr.c_str());
+
+    // Same syntax as process masks, e.g., "0:2" for nodes 0 and 1
+    std::vector<bool> gmNodes = ParseMask(conf.get<const char*>("sim.gmNumaNodes", "0:64"), 64);
+    uint64_t gmNodeMask = 0;
+    for (uint32_t n = 0; n < gmNodes.size(); n++) if (gmNodes[n]) gmNodeMask |= 1ul << n;
+
+    int shmid = gm_init(((size_t)gmSize) << 20 /*MB to Bytes*/, gmPages, gmNuma, gmNodeMask, ((size_t)gmMaxSize) << 20);
+    if (!conf.get<bool>("sim.gmCaches", true)) gm_set_caching(false);
+    pthread_t mapperThread;
+    if (pthread_create(&mapperThread, nullptr, SegmentMapperThread, nullptr)) panic("Could not start the heap segment mapper thread");
     info("Global segment shmid = %d", shmid);
+    gm_report_backing();
     //fprintf(stderr, "%sGlobal segment shmid = %d\n", logHeader, shmid); //hack to print shmid on both streams
     //fflush(stderr);
 
@@ -410,6 +446,7 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
+        gm_map_new_segments();  // so reads below never hit a segment the heap grew by
         if (zinfo == nullptr) {
             zinfo = static_cast<GlobSimInfo*>(gm_get_glob_ptr());
             globzinfo = zinfo;
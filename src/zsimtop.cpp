@@ -0,0 +1,197 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Live monitor for running simulations. Attaches read-only to the live stats segment (sim.liveStats = true) and
+ * periodically shows simulation speed, per-core IPC, per-cache miss rates, and the bound/weave time split.
+ */
+
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "live_stats.h"
+#include "log.h"
+
+struct CoreIdx {
+    std::string name;
+    uint32_t instrs;
+    uint32_t cycles;
+};
+
+struct CacheIdx {
+    std::string name;
+    std::vector<uint32_t> hits;
+    std::vector<uint32_t> misses;
+};
+
+static std::string findSegment() {
+    std::vector<std::string> segs;
+    DIR* d = opendir("/dev/shm");
+    if (!d) panic("Could not open /dev/shm");
+    while (struct dirent* e = readdir(d)) {
+        if (strncmp(e->d_name, LIVE_STATS_PREFIX, strlen(LIVE_STATS_PREFIX)) == 0) segs.push_back(e->d_name);
+    }
+    closedir(d);
+    if (segs.size() == 1) return segs[0];
+    if (segs.empty()) panic("No live stats segments in /dev/shm; run zsim with sim.liveStats = true");
+    info("Multiple live stats segments, pick one:");
+    for (const std::string& s : segs) info("  %s", s.c_str());
+    exit(1);
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t len = strlen(suffix);
+    return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+static double ratio(double num, double den) {
+    return den? num/den : 0.0;
+}
+
+int main(int argc, char *argv[]) {
+    InitLog("[zsimtop] ");
+    if (argc > 3) {
+        info("Usage: %s [<segment, e.g. zsim-live-1234>] [<refresh secs>]", argv[0]);
+        exit(1);
+    }
+    std::string segName = (argc >= 2)? argv[1] : findSegment();
+    double refreshSecs = (argc == 3)? atof(argv[2]) : 1.0;
+    if (segName.find(LIVE_STATS_PREFIX) != 0) segName = LIVE_STATS_PREFIX + segName;
+
+    int fd = shm_open(("/" + segName).c_str(), O_RDONLY, 0);
+    if (fd == -1) panic("Could not open live stats segment %s: %s", segName.c_str(), strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) panic("fstat failed: %s", strerror(errno));
+    const LiveStatsHeader* hdr = (const LiveStatsHeader*) mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) panic("Could not map live stats segment: %s", strerror(errno));
+    close(fd);
+
+    // zsim fills the header before the magic, so wait for it if we attached early
+    while (strncmp(hdr->magic, LIVE_STATS_MAGIC, sizeof(hdr->magic)) != 0) usleep(100*1000);
+    if (hdr->version != LIVE_STATS_VERSION) panic("Live stats version mismatch (segment %d, zsimtop %d)", hdr->version, LIVE_STATS_VERSION);
+    if ((uint64_t)st.st_size < hdr->totalBytes) panic("Truncated live stats segment");
+
+    // Index the stats we show
+    uint32_t numStats = hdr->numStats;
+    std::map<std::string, uint32_t> idx;
+    const char* name = ((const char*)hdr) + hdr->namesOffset;
+    for (uint32_t i = 0; i < numStats; i++) {
+        idx[name] = i;
+        name += strlen(name) + 1;
+    }
+
+    std::vector<CoreIdx> cores;
+    std::map<std::string, CacheIdx> caches;  // by cache group (e.g., root.l2), summed over banks
+    const char* hitNames[] = {"hGETS", "hGETX"};
+    const char* missNames[] = {"mGETS", "mGETXIM", "mGETXSM"};
+    for (auto& kv : idx) {
+        const std::string& n = kv.first;
+        if (endsWith(n, ".instrs")) {
+            std::string prefix = n.substr(0, n.size() - strlen(".instrs"));
+            auto c = idx.find(prefix + ".cycles");
+            if (c != idx.end()) cores.push_back({prefix.substr(prefix.rfind('.') + 1), kv.second, c->second});
+        } else if (endsWith(n, ".hGETS")) {
+            std::string prefix = n.substr(0, n.size() - strlen(".hGETS"));
+            std::string group = prefix.substr(0, prefix.rfind('.'));
+            CacheIdx& ci = caches[group];
+            ci.name = group.substr(group.rfind('.') + 1);
+            for (const char* h : hitNames) if (idx.count(prefix + "." + h)) ci.hits.push_back(idx[prefix + "." + h]);
+            for (const char* m : missNames) if (idx.count(prefix + "." + m)) ci.misses.push_back(idx[prefix + "." + m]);
+        }
+    }
+    std::sort(cores.begin(), cores.end(), [&](const CoreIdx& a, const CoreIdx& b) { return a.instrs < b.instrs; });  // tree order
+    auto timeIdx = [&](const char* state) { auto it = idx.find(std::string("root.time.") + state); return (it == idx.end())? -1 : (int64_t)it->second; };
+    int64_t boundIdx = timeIdx("bound");
+    int64_t weaveIdx = timeIdx("weave");
+
+    std::vector<uint64_t> cur(numStats), prev(numStats, 0);
+    uint64_t prevPhase = 0, prevNs = 0;
+    bool first = true;
+    while (true) {
+        uint64_t phase, updateNs;
+        bool finished;
+        if (!LiveStatsSnapshot(hdr, cur.data(), phase, updateNs, finished)) {
+            usleep(10*1000);
+            continue;
+        }
+
+        // Deltas since the last refresh (since the start on the first one)
+        auto d = [&](uint32_t i) { return (double)(cur[i] - prev[i]); };
+        double intervalSecs = first? 0.0 : (updateNs - prevNs)*1e-9;
+        double phases = phase - prevPhase;
+
+        printf("\033[H\033[2J");
+        printf("zsim live stats: %s%s\n", segName.c_str(), finished? "  [FINISHED]" : "");
+        printf("Phase %ld (%.1f Mcycles)", phase, phase*hdr->phaseLength*1e-6);
+        if (intervalSecs > 0) printf(", %.1f phases/s, %.2f Mcycles/s", phases/intervalSecs, phases*hdr->phaseLength/intervalSecs*1e-6);
+        if (boundIdx >= 0 && weaveIdx >= 0) {
+            double bound = d(boundIdx), weave = d(weaveIdx);
+            printf(", bound %.1f%% / weave %.1f%%", 100.0*ratio(bound, bound + weave), 100.0*ratio(weave, bound + weave));
+        }
+        printf("\n\n");
+
+        double totalInstrs = 0.0;
+        for (auto& c : cores) totalInstrs += d(c.instrs);
+
+        printf("%-16s %14s %12s %10s\n", "Cache", "Accesses", "Miss rate", "MPKI");
+        for (auto& kv : caches) {
+            const CacheIdx& ci = kv.second;
+            double hits = 0.0, misses = 0.0;
+            for (uint32_t i : ci.hits) hits += d(i);
+            for (uint32_t i : ci.misses) misses += d(i);
+            printf("%-16s %14.0f %11.2f%% %10.3f\n", ci.name.c_str(), hits + misses, 100.0*ratio(misses, hits + misses), 1000.0*ratio(misses, totalInstrs));
+        }
+        printf("\n");
+
+        printf("%-16s %14s %14s %8s\n", "Core", "Instrs", "Cycles", "IPC");
+        double totalCycles = 0.0;
+        for (auto& c : cores) {
+            double instrs = d(c.instrs), cycles = d(c.cycles);
+            totalCycles += cycles;
+            if (!instrs) continue;  // skip idle cores
+            printf("%-16s %14.0f %14.0f %8.3f\n", c.name.c_str(), instrs, cycles, ratio(instrs, cycles));
+        }
+        printf("%-16s %14.0f %14.0f %8.3f\n", "Total", totalInstrs, totalCycles, ratio(totalInstrs, totalCycles));
+        fflush(stdout);
+
+        if (finished) break;
+        prev.swap(cur);
+        prevPhase = phase;
+        prevNs = updateNs;
+        first = false;
+        usleep(refreshSecs*1e6);
+    }
+
+    munmap((void*)hdr, st.st_size);
+    return 0;
+}